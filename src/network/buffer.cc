@@ -5,6 +5,7 @@ namespace xkernel {
     // 统计缓冲区对象个数
     STATISTIC_IMPL(Buffer) 
     STATISTIC_IMPL(BufferString)
+    STATISTIC_IMPL(BufferSlice)
     STATISTIC_IMPL(BufferRaw) 
     STATISTIC_IMPL(BufferLikeString)
 }
\ No newline at end of file
@@ -2,9 +2,10 @@
  * 定义了socket中发送/接收数据时使用的缓冲区
  * 设计了三种缓冲区：
  * 1. Buffer: 抽象基类，定义了缓冲区的基本接口
- * 2. BufferOffset<C>: 基于偏移量的缓冲区实现
+ * 2. BufferOffset<C>: 基于偏移量的缓冲区实现, BufferSlice为其他缓冲区的切片
  * 3. BufferRaw: 原始缓冲区实现, 基于char*
  * 4. BufferLikeString: 类似于string的缓冲区实现, 基于std::string
+ * BufferRaw的数据以及各缓冲区对象本身(通过BufferArena::makeShared创建时)从BufferArena分配
 */
 #ifndef _BUFFER_H_
 #define _BUFFER_H_
@@ -19,6 +20,7 @@
 
 #include "utility.h"
 #include "resourcepool.h"
+#include "bufferarena.h"
 
 namespace xkernel {
 // 用于检查类型是否为指针的模板结构体
@@ -99,37 +101,38 @@ private:
 };
 
 using BufferString = BufferOffset<std::string>;
+using BufferSlice = BufferOffset<Buffer::Ptr>;  // 引用另一个缓冲区中的一段, 不拷贝数据
 
 class BufferRaw : public Buffer {
 public:
     using Ptr = std::shared_ptr<BufferRaw>;
 
-    static Ptr create() { return Ptr(new BufferRaw); }
-    
-    ~BufferRaw() override {
-        if (data_) {
-            delete [] data_;
-        }
+    // 对象、控制块和数据都从BufferArena分配
+    static Ptr create(size_t capacity = 0) {
+        struct Creator : public BufferRaw {
+            explicit Creator(size_t capacity) : BufferRaw(capacity) {}
+        };
+        return BufferArena::makeShared<Creator>(capacity);
     }
+    
+    ~BufferRaw() override { BufferArena::free(data_); }
 
 public:
     char* data() const override { return data_; }
     size_t size() const override { return size_; }
     std::string toString() const override { return std::string(data(), size()); }
     size_t getCapacity() const override {return capacity_; }
+    // 容量会向上取整到BufferArena的大小等级, 当前容量足够时直接复用
     void setCapacity(size_t capacity) {
         if (data_) {
-            do{
-                if (capacity > capacity_) {
-                    break;
-                }
-                if (capacity <= capacity_) {
-                    break;
-                }
-            } while (false);
+            if (capacity <= capacity_) {
+                return;
+            }
+            BufferArena::free(data_);
+            data_ = nullptr;
+            capacity_ = 0;
         }
-        data_ = new char[capacity];
-        capacity_ = capacity;
+        data_ = static_cast<char*>(BufferArena::alloc(capacity, capacity_));
     }
     virtual void setSize(size_t size) {
         if (size > capacity_) {
@@ -0,0 +1,266 @@
+#include "bufferarena.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace xkernel {
+
+static constexpr size_t kClassCount = 12;  // 64 << 11 = 128KB
+static constexpr uint32_t kLargeClass = kClassCount;
+static constexpr size_t kCacheBytes = 1024 * 1024;  // 每个线程每个大小等级最多缓存的字节数
+
+struct ThreadCache;
+
+// 每个内存块前的头部, 数据区紧随其后, 保持16字节对齐
+struct alignas(16) BlockHeader {
+    ThreadCache* owner;  // 分配该内存块的线程缓存, 释放时归还给它
+    BlockHeader* next;  // 在空闲链表或归还栈中时使用
+    size_t capacity;
+    uint32_t cls;
+};
+
+struct ThreadCache {
+    BlockHeader* free_[kClassCount] = {};  // 空闲链表, 只有所属线程访问
+    size_t free_count_[kClassCount] = {};
+    std::atomic<BlockHeader*> returned_{nullptr};  // 其他线程归还的内存块
+    std::atomic<bool> orphaned_{false};  // 所属线程已退出, 归还的内存块直接释放
+    // 统计信息, 一般只由所属线程更新
+    std::atomic<uint64_t> alloc_count_{0};
+    std::atomic<uint64_t> malloc_count_{0};
+    std::atomic<uint64_t> alloc_bytes_{0};
+    std::atomic<uint64_t> free_bytes_{0};
+    std::atomic<int64_t> cached_bytes_{0};
+};
+
+// 所有创建过的线程缓存, 不会被释放, 线程退出后留给新线程复用
+struct CacheRegistry {
+    std::mutex mtx;
+    std::vector<ThreadCache*> all;
+    std::vector<ThreadCache*> orphans;
+};
+
+static CacheRegistry& registry() {
+    static auto instance = new CacheRegistry;  // 故意不释放, 避免与线程局部变量的析构顺序冲突
+    return *instance;
+}
+
+static inline size_t classSize(uint32_t cls) { return BufferArena::kMinSize << cls; }
+
+static inline uint32_t sizeClass(size_t size) {
+    if (size <= BufferArena::kMinSize) {
+        return 0;
+    }
+    return static_cast<uint32_t>(64 - __builtin_clzll(size - 1)) - 6;
+}
+
+static inline size_t maxCached(uint32_t cls) {
+    auto count = kCacheBytes / classSize(cls);
+    return count < 8 ? 8 : (count > 1024 ? 1024 : count);
+}
+
+// 归还栈是多生产者单消费者的, 消费者一次取走整个栈, 不存在ABA问题
+static void pushReturned(ThreadCache* cache, BlockHeader* block) {
+    auto head = cache->returned_.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!cache->returned_.compare_exchange_weak(head, block, std::memory_order_seq_cst, std::memory_order_relaxed));
+}
+
+static void freeList(BlockHeader* block) {
+    while (block) {
+        auto next = block->next;
+        std::free(block);
+        block = next;
+    }
+}
+
+static ThreadCache* acquireCache() {
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    if (!reg.orphans.empty()) {
+        auto cache = reg.orphans.back();
+        reg.orphans.pop_back();
+        cache->orphaned_.store(false, std::memory_order_seq_cst);
+        return cache;
+    }
+    auto cache = new ThreadCache;
+    reg.all.emplace_back(cache);
+    return cache;
+}
+
+// 先标记为已退出再取走归还栈, 与pushReturned之后检查orphaned_配合, 保证归还的内存块不会遗留
+static void releaseCache(ThreadCache* cache) {
+    cache->orphaned_.store(true, std::memory_order_seq_cst);
+    freeList(cache->returned_.exchange(nullptr, std::memory_order_seq_cst));
+    for (uint32_t cls = 0; cls < kClassCount; ++cls) {
+        freeList(cache->free_[cls]);
+        cache->free_[cls] = nullptr;
+        cache->free_count_[cls] = 0;
+    }
+    cache->cached_bytes_.store(0, std::memory_order_relaxed);
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    reg.orphans.emplace_back(cache);
+}
+
+// 线程退出过程中(线程缓存已经释放)使用的缓存, 始终处于已退出状态, 分配的内存块释放时直接归还系统
+static ThreadCache* exitCache() {
+    static auto cache = []() {
+        auto cache = new ThreadCache;
+        cache->orphaned_.store(true);
+        std::lock_guard<std::mutex> lock(registry().mtx);
+        registry().all.emplace_back(cache);
+        return cache;
+    }();
+    return cache;
+}
+
+enum class CacheState : uint8_t { None, Active, Exited };
+static thread_local CacheState t_state = CacheState::None;
+static thread_local ThreadCache* t_cache = nullptr;
+
+struct CacheHolder {
+    ~CacheHolder() {
+        if (t_cache) {
+            releaseCache(t_cache);
+        }
+        t_state = CacheState::Exited;
+    }
+};
+
+static inline ThreadCache* localCache() {
+    if (t_state == CacheState::Active) {
+        return t_cache;
+    }
+    if (t_state == CacheState::Exited) {
+        return exitCache();
+    }
+    static thread_local CacheHolder holder;
+    (void)holder;
+    t_cache = acquireCache();
+    t_state = CacheState::Active;
+    return t_cache;
+}
+
+// 线程缓存的统计信息只有所属线程写入, 不需要原子的读改写; 退出过程中使用的公共缓存除外
+template <typename T>
+static inline void addStat(std::atomic<T>& stat, T value) {
+    if (t_state == CacheState::Active) {
+        stat.store(stat.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    } else {
+        stat.fetch_add(value, std::memory_order_relaxed);
+    }
+}
+
+void* BufferArena::alloc(size_t size, size_t& capacity) {
+    auto cache = localCache();
+    bool local = t_state == CacheState::Active;
+    uint32_t cls = size > kMaxSize ? kLargeClass : sizeClass(size);
+    BlockHeader* block = nullptr;
+    if (cls != kLargeClass && local) {
+        block = cache->free_[cls];
+        if (!block) {
+            // 取回其他线程归还的内存块
+            auto returned = cache->returned_.exchange(nullptr, std::memory_order_acquire);
+            while (returned) {
+                auto next = returned->next;
+                if (cache->free_count_[returned->cls] >= maxCached(returned->cls)) {
+                    std::free(returned);
+                    returned = next;
+                    continue;
+                }
+                returned->next = cache->free_[returned->cls];
+                cache->free_[returned->cls] = returned;
+                ++cache->free_count_[returned->cls];
+                addStat<int64_t>(cache->cached_bytes_, returned->capacity);
+                returned = next;
+            }
+            block = cache->free_[cls];
+        }
+        if (block) {
+            cache->free_[cls] = block->next;
+            --cache->free_count_[cls];
+            addStat<int64_t>(cache->cached_bytes_, -static_cast<int64_t>(block->capacity));
+        }
+    }
+    if (!block) {
+        auto block_size = cls == kLargeClass ? size : classSize(cls);
+        block = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + block_size));
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        block->capacity = block_size;
+        block->cls = cls;
+        addStat<uint64_t>(cache->malloc_count_, 1);
+    }
+    block->owner = cache;
+    block->next = nullptr;
+    addStat<uint64_t>(cache->alloc_count_, 1);
+    addStat<uint64_t>(cache->alloc_bytes_, block->capacity);
+    capacity = block->capacity;
+    return block + 1;
+}
+
+void BufferArena::free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    auto block = static_cast<BlockHeader*>(ptr) - 1;
+    auto cache = localCache();
+    addStat<uint64_t>(cache->free_bytes_, block->capacity);
+    if (block->cls == kLargeClass) {
+        std::free(block);
+        return;
+    }
+    auto owner = block->owner;
+    if (owner == cache && t_state == CacheState::Active) {
+        if (cache->free_count_[block->cls] >= maxCached(block->cls)) {
+            std::free(block);
+            return;
+        }
+        block->next = cache->free_[block->cls];
+        cache->free_[block->cls] = block;
+        ++cache->free_count_[block->cls];
+        addStat<int64_t>(cache->cached_bytes_, block->capacity);
+        return;
+    }
+    pushReturned(owner, block);
+    if (owner->orphaned_.load(std::memory_order_seq_cst)) {
+        freeList(owner->returned_.exchange(nullptr, std::memory_order_seq_cst));
+    }
+}
+
+template <typename Func>
+static uint64_t sumCaches(Func&& func) {
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    int64_t sum = 0;
+    for (auto cache : reg.all) {
+        sum += func(cache);
+    }
+    return sum > 0 ? static_cast<uint64_t>(sum) : 0;
+}
+
+uint64_t BufferArena::allocCount() {
+    return sumCaches([](ThreadCache* cache) { return cache->alloc_count_.load(std::memory_order_relaxed); });
+}
+
+uint64_t BufferArena::mallocCount() {
+    return sumCaches([](ThreadCache* cache) { return cache->malloc_count_.load(std::memory_order_relaxed); });
+}
+
+uint64_t BufferArena::bytesInUse() {
+    return sumCaches([](ThreadCache* cache) {
+        return static_cast<int64_t>(cache->alloc_bytes_.load(std::memory_order_relaxed)) -
+               static_cast<int64_t>(cache->free_bytes_.load(std::memory_order_relaxed));
+    });
+}
+
+uint64_t BufferArena::bytesCached() {
+    return sumCaches([](ThreadCache* cache) { return cache->cached_bytes_.load(std::memory_order_relaxed); });
+}
+
+}  // namespace xkernel
@@ -0,0 +1,72 @@
+/*
+ * 缓冲区内存池, 为Buffer的数据和对象本身分配内存
+ *
+ * 按2的幂划分大小等级(64字节~128KB), 超出最大等级的直接使用malloc
+ * 每个线程(一般是EventPoller线程)有自己的空闲链表, 本线程分配和释放不需要加锁
+ * 在其他线程释放的内存块放回所属线程的归还栈(无锁), 所属线程的空闲链表为空时一次性取回
+ * 线程退出时释放空闲链表中的内存, 线程缓存保留下来给之后创建的线程复用
+ */
+#ifndef _BUFFERARENA_H_
+#define _BUFFERARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace xkernel {
+
+class BufferArena {
+public:
+    static constexpr size_t kMinSize = 64;
+    static constexpr size_t kMaxSize = 128 * 1024;
+
+    // 分配至少size字节, capacity返回实际可用的大小
+    static void* alloc(size_t size, size_t& capacity);
+    static void* alloc(size_t size) {
+        size_t capacity;
+        return alloc(size, capacity);
+    }
+    // 可以在任意线程释放
+    static void free(void* ptr);
+
+    // 对象和shared_ptr控制块在同一块内存中分配
+    template <typename T, typename... ArgTypes>
+    static std::shared_ptr<T> makeShared(ArgTypes&&... args);
+
+    // 统计信息, 所有线程的汇总
+    static uint64_t allocCount();  // 累计分配次数
+    static uint64_t mallocCount();  // 累计向系统申请内存的次数, 其余的分配都命中了空闲链表
+    static uint64_t bytesInUse();  // 已分配未释放的字节数(按实际容量计算)
+    static uint64_t bytesCached();  // 空闲链表中缓存的字节数
+
+private:
+    BufferArena() = delete;
+};
+
+// 供标准库容器和std::allocate_shared使用的分配器
+template <typename T>
+class BufferArenaAllocator {
+public:
+    using value_type = T;
+
+    BufferArenaAllocator() = default;
+    template <typename U>
+    BufferArenaAllocator(const BufferArenaAllocator<U>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(BufferArena::alloc(n * sizeof(T))); }
+    void deallocate(T* ptr, size_t) { BufferArena::free(ptr); }
+
+    template <typename U>
+    bool operator==(const BufferArenaAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const BufferArenaAllocator<U>&) const { return false; }
+};
+
+template <typename T, typename... ArgTypes>
+std::shared_ptr<T> BufferArena::makeShared(ArgTypes&&... args) {
+    return std::allocate_shared<T>(BufferArenaAllocator<T>(), std::forward<ArgTypes>(args)...);
+}
+
+}  // namespace xkernel
+#endif  // _BUFFERARENA_H_
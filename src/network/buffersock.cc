@@ -1,5 +1,12 @@
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/udp.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <utility>
@@ -33,23 +40,74 @@ socklen_t BufferSock::socklen() const { return addr_len_; }
 std::string BufferSock::toString() const { return buffer_->toString(); }
 size_t BufferSock::getCapacity() const { return buffer_->getCapacity(); }
 
+///////////////////////////////////// BufferFile //////////////////////////////////////
+
+BufferFile::Ptr BufferFile::create(int fd, off_t offset, size_t len) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || offset < 0 || offset > st.st_size) {
+        return nullptr;
+    }
+    if (len == 0 || offset + static_cast<off_t>(len) > st.st_size) {
+        len = st.st_size - offset;
+    }
+    int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd == -1) {
+        return nullptr;
+    }
+    return std::make_shared<BufferFile>(dup_fd, offset, len);
+}
+
+BufferFile::BufferFile(int fd, off_t offset, size_t len) : fd_(fd), offset_(offset), len_(len) {}
+
+BufferFile::~BufferFile() { close(fd_); }
+
+std::string BufferFile::toString() const {
+    std::string ret(len_, '\0');
+    size_t total = 0;
+    while (total < len_) {
+        auto n = pread(fd_, &ret[total], len_ - total, offset_ + total);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        total += n;
+    }
+    ret.resize(total);
+    return ret;
+}
+
 ///////////////////////////////////// SocketRecvBuffer //////////////////////////////////////
 
 static constexpr auto kPacketCount = 32;
 static constexpr auto kBufferCapacity = 4 * 1024u;
 
-SocketRecvBuffer::Ptr SocketRecvBuffer::create(bool is_udp) {
+static constexpr auto kRingBlockSize = 256 * 1024u;
+static constexpr auto kRingBlockCount = 4u;
+static constexpr auto kRingMinFree = 4 * 1024u;  // 当前内存块剩余空间不足时切换到下一块
+
+static constexpr auto kGroPacketCount = 8;
+static constexpr auto kGroBufferCapacity = 64 * 1024u;  // 内核合并后的数据包不超过64KB
+
+SocketRecvBuffer::Ptr SocketRecvBuffer::create(bool is_udp, bool use_ring, bool udp_gro) {
+    if (is_udp && udp_gro) {
+        return std::make_shared<SocketRecvmmsgBuffer>(kGroPacketCount, kGroBufferCapacity, true);
+    }
     if (is_udp) {
         return std::make_shared<SocketRecvmmsgBuffer>(kPacketCount, kBufferCapacity);
     }
+    if (use_ring) {
+        return std::make_shared<SocketRecvRingBuffer>(kRingBlockSize, kRingBlockCount);
+    }
     return std::make_shared<SocketRecvFromBuffer>(kPacketCount * kBufferCapacity);
 }
 
 ///////////////////////////////////// BufferList //////////////////////////////////////
 
-BufferList::Ptr BufferList::create(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb, bool is_udp) {
+BufferList::Ptr BufferList::create(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb, bool is_udp, bool udp_gso) {
     if (is_udp) {
-        return std::make_shared<BufferSendMMsg>(std::move(list), std::move(cb));
+        return std::make_shared<BufferSendMMsg>(std::move(list), std::move(cb), udp_gso);
     }
     return std::make_shared<BufferSendMsg>(std::move(list), std::move(cb));
 }
@@ -94,10 +152,11 @@ BufferSendMsg::BufferSendMsg(List<std::pair<Buffer::Ptr, bool>> list, SendResult
 
 bool BufferSendMsg::empty() { return remain_size_ == 0; }
 size_t BufferSendMsg::count() { return iovec_.size() - iovec_off_; }
+size_t BufferSendMsg::remainSize() { return remain_size_; }
 
 ssize_t BufferSendMsg::send(int fd, int flags) {
     auto remain_size = remain_size_;
-    while (remain_size && send_l(fd, flags) != -1)
+    while (remain_size_ && send_l(fd, flags) != -1)
         ;
     ssize_t sent = remain_size - remain_size_;
     if (sent > 0) {
@@ -123,6 +182,9 @@ ssize_t BufferSendMsg::send_l(int fd, int flags) {
         n = sendmsg(fd, &msg, flags);
     } while (-1 == n && UV_EINTR == get_uv_error(true));
 
+    if (n > 0) {
+        ++send_calls_;
+    }
     if (n >= static_cast<ssize_t>(remain_size_)) {
         remain_size_ = 0;
         sendCompleted(true); // 全部发送成功   
@@ -135,6 +197,23 @@ ssize_t BufferSendMsg::send_l(int fd, int flags) {
     return n;
 }
 
+const struct msghdr* BufferSendMsg::asyncMsg() {
+    memset(&msg_, 0, sizeof(msg_));
+    msg_.msg_iov = &(iovec_[iovec_off_]);
+    msg_.msg_iovlen = std::min<size_t>(iovec_.size() - iovec_off_, IOV_MAX);
+    return &msg_;
+}
+
+void BufferSendMsg::asyncSent(size_t n) {
+    ++send_calls_;
+    if (n >= remain_size_) {
+        remain_size_ = 0;
+        sendCompleted(true);
+        return;
+    }
+    reOffset(n);
+}
+
 void BufferSendMsg::reOffset(size_t n) {
     remain_size_ -= n;
     size_t offset = 0;
@@ -213,17 +292,45 @@ ssize_t BufferSendTo::send(int fd, int flags) {
 
 ///////////////////////////////////// BufferSendMMsg //////////////////////////////////////
 
-BufferSendMMsg::BufferSendMMsg(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb) 
-    : BufferCallBack(std::move(list), std::move(cb)), iovec_(pkt_list_.size()), hdrvec_(pkt_list_.size()) {
+static constexpr auto kUdpGsoMaxSegments = 64u;  // 内核UDP_MAX_SEGMENTS
+static constexpr auto kUdpGsoMaxBytes = 65000u;  // 合并后的长度不能超过UDP长度字段
+static constexpr auto kUdpGsoMaxSegSize = 1452u;  // 段长不能超过路径MTU, 按以太网IPv6取值
+static constexpr auto kUdpGsoControlSize = CMSG_SPACE(sizeof(uint16_t));
+
+static bool isSameDst(const struct msghdr& msg, const BufferSock* ptr) {
+    if (!ptr) {
+        return msg.msg_name == nullptr;
+    }
+    return msg.msg_name && msg.msg_namelen == ptr->socklen() && memcmp(msg.msg_name, ptr->sockaddr(), ptr->socklen()) == 0;
+}
+
+BufferSendMMsg::BufferSendMMsg(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb, bool gso)
+    : BufferCallBack(std::move(list), std::move(cb)), iovec_(pkt_list_.size()) {
+        hdrvec_.reserve(pkt_list_.size());
         auto i = 0U;
+        size_t gso_bytes = 0;
         pkt_list_.forEach([&](std::pair<Buffer::Ptr, bool>& pr) {
-            auto& io = iovec_[i];
+            auto& io = iovec_[i++];
             io.iov_base = pr.first->data();
             io.iov_len = pr.first->size();
             remain_size_ += io.iov_len;
-            // 填充mmsg结构体
             auto ptr = getBufferSockPtr(pr);
-            auto& mmsg = hdrvec_[i];
+            if (gso && !hdrvec_.empty()) {
+                // 上一个消息的包都等于段长, 本包同一目标且不超过段长时并入该消息
+                auto& last = hdrvec_.back().msg_hdr;
+                auto seg = last.msg_iov->iov_len;
+                if (seg <= kUdpGsoMaxSegSize && io.iov_len <= seg && (&io - 1)->iov_len == seg &&
+                    last.msg_iovlen < kUdpGsoMaxSegments && gso_bytes + io.iov_len <= kUdpGsoMaxBytes &&
+                    isSameDst(last, ptr)) {
+                    ++last.msg_iovlen;
+                    gso_bytes += io.iov_len;
+                    return;
+                }
+            }
+            gso_bytes = io.iov_len;
+            // 填充mmsg结构体
+            hdrvec_.emplace_back();
+            auto& mmsg = hdrvec_.back();
             auto& msg = mmsg.msg_hdr;
             mmsg.msg_len = 0;
             msg.msg_name = ptr ? (void*)ptr->sockaddr() : nullptr;
@@ -233,12 +340,32 @@ BufferSendMMsg::BufferSendMMsg(List<std::pair<Buffer::Ptr, bool>> list, SendResu
             msg.msg_control = nullptr;
             msg.msg_controllen = 0;
             msg.msg_flags = 0;
-            ++i;
         });
+#ifdef UDP_SEGMENT
+        if (!gso || hdrvec_.size() == pkt_list_.size()) {
+            return;
+        }
+        // 合并了多个包的消息附带段长, 内核按段长切分
+        control_.resize(hdrvec_.size() * kUdpGsoControlSize);
+        for (auto k = 0U; k < hdrvec_.size(); ++k) {
+            auto& msg = hdrvec_[k].msg_hdr;
+            if (msg.msg_iovlen == 1) {
+                continue;
+            }
+            msg.msg_control = &control_[k * kUdpGsoControlSize];
+            msg.msg_controllen = kUdpGsoControlSize;
+            auto cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t seg = msg.msg_iov->iov_len;
+            memcpy(CMSG_DATA(cmsg), &seg, sizeof(seg));
+        }
+#endif
 }
 
 bool BufferSendMMsg::empty() { return remain_size_ == 0; }
-size_t BufferSendMMsg::count() { return hdrvec_.size(); }
+size_t BufferSendMMsg::count() { return pkt_list_.size(); }
 
 ssize_t BufferSendMMsg::send(int fd, int flags) {
     auto remain_size = remain_size_;
@@ -262,18 +389,51 @@ ssize_t BufferSendMMsg::send_l(int fd, int flags) {
         reOffset(n);
         return n;
     }
+    // 网卡不支持校验和卸载等原因导致合并消息发送失败时, 拆开后重新发送这一批, 不丢弃数据
+    if (-1 == n && (errno == EIO || errno == EINVAL) && !gso_failed_ && !hdrvec_.empty() &&
+        hdrvec_[0].msg_hdr.msg_iovlen > 1) {
+        splitGso();
+        return send_l(fd, flags);
+    }
     return n;
 }
 
+void BufferSendMMsg::splitGso() {
+    gso_failed_ = true;
+    std::vector<struct mmsghdr> hdrvec;
+    for (auto& hdr : hdrvec_) {
+        for (auto k = 0U; k < hdr.msg_hdr.msg_iovlen; ++k) {
+            hdrvec.emplace_back(hdr);
+            auto& msg = hdrvec.back().msg_hdr;
+            msg.msg_iov = hdr.msg_hdr.msg_iov + k;
+            msg.msg_iovlen = 1;
+            msg.msg_control = nullptr;
+            msg.msg_controllen = 0;
+        }
+    }
+    hdrvec_ = std::move(hdrvec);
+}
+
 void BufferSendMMsg::reOffset(size_t n) {
-    for (auto it = hdrvec_.begin(); it != hdrvec_.end(); ) {
+    auto it = hdrvec_.begin();
+    for (; it != hdrvec_.end(); ++it) {
         auto& hdr = *it;
+        if (hdr.msg_hdr.msg_iovlen > 1) {
+            // GSO消息整体发送
+            if (!hdr.msg_len) {
+                break;
+            }
+            remain_size_ -= hdr.msg_len;
+            for (auto k = 0U; k < hdr.msg_hdr.msg_iovlen; ++k) {
+                sendFrontSuccess();
+            }
+            continue;
+        }
         auto& io = *(hdr.msg_hdr.msg_iov);
         assert(hdr.msg_len <= io.iov_len);
         remain_size_ -= hdr.msg_len;
         if (hdr.msg_len == io.iov_len) {
             // 这个udp包全部发送成功
-            it = hdrvec_.erase(it);  // 返回移除元素之后元素的迭代器
             sendFrontSuccess();
             continue;
         }
@@ -282,47 +442,153 @@ void BufferSendMMsg::reOffset(size_t n) {
         io.iov_len -= hdr.msg_len;
         break;
     }
+    hdrvec_.erase(hdrvec_.begin(), it);  // 一次移除所有发送完毕的消息
+}
+
+///////////////////////////////////// BufferSendFile //////////////////////////////////////
+
+static constexpr auto kSendFileChunk = 1024 * 1024u;  // 单次sendfile的最大长度
+
+BufferSendFile::BufferSendFile(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb)
+    : BufferCallBack(std::move(list), std::move(cb)) {
+    assert(pkt_list_.size() == 1);
+    file_ = std::dynamic_pointer_cast<BufferFile>(pkt_list_.front().first);
+    assert(file_);
+}
+
+bool BufferSendFile::empty() { return sent_ == file_->size(); }
+size_t BufferSendFile::count() { return empty() ? 0 : 1; }
+size_t BufferSendFile::remainSize() { return file_->size() - sent_; }
+
+ssize_t BufferSendFile::send(int fd, int flags) {
+    // sendfile没有MSG_NOSIGNAL, 对端关闭时临时屏蔽SIGPIPE, 并清除产生的信号
+    sigset_t pipe_set, old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    ssize_t total = 0;
+    while (!empty()) {
+        off_t offset = file_->offset() + sent_;
+        auto n = sendfile(fd, file_->fd(), &offset, std::min<size_t>(remainSize(), kSendFileChunk));
+        if (n > 0) {
+            sent_ += n;
+            total += n;
+            continue;
+        }
+        if (n == 0) {
+            errno = EIO;  // 文件被截断, 无法再发送
+            total = -1;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EPIPE && !sigismember(&old_set, SIGPIPE)) {
+            struct timespec ts = {0, 0};
+            sigtimedwait(&pipe_set, nullptr, &ts);
+            errno = EPIPE;
+        }
+        break;
+    }
+    auto err = errno;
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    errno = err;
+
+    if (empty()) {
+        sendCompleted(true);
+    }
+    if (total > 0) {
+        return total;
+    }
+    return -1;
 }
 
 ///////////////////////////////////// SocketRecvmmsgBuffer //////////////////////////////////////
 
-SocketRecvmmsgBuffer::SocketRecvmmsgBuffer(size_t count, size_t size) 
-    : size_(size), iovec_(count), mmsgs_(count), buffers_(count), address_(count) {
-    for (auto i = 0u;  i < count; ++i) {
-        auto buf = BufferRaw::create();
-        buf->setCapacity(size);
+static constexpr auto kGroControlSize = CMSG_SPACE(sizeof(int));
+static constexpr auto kMinBatch = 4u;  // 自适应调整时的最小批大小
+
+static RecvmmsgOptions makeRecvmmsgOptions(size_t count, size_t size, bool gro) {
+    RecvmmsgOptions options;
+    options.count = count;
+    options.size = size;
+    options.gro = gro;
+    return options;
+}
+
+SocketRecvmmsgBuffer::SocketRecvmmsgBuffer(size_t count, size_t size, bool gro)
+    : SocketRecvmmsgBuffer(makeRecvmmsgOptions(count, size, gro)) {}
 
-        buffers_[i] = buf;
+SocketRecvmmsgBuffer::SocketRecvmmsgBuffer(const RecvmmsgOptions& options)
+    : options_(options), batch_(options.count), iovec_(options.count), mmsgs_(options.count),
+      buffers_(options.count), address_(options.count), control_(options.gro ? options.count * kGroControlSize : 0) {
+    assert(options_.count > 0);
+    if (options_.gro) {
+        options_.size = std::max<size_t>(options_.size, kGroBufferCapacity);
+    }
+    for (auto i = 0u;  i < options_.count; ++i) {
         auto& mmsg = mmsgs_[i];
         auto& addr = address_[i];
         mmsg.msg_len = 0;
         mmsg.msg_hdr.msg_name = &addr;
         mmsg.msg_hdr.msg_namelen = sizeof(addr);
         mmsg.msg_hdr.msg_iov = &iovec_[i];
-        mmsg.msg_hdr.msg_iov->iov_base = buf->data();
-        mmsg.msg_hdr.msg_iov->iov_len = buf->getCapacity() - 1;
         mmsg.msg_hdr.msg_iovlen = 1;
-        mmsg.msg_hdr.msg_control = nullptr;
+        mmsg.msg_hdr.msg_control = options_.gro ? &control_[i * kGroControlSize] : nullptr;
         mmsg.msg_hdr.msg_controllen = 0;
         mmsg.msg_hdr.msg_flags = 0;
+        setSlot(i, allocBuffer());
+    }
+}
+
+Buffer::Ptr SocketRecvmmsgBuffer::allocBuffer() {
+    for (auto& buf : lent_) {
+        if (buf.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);  // 与应用线程释放时的写入同步
+            auto ret = std::move(buf);
+            buf = std::move(lent_.back());
+            lent_.pop_back();
+            return ret;
+        }
     }
+    ++alloc_count_;
+    return BufferRaw::create(options_.size);
+}
+
+void SocketRecvmmsgBuffer::setSlot(size_t index, Buffer::Ptr buf) {
+    iovec_[index].iov_base = buf->data();
+    iovec_[index].iov_len = buf->getCapacity() - 1;
+    buffers_[index] = std::move(buf);
 }
 
 ssize_t SocketRecvmmsgBuffer::recvFromSocket(int fd, ssize_t& count) {
+    // 释放上次交给读回调的副本, 之后引用计数大于1的缓冲区说明被应用保留
+    out_buffers_.clear();
+    out_address_.clear();
     for (auto i = 0u; i < last_count_; ++i) {
         auto& mmsg = mmsgs_[i];
         mmsg.msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
         auto& buf = buffers_[i];
         if (!buf) {
-            auto raw = BufferRaw::create();
-            raw->setCapacity(size_);
-            buf = raw;
-            mmsg.msg_hdr.msg_iov->iov_base = buf->data();
+            setSlot(i, allocBuffer());  // 被读回调移走
+        } else if ((options_.recycle || options_.gro) && buf.use_count() > 1) {
+            // 先取替换的缓冲区再登记被保留的, 避免回收列表已满时丢掉刚释放出来的位置
+            auto retained = std::move(buf);
+            setSlot(i, allocBuffer());
+            if (options_.recycle && lent_.size() < options_.count) {
+                lent_.emplace_back(std::move(retained));
+            }
+        }
+    }
+    if (options_.gro) {
+        for (auto i = 0u; i < batch_; ++i) {
+            mmsgs_[i].msg_hdr.msg_controllen = kGroControlSize;
         }
     }
     do {
         // 将接收到的count条消息依次存到mmsgs_数组中
-        count = recvmmsg(fd, &mmsgs_[0], mmsgs_.size(), 0, nullptr);
+        count = recvmmsg(fd, &mmsgs_[0], batch_, 0, nullptr);
     } while (-1 == count && UV_EINTR == get_uv_error(true));
 
     last_count_ = count;
@@ -340,11 +606,76 @@ ssize_t SocketRecvmmsgBuffer::recvFromSocket(int fd, ssize_t& count) {
         buf->setSize(mmsg.msg_len);
         buf->data()[mmsg.msg_len] = '\0';
     }
+    if (options_.adaptive) {
+        adjustBatch(count);
+    }
+    if (options_.gro) {
+        count = splitGro(count);
+    } else if (options_.recycle) {
+        out_buffers_.assign(buffers_.begin(), buffers_.begin() + count);
+    }
     return nread;
 }
 
-Buffer::Ptr& SocketRecvmmsgBuffer::getBuffer(size_t index) { return buffers_[index]; }
-struct sockaddr_storage& SocketRecvmmsgBuffer::getAddress(size_t index) { return address_[index]; }
+void SocketRecvmmsgBuffer::adjustBatch(size_t count) {
+    avg_x16_ = avg_x16_ - avg_x16_ / 8 + count * 2;
+    if (count == batch_ && batch_ < options_.count) {
+        // 本次收满, 下次多收一些
+        auto batch = std::min(batch_ * 2, options_.count);
+        for (auto i = batch_; i < batch; ++i) {
+            if (!buffers_[i]) {
+                setSlot(i, allocBuffer());
+            }
+            mmsgs_[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        }
+        batch_ = batch;
+        return;
+    }
+    if (batch_ > kMinBatch && avg_x16_ < batch_ * 4) {
+        // 平均不到批大小的1/4, 减小批大小并释放多余的缓冲区, 本次收到数据的槽位保留
+        auto batch = std::max<size_t>(batch_ / 2, kMinBatch);
+        for (auto i = std::max(batch, count); i < batch_; ++i) {
+            buffers_[i] = nullptr;
+        }
+        batch_ = batch;
+    }
+}
+
+ssize_t SocketRecvmmsgBuffer::splitGro(ssize_t count) {
+    for (auto i = 0u; i < count; ++i) {
+        auto& hdr = mmsgs_[i].msg_hdr;
+        size_t len = mmsgs_[i].msg_len;
+        size_t seg = 0;
+#ifdef UDP_GRO
+        for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                int gso_size;
+                memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                seg = gso_size > 0 ? gso_size : 0;
+            }
+        }
+#endif
+        if (!seg || len <= seg) {
+            out_buffers_.emplace_back(buffers_[i]);
+            out_address_.emplace_back(address_[i]);
+            continue;
+        }
+        // 切片之间没有'\0'结尾, 只有最后一段有
+        for (size_t offset = 0; offset < len; offset += seg) {
+            out_buffers_.emplace_back(BufferArena::makeShared<BufferSlice>(buffers_[i], offset, std::min(seg, len - offset)));
+            out_address_.emplace_back(address_[i]);
+        }
+    }
+    return out_buffers_.size();
+}
+
+Buffer::Ptr& SocketRecvmmsgBuffer::getBuffer(size_t index) {
+    return options_.gro || options_.recycle ? out_buffers_[index] : buffers_[index];
+}
+
+struct sockaddr_storage& SocketRecvmmsgBuffer::getAddress(size_t index) {
+    return options_.gro ? out_address_[index] : address_[index];
+}
 
 ///////////////////////////////////// SocketRecvFromBuffer //////////////////////////////////////
 
@@ -374,9 +705,78 @@ Buffer::Ptr& SocketRecvFromBuffer::getBuffer(size_t index) { return buffer_; }
 struct sockaddr_storage& SocketRecvFromBuffer::getAddress(size_t index) { return address_; }
 
 void SocketRecvFromBuffer::allocBuffer() {
-    auto buf = BufferRaw::create();
-    buf->setCapacity(size_);
-    buffer_ = std::move(buf);
+    buffer_ = BufferRaw::create(size_);
+}
+
+///////////////////////////////////// SocketRecvRingBuffer //////////////////////////////////////
+
+SocketRecvRingBuffer::SocketRecvRingBuffer(size_t block_size, size_t block_count)
+    : block_size_(block_size), blocks_(block_count < 2 ? 2 : block_count) {
+    memset(address_, 0, sizeof(address_));
 }
 
+void SocketRecvRingBuffer::ensureFree(size_t index) {
+    auto& block = blocks_[index];
+    if (block && block.use_count() == 1) {
+        // 切片在其他线程释放, 之后才能覆写其中的数据
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return;
+    }
+    block = BufferRaw::create(block_size_);
+    block->setSize(block->getCapacity());
+    ++block_alloc_count_;
+}
+
+Buffer::Ptr SocketRecvRingBuffer::slice(size_t index, size_t offset, size_t size) {
+    auto& block = blocks_[index];
+    block->data()[offset + size] = '\0';
+    return BufferArena::makeShared<BufferSlice>(block, offset, size);
+}
+
+ssize_t SocketRecvRingBuffer::recvFromSocket(int fd, ssize_t& count) {
+    // 释放上一次交给会话的切片, 会话需要保留时自行持有
+    slices_[0] = nullptr;
+    slices_[1] = nullptr;
+    if (!blocks_[current_] || blocks_[current_]->getCapacity() - offset_ <= kRingMinFree) {
+        current_ = (current_ + 1) % blocks_.size();
+        offset_ = 0;
+        ensureFree(current_);
+    }
+    auto next = (current_ + 1) % blocks_.size();
+    ensureFree(next);
+
+    // 每段末尾保留一个字节写入'\0'
+    auto first_len = blocks_[current_]->getCapacity() - offset_ - 1;
+    struct iovec iov[2];
+    iov[0].iov_base = blocks_[current_]->data() + offset_;
+    iov[0].iov_len = first_len;
+    iov[1].iov_base = blocks_[next]->data();
+    iov[1].iov_len = blocks_[next]->getCapacity() - 1;
+
+    ssize_t nread;
+    do {
+        nread = readv(fd, iov, 2);
+    } while (-1 == nread && UV_EINTR == get_uv_error(true));
+
+    if (nread <= 0) {
+        return nread;
+    }
+    if (static_cast<size_t>(nread) <= first_len) {
+        count = 1;
+        slices_[0] = slice(current_, offset_, nread);
+        offset_ += nread + 1;
+        return nread;
+    }
+    count = 2;
+    slices_[0] = slice(current_, offset_, first_len);
+    current_ = next;
+    offset_ = nread - first_len;
+    slices_[1] = slice(current_, 0, offset_);
+    ++offset_;
+    return nread;
+}
+
+Buffer::Ptr& SocketRecvRingBuffer::getBuffer(size_t index) { return slices_[index]; }
+struct sockaddr_storage& SocketRecvRingBuffer::getAddress(size_t index) { return address_[index]; }
+
 } // namespace xkernel
\ No newline at end of file
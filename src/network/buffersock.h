@@ -1,13 +1,16 @@
 /*
 *  该文件封装了socket中的发送/接收数据的系统调用
 *  BufferSock: 封装目标地址和相应的buffer, udp需要指定目的地址
+*  BufferFile: 文件中的一段, 数据不读入内存
 *  BufferList: 封装了对缓冲区列表的操作的基类, send(), size(), empty()
 *  BufferCallBack: 封装对缓冲区列表的操作, 根据发送的结果，调整List中的内容
 *  BufferSendMsg: sendmsg()
 *  BufferSendTo: sendto()/send()
-*  BufferSendMMsg: sendmmsg()
+*  BufferSendMMsg: sendmmsg(), 可用UDP_SEGMENT把同一目标的连续等长数据包合并为一次发送
+*  BufferSendFile: sendfile()
 *  SocketRecvFromBuffer: recvfrom()
-*  SocketRecvmmsgBuffer: recvmmsg()
+*  SocketRecvmmsgBuffer: recvmmsg(), 批大小和缓冲区大小可配置, 可复用缓冲区, 可按UDP_GRO的段长拆分内核合并的数据包
+*  SocketRecvRingBuffer: readv()到共享的接收环, 交给会话的是引用其中一段的切片
 * BufferList和BufferCallBack可以重构到一起
 */
 
@@ -52,12 +55,36 @@ private:
     Buffer::Ptr buffer_;
 };
 
+// 文件中的一段数据, 由BufferSendFile通过sendfile直接从文件发送到socket
+class BufferFile : public Buffer {
+public:
+    using Ptr = std::shared_ptr<BufferFile>;
+
+    // 复制fd, 调用方可以随即关闭自己的fd; len为0时到文件末尾, 失败时返回nullptr
+    static Ptr create(int fd, off_t offset = 0, size_t len = 0);
+    BufferFile(int fd, off_t offset, size_t len);  // 接管fd
+    ~BufferFile() override;
+
+public:
+    char* data() const override { return nullptr; }  // 数据在文件中, 不在内存
+    size_t size() const override { return len_; }
+    std::string toString() const override;  // 读取整段数据
+    size_t getCapacity() const override { return len_; }
+    int fd() const { return fd_; }
+    off_t offset() const { return offset_; }
+
+private:
+    int fd_;
+    off_t offset_;
+    size_t len_;
+};
+
 // 用于接收套接字数据的缓冲区接口
 class SocketRecvBuffer {
 public:
     using Ptr = std::shared_ptr<SocketRecvBuffer>;
 
-    static Ptr create(bool is_udp);
+    static Ptr create(bool is_udp, bool use_ring = false, bool udp_gro = false);  // use_ring只对TCP有效, udp_gro只对UDP有效
     SocketRecvBuffer() = default;
     virtual ~SocketRecvBuffer() = default;
 
@@ -73,7 +100,7 @@ public:
     using Ptr = std::shared_ptr<BufferList>;
     using SendResult = std::function<void(const Buffer::Ptr& buffer, bool send_success)>;
 
-    static Ptr create(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb, bool is_udp);
+    static Ptr create(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb, bool is_udp, bool udp_gso = false);
     BufferList() = default;
     virtual ~BufferList() =  default;
 
@@ -81,6 +108,14 @@ public:
     virtual bool empty() = 0;
     virtual size_t count() = 0;
     virtual ssize_t send(int fd, int flags) = 0;
+    virtual size_t remainSize() { return 0; }  // 剩余待发送的字节数, TCP按此判断是否使用零拷贝发送
+    virtual const struct msghdr* asyncMsg() { return nullptr; }  // 交给io_uring异步发送的消息, 不支持时返回nullptr
+    virtual void asyncSent(size_t) {}  // 异步发送完成了n字节
+    virtual bool gsoFailed() const { return false; }  // UDP_SEGMENT合并发送被内核拒绝, 已退回逐包发送
+    size_t sendCalls() const { return send_calls_; }  // 成功的发送系统调用次数, 零拷贝发送的完成通知按调用计数
+
+protected:
+    size_t send_calls_ = 0;
 
 private:
     ObjectCounter<BufferList> counter_;
@@ -114,6 +149,9 @@ public:
     bool empty() override;
     size_t count() override;
     ssize_t send(int fd, int flags) override;
+    size_t remainSize() override;
+    const struct msghdr* asyncMsg() override;  // iovec超过IOV_MAX时只包含前IOV_MAX个
+    void asyncSent(size_t n) override;
 
 private:
     ssize_t send_l(int fd, int flags);
@@ -123,6 +161,7 @@ private:
     size_t iovec_off_ = 0;  // 当前处理到的iovec索引
     size_t remain_size_ = 0;
     SocketBufVec iovec_;  // 和pkt_list_的内容一一对应
+    struct msghdr msg_;  // 异步发送时内核在完成前会访问该结构
 };
 
 class BufferSendTo final : public BufferList,
@@ -144,40 +183,89 @@ private:
 class BufferSendMMsg : public BufferList,
                        public BufferCallBack {
 public:
-    BufferSendMMsg(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb);
+    // gso为true时, 发往同一目标的连续数据包除最后一个外长度相同时合并为一个UDP_SEGMENT消息
+    BufferSendMMsg(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb, bool gso = false);
     ~BufferSendMMsg() override = default;
 
 public:
     bool empty() override;
     size_t count() override;
     ssize_t send(int fd, int flags) override;
+    bool gsoFailed() const override { return gso_failed_; }
 
 private:
     ssize_t send_l(int fd, int flags);
     void reOffset(size_t n);
+    void splitGso();  // 把未发送的合并消息拆回每包一个消息
 
 private:
+    bool gso_failed_ = false;
     size_t remain_size_ = 0;
-    std::vector<struct iovec> iovec_;
-    std::vector<struct mmsghdr> hdrvec_;
+    std::vector<struct iovec> iovec_;  // 和pkt_list_的内容一一对应
+    std::vector<struct mmsghdr> hdrvec_;  // 每个消息包含一个或多个(GSO)连续的iovec
+    std::vector<char> control_;  // 每个消息的UDP_SEGMENT控制信息
+};
+
+// 发送一个BufferFile, 每次调用sendfile直到写满socket缓冲区; 不增加sendCalls, 不参与零拷贝计数
+class BufferSendFile final : public BufferList,
+                             public BufferCallBack {
+public:
+    BufferSendFile(List<std::pair<Buffer::Ptr, bool>> list, SendResult cb);
+    ~BufferSendFile() override = default;
+
+public:
+    bool empty() override;
+    size_t count() override;
+    ssize_t send(int fd, int flags) override;
+    size_t remainSize() override;
+
+private:
+    BufferFile::Ptr file_;
+    size_t sent_ = 0;
+};
+
+// UDP批量接收的参数
+struct RecvmmsgOptions {
+    size_t count = 32;        // 每次recvmmsg最多接收的数据包个数
+    size_t size = 4 * 1024;   // 每个数据包的缓冲区大小
+    bool recycle = false;     // 读回调拿到的是缓冲区的副本, 应用没有保留的原地复用, 保留的等应用释放后回收
+    bool adaptive = false;    // 根据每次实际收到的个数调整批大小, count为上限
+    bool gro = false;         // 读取UDP_GRO控制信息, 合并的数据包拆分为BufferSlice, 缓冲区至少64KB
 };
 
 class SocketRecvmmsgBuffer : public SocketRecvBuffer {
 public:
-    SocketRecvmmsgBuffer(size_t count, size_t size);
+    SocketRecvmmsgBuffer(size_t count, size_t size, bool gro = false);
+    explicit SocketRecvmmsgBuffer(const RecvmmsgOptions& options);
 
 public:
-    ssize_t recvFromSocket(int fd, ssize_t &count) override;
+    ssize_t recvFromSocket(int fd, ssize_t &count) override;  // gro时count为拆分后的个数
     Buffer::Ptr& getBuffer(size_t index) override;
     struct sockaddr_storage& getAddress(size_t index) override;
 
+    size_t batchSize() const { return batch_; }  // 当前每次recvmmsg接收的个数
+    size_t allocCount() const { return alloc_count_; }  // 累计分配缓冲区的次数
+
 private:
-    size_t size_;
+    Buffer::Ptr allocBuffer();  // 优先回收应用已释放的缓冲区
+    void setSlot(size_t index, Buffer::Ptr buf);
+    void adjustBatch(size_t count);
+    ssize_t splitGro(ssize_t count);
+
+private:
+    RecvmmsgOptions options_;
+    size_t batch_;
+    size_t avg_x16_ = 0;  // 每次收到个数的滑动平均, 放大16倍
+    size_t alloc_count_ = 0;
     ssize_t last_count_{0};
     std::vector<struct iovec> iovec_;
     std::vector<struct mmsghdr> mmsgs_;
     std::vector<Buffer::Ptr> buffers_;
     std::vector<struct sockaddr_storage> address_;
+    std::vector<char> control_;
+    std::vector<Buffer::Ptr> out_buffers_;  // recycle或gro时交给读回调的缓冲区
+    std::vector<struct sockaddr_storage> out_address_;  // gro拆分后每个数据包的地址
+    std::vector<Buffer::Ptr> lent_;  // 被应用保留的缓冲区
 };
 
 class SocketRecvFromBuffer : public SocketRecvBuffer {
@@ -197,5 +285,32 @@ private:
     Buffer::Ptr buffer_;
     struct sockaddr_storage address_;
 };
+
+// TCP接收环, 由若干个大内存块组成, 每次readv填充当前块的剩余空间和下一块
+// 会话收到的是BufferSlice切片, 保留切片只会占住所在的内存块; 没有切片引用的内存块循环使用, 被占住的则换成新块
+class SocketRecvRingBuffer : public SocketRecvBuffer {
+public:
+    SocketRecvRingBuffer(size_t block_size, size_t block_count);
+
+public:
+    ssize_t recvFromSocket(int fd, ssize_t& count) override;
+    Buffer::Ptr& getBuffer(size_t index) override;
+    struct sockaddr_storage& getAddress(size_t index) override;
+
+    size_t blockAllocCount() const { return block_alloc_count_; }  // 累计分配内存块的次数
+
+private:
+    void ensureFree(size_t index);  // 保证index处的内存块没有被切片引用
+    Buffer::Ptr slice(size_t index, size_t offset, size_t size);
+
+private:
+    size_t block_size_;
+    size_t current_ = 0;  // 当前内存块
+    size_t offset_ = 0;  // 当前内存块已使用的长度
+    size_t block_alloc_count_ = 0;
+    std::vector<BufferRaw::Ptr> blocks_;
+    Buffer::Ptr slices_[2];  // 一次读取最多跨两个内存块
+    struct sockaddr_storage address_[2];
+};
 }  // namespace xkernel
 #endif
\ No newline at end of file
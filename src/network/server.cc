@@ -48,6 +48,7 @@ SessionHelper::SessionHelper(const std::weak_ptr<Server>& server,
     session_ = std::move(session);
     cls_ = std::move(cls);
     identifier_ = session_->getIdentifier();
+    session_map_ = SessionMap::Instance().shared_from_this();
     session_map_->add(identifier_, session_);
 }
 
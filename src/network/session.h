@@ -3,7 +3,7 @@
 
 #include <memory>
 
-#include "Socket.h"
+#include "socket.h"
 #include "SSLbox.h"
 #include "utility.h"
 
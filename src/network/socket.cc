@@ -1,6 +1,11 @@
 #include "socket.h"
 
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include "threadpool.h"
 #include "uv_errno.h"
@@ -128,8 +133,8 @@ Socket::Socket(EventPoller::Ptr poller, bool enable_mutex)
     : poller_(std::move(poller)),
       mtx_sock_fd_(enable_mutex),
       mtx_event_(enable_mutex),
-      mtx_send_buf_waiting_(enable_mutex),
-      mtx_send_buf_sending_(enable_mutex) {
+      mtx_send_buf_sending_(enable_mutex),
+      mtx_zerocopy_(enable_mutex) {
     setOnRead(nullptr);
     setOnErr(nullptr);
     setOnAccept(nullptr);
@@ -138,7 +143,9 @@ Socket::Socket(EventPoller::Ptr poller, bool enable_mutex)
     setOnSendResult(nullptr);
 }
 
-Socket::~Socket() { closeSock(); }
+Socket::~Socket() {
+    closeSock();
+}
 
 void Socket::setOnRead(onReadCb cb) {
     onMultiReadCb cb2;
@@ -210,6 +217,7 @@ void Socket::setOnBeforeAccept(onCreateSocket cb) {
 void Socket::setOnSendResult(onSendResult cb) {
     std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
     send_result_ = std::move(cb);
+    ++send_result_version_;
 }
 
 void Socket::connect(const std::string& url, uint16_t port, const onErrCb& con_cb_in, 
@@ -318,11 +326,26 @@ void Socket::onConnected(const SockNum::Ptr& sock, const onErrCb& cb) {
 
 bool Socket::attachEvent(const SockNum::Ptr& sock) {
     std::weak_ptr<Socket> weak_self = shared_from_this();
+    async_io_ = sock->type() != SockNum::SockType::UDP && poller_->supportAsyncIo();
+    if (sock->type() == SockNum::SockType::TCP && !connection_counted_.exchange(true)) {
+        poller_->addConnection();  // 用于按连接数选择poller
+    }
+    if (sock->type() != SockNum::SockType::TCP_Server) {
+        if (auto usec = poller_->getSockBusyPoll()) {
+            SockUtil::setBusyPoll(sock->rawFd(), usec);  // udp socket和tcp连接在驱动层忙轮询
+        }
+    }
     // tcp server
     if (sock->type() == SockNum::SockType::TCP_Server) {
+        if (async_io_) {
+            return attachAsyncIo(sock);
+        }
+        auto event = EventPoller::Poll_Event::Read_Event | EventPoller::Poll_Event::Error_Event;
+        if (accept_exclusive_) {
+            event = event | EventPoller::Poll_Event::Exclusive_Event;
+        }
         auto result = poller_->addEvent(
-            sock->rawFd(), 
-            EventPoller::Poll_Event::Read_Event | EventPoller::Poll_Event::Error_Event,
+            sock->rawFd(), event,
             [weak_self, sock](EventPoller::Poll_Event event) {
                 if (auto strong_self = weak_self.lock()) {
                     strong_self->onAccept(sock, event);
@@ -335,14 +358,15 @@ bool Socket::attachEvent(const SockNum::Ptr& sock) {
     auto read_buffer = poller_->getSharedBuffer(sock->type() == SockNum::SockType::UDP);
     auto result = poller_->addEvent(
         sock->rawFd(),
-        EventPoller::Poll_Event::Read_Event | EventPoller::Poll_Event::Write_Event | EventPoller::Poll_Event::Error_Event,
+        readFlag() | EventPoller::Poll_Event::Write_Event | EventPoller::Poll_Event::Error_Event,
         [weak_self, sock, read_buffer](EventPoller::Poll_Event event) {
             auto strong_self = weak_self.lock();
             if (!strong_self) {
                 return ;
             }
-            if (!(event & EventPoller::Poll_Event::Read_Event)) {
-                strong_self->onRead(sock, read_buffer);
+            if (!(event & EventPoller::Poll_Event::Read_Event) && !strong_self->async_io_) {
+                auto& udp_buffer = strong_self->udp_recv_buffer_;
+                strong_self->onRead(sock, udp_buffer && sock->type() == SockNum::SockType::UDP ? udp_buffer : read_buffer);
             }
             if (!(event & EventPoller::Poll_Event::Write_Event)) {
                 strong_self->onWriteAble(sock);
@@ -350,12 +374,96 @@ bool Socket::attachEvent(const SockNum::Ptr& sock) {
             if (!(event & EventPoller::Poll_Event::Error_Event)) {
                 if (sock->type() == SockNum::SockType::UDP) {
                     // udp ignore error
+                } else if (strong_self->onZeroCopyEvent(sock)) {
+                    // 零拷贝发送的完成通知同样触发EPOLLERR
                 } else {
                     strong_self->emitErr(getSockErr(sock->rawFd()));
                 }
             }
         });
-    return -1 != result;
+    if (-1 == result) {
+        return false;
+    }
+    return async_io_ ? attachAsyncIo(sock) : true;
+}
+
+bool Socket::attachAsyncIo(const SockNum::Ptr& sock) {
+    std::weak_ptr<Socket> weak_self = shared_from_this();
+    poller_->async([weak_self, sock]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return;
+        }
+        if (sock->type() == SockNum::SockType::TCP) {
+            strong_self->async_recv_id_ = 0;  // 旧fd上的请求已随delEvent取消
+            strong_self->startAsyncRecv(sock);
+            return;
+        }
+        auto id = strong_self->poller_->addAccept(sock->rawFd(), [weak_self, sock](int fd) {
+            auto strong_self = weak_self.lock();
+            if (!strong_self) {
+                return;
+            }
+            if (fd >= 0) {
+                strong_self->onAcceptFd(fd);
+                return;
+            }
+            // multishot accept出错后已结束, 可能打开的文件描述符太多了, 稍后重新提交
+            ErrorL << "Accept socket failed: " << uv_strerror(uv_translate_posix_error(-fd));
+            strong_self->poller_->doDelayTask(100, [weak_self, sock]() {
+                auto strong_self = weak_self.lock();
+                if (strong_self && strong_self->rawFd() == sock->rawFd()) {
+                    strong_self->attachAsyncIo(sock);
+                }
+                return 0;
+            });
+        });
+        if (!id) {
+            strong_self->emitErr(SockException(ErrorCode::Other, "add accept to io_uring failed"));
+        }
+    });
+    return true;
+}
+
+void Socket::startAsyncRecv(const SockNum::Ptr& sock) {
+    if (!enable_recv_ || async_recv_id_) {
+        return;
+    }
+    std::weak_ptr<Socket> weak_self = shared_from_this();
+    async_recv_id_ = poller_->addRecv(sock->rawFd(), [weak_self, sock](const char* data, ssize_t len) {
+        if (auto strong_self = weak_self.lock()) {
+            strong_self->onAsyncRecv(sock, data, len);
+        }
+    });
+    if (!async_recv_id_) {
+        emitErr(SockException(ErrorCode::Other, "add recv to io_uring failed"));
+    }
+}
+
+void Socket::onAsyncRecv(const SockNum::Ptr& sock, const char* data, ssize_t len) noexcept {
+    if (len <= 0) {
+        async_recv_id_ = 0;  // multishot recv已结束
+        emitErr(len == 0 ? SockException(ErrorCode::Eof, "end of file")
+                         : toSockException(uv_translate_posix_error(static_cast<int>(-len))));
+        return;
+    }
+    if (enable_speed_) {
+        recv_speed_ += len;
+    }
+    // 数据在poller的缓冲区环中, 回调返回后就被内核复用
+    auto raw = BufferRaw::create();
+    raw->assign(data, len);
+    Buffer::Ptr buf = std::move(raw);
+    try {
+        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+        on_multi_read_(&buf, &peer_addr_, 1);
+    } catch (std::exception& ex) {
+        ErrorL << "Exception occured when emit on_read: " << ex.what();
+    }
+}
+
+EventPoller::Poll_Event Socket::readFlag() const {
+    return enable_recv_ && !async_io_ ? EventPoller::Poll_Event::Read_Event : EventPoller::Poll_Event::None_Event;
 }
 
 ssize_t Socket::onRead(const SockNum::Ptr& sock, const SocketRecvBuffer::Ptr& buffer) noexcept {
@@ -419,12 +527,15 @@ bool Socket::emitErr(const SockException& err) noexcept {
     return true;
 }
 
-bool Socket::listen(uint16_t port, const std::string& local_ip, int backlog) {
+bool Socket::listen(uint16_t port, const std::string& local_ip, int backlog, bool reuse_port) {
     closeSock();
-    int fd = SockUtil::listen(port, local_ip.data(), backlog);
+    int fd = SockUtil::listen(port, local_ip.data(), backlog, reuse_port);
     if (fd == -1) {
         return false;
     }
+    if (accept_options_.inherit) {
+        applyAcceptOptions(fd, accept_options_);
+    }
     return fromSock_l(std::make_shared<SockNum>(fd, SockNum::SockType::TCP_Server));
 }
 
@@ -464,9 +575,25 @@ bool Socket::cloneSocket(const Socket& other) {
         }
         sock = other.sock_fd_->sockNum();
     }
+    accept_options_ = other.accept_options_;
     return fromSock_l(sock);
 }
 
+void Socket::setAcceptExclusive(bool exclusive) { accept_exclusive_ = exclusive; }
+
+void Socket::setAcceptOptions(const AcceptOptions& options) { accept_options_ = options; }
+
+void Socket::applyAcceptOptions(int fd, const AcceptOptions& options) {
+    if (options.no_delay) {
+        SockUtil::setNoDelay(fd);
+    }
+    SockUtil::setSendBuf(fd, options.send_buf);
+    SockUtil::setRecvBuf(fd, options.recv_buf);
+    if (options.close_wait >= 0) {
+        SockUtil::setCloseWait(fd, options.close_wait);
+    }
+}
+
 ssize_t Socket::send(const char* buf, size_t size, struct sockaddr* addr, 
                     socklen_t addr_len, bool try_flush) {
     if (size <= 0) {
@@ -481,7 +608,7 @@ ssize_t Socket::send(const char* buf, size_t size, struct sockaddr* addr,
 }
 
 ssize_t Socket::send(std::string buf, struct sockaddr* addr, socklen_t addr_len, bool try_flush) {
-    return send(std::make_shared<BufferString>(std::move(buf)), addr, addr_len, try_flush);
+    return send(BufferArena::makeShared<BufferString>(std::move(buf)), addr, addr_len, try_flush);
 }
 
 ssize_t Socket::send(Buffer::Ptr buf, struct sockaddr* addr, socklen_t addr_len, bool try_flush) {
@@ -500,10 +627,32 @@ ssize_t Socket::send_l(Buffer::Ptr buf, bool is_buf_sock, bool try_flush) {
     if (!size) {
         return 0;
     }
-    {
-        std::lock_guard<decltype(mtx_send_buf_waiting_)> lock(mtx_send_buf_waiting_);
-        send_buf_waiting_.emplace_back(std::move(buf), is_buf_sock);
+    ++send_waiting_count_;
+    send_buf_waiting_.push(std::make_pair(std::move(buf), is_buf_sock));
+    if (try_flush) {
+        if (flushAll()) {
+            return -1;
+        }
+    }
+    return size;
+}
+
+ssize_t Socket::sendFile(int fd, off_t offset, size_t len, bool try_flush) {
+    if (sockType() != SockNum::SockType::TCP) {
+        return -1;
+    }
+    auto file = BufferFile::create(fd, offset, len);
+    if (!file) {
+        return -1;
+    }
+    auto size = file->size();
+    if (!size) {
+        return 0;
     }
+    // 计数先于写入, 取出文件时一定能看到计数
+    ++send_file_count_;
+    ++send_waiting_count_;
+    send_buf_waiting_.push(std::make_pair(std::move(file), false));
     if (try_flush) {
         if (flushAll()) {
             return -1;
@@ -512,13 +661,49 @@ ssize_t Socket::send_l(Buffer::Ptr buf, bool is_buf_sock, bool try_flush) {
     return size;
 }
 
+void Socket::onceFlushed(std::function<void()> cb) {
+    auto task = std::make_shared<std::function<void()>>(std::move(cb));
+    {
+        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+        once_flushed_.emplace_back(task);
+    }
+    // 先注册再检查, 避免检查之后发送缓存刚好清空而错过回调
+    bool idle = !isSocketBusy() && !send_waiting_count_;
+    if (idle) {
+        std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
+        idle = send_buf_sending_.empty();
+    }
+    if (!idle) {
+        return;
+    }
+    {
+        // 没有找到说明onFlushed已经取走
+        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+        auto it = std::find(once_flushed_.begin(), once_flushed_.end(), task);
+        if (it == once_flushed_.end()) {
+            return;
+        }
+        once_flushed_.erase(it);
+    }
+    poller_->async([task]() { (*task)(); }, false);
+}
+
 int Socket::flushAll() {
+    if (flush_later_) {
+        flush_later_ = false;
+    }
     std::lock_guard<decltype(mtx_sock_fd_)> lock(mtx_sock_fd_);
     if (!sock_fd_) {
         return -1;
     }
-    if (sendable_) {
-        return flushData(sock_fd_->sockNum(), false) ? 0 : -1;  // socket可写
+    // 先检查发送权: 持有者在释放发送权之前才停止等待可写, 此时由tryFlush留下标记让持有者重试
+    if (flushing_ || sendable_) {
+        if (async_io_ && !poller_->isCurrentThread()) {
+            // io_uring的请求只能在poller线程提交
+            postFlush();
+            return 0;
+        }
+        return tryFlush(sock_fd_->sockNum(), false) ? 0 : -1;  // socket可写
     }
     // socket不可写，判断是否超时
     if (send_flush_ticker_.elapsedTime() > max_send_buffer_ms_) {
@@ -528,8 +713,70 @@ int Socket::flushAll() {
     return 0;
 }
 
+bool Socket::tryFlush(const SockNum::Ptr& sock, bool poller_thread) {
+    bool ret = true;
+    // 先标记再抢发送权: 没抢到时, 持有者释放发送权后一定能看到标记
+    (poller_thread ? poller_flush_missed_ : flush_missed_) = true;
+    while (!flushing_.exchange(true)) {
+        flush_missed_ = false;
+        if (poller_thread) {
+            poller_flush_missed_ = false;
+        }
+        {
+            // 回调中抛出异常时也要释放发送权
+            onceToken token(nullptr, [&]() { flushing_ = false; });
+            ret = flushData(sock, poller_thread);
+        }
+        if (poller_flush_missed_.exchange(false)) {
+            // 可写事件或异步发送完成时没有抢到发送权, 不能丢弃, 交回poller线程重新处理
+            std::weak_ptr<Socket> weak_self = shared_from_this();
+            poller_->async([weak_self, sock]() {
+                if (auto strong_self = weak_self.lock()) {
+                    strong_self->tryFlush(sock, true);
+                }
+            }, false);
+        }
+        // 发送期间有其他线程写入后没有抢到发送权, 由本线程继续发送; 不可写时由可写事件继续
+        if (!ret || !sendable_ || !flush_missed_.exchange(false)) {
+            return ret;
+        }
+        // 继续发送的是其他线程写入的数据, 此时可能已经停止监听可写事件, 按非poller线程的方式发送
+        poller_thread = false;
+    }
+    return ret;
+}
+
+void Socket::flushLater() {
+    if (!poller_->isCurrentThread()) {
+        postFlush();  // 投递的任务同样在poller的一轮循环中合并执行
+        return;
+    }
+    if (!flush_later_.exchange(true)) {
+        poller_->addDirtySocket(shared_from_this());
+    }
+}
+
+void Socket::postFlush() {
+    if (flush_posted_.exchange(true)) {
+        return;
+    }
+    std::weak_ptr<Socket> weak_self = shared_from_this();
+    poller_->async([weak_self]() {
+        if (auto strong_self = weak_self.lock()) {
+            strong_self->flush_posted_ = false;
+            strong_self->flushAll();
+        }
+    }, false);
+}
+
 void Socket::onFlushed() {
     bool flag;
+    decltype(once_flushed_) once_flushed;
+    {
+        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+        once_flushed.swap(once_flushed_);
+    }
+    once_flushed.forEach([](std::shared_ptr<std::function<void()>>& task) { (*task)(); });
     {
         std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
         flag = on_flush_();
@@ -559,21 +806,45 @@ void Socket::closeSock(bool close_fd) {
     async_con_cb_ = nullptr;
     send_flush_ticker_.resetTime();
 
+    ++send_result_version_;
+
     {
-        std::lock_guard<decltype(mtx_send_buf_waiting_)> lock(mtx_send_buf_waiting_);
-        send_buf_waiting_.clear();
+        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+        once_flushed_.clear();
     }
 
     {
         std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
+        std::pair<Buffer::Ptr, bool> item;
+        while (send_buf_waiting_.tryPop(item)) {
+            --send_waiting_count_;
+        }
+        send_file_count_ = 0;
         send_buf_sending_.clear();
+        // 进行中的异步发送随delEvent取消, 其回调持有缓冲区直到内核不再访问
+        async_sending_.clear();
+        async_pending_ = 0;
+        async_err_ = 0;
     }
 
+    releaseZeroCopy(close_fd);
+
     {
         std::lock_guard<decltype(mtx_sock_fd_)> lock(mtx_sock_fd_);
         if (close_fd) {
             err_emit_ = false;
             sock_fd_ = nullptr;
+            if (connection_counted_.exchange(false)) {
+                poller_->addConnection(-1);
+            }
+            // 零拷贝发送的序号随fd重新计数
+            std::lock_guard<decltype(mtx_zerocopy_)> zc_lock(mtx_zerocopy_);
+            zerocopy_ = false;
+            zerocopy_threshold_ = 0;
+            zerocopy_seq_ = 0;
+            zerocopy_done_ = 0;
+            zerocopy_ranges_.clear();
+            udp_gso_ = false;
         } else if (sock_fd_) {
             sock_fd_->delEvent();
         }
@@ -581,32 +852,275 @@ void Socket::closeSock(bool close_fd) {
 }
 
 size_t Socket::getSendBufferCount() {
-    size_t ret = 0;
-    {
-        std::lock_guard<decltype(mtx_send_buf_waiting_)> lock(mtx_send_buf_waiting_);
-        ret += send_buf_waiting_.size();
-    }
+    size_t ret = send_waiting_count_;
 
     {
         std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
         send_buf_sending_.forEach([&](BufferList::Ptr& buf) {
             ret += buf->count();
         });
+        for (auto& buf : async_sending_) {
+            ret += buf->count();
+        }
+    }
+
+    {
+        std::lock_guard<decltype(mtx_zerocopy_)> lock(mtx_zerocopy_);
+        ret += zerocopy_pending_.size();
     }
     return ret;
 }
 
+bool Socket::enableZeroCopy(size_t threshold) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    std::lock_guard<decltype(mtx_sock_fd_)> lock(mtx_sock_fd_);
+    if (!sock_fd_ || sock_fd_->type() != SockNum::SockType::TCP) {
+        return false;
+    }
+    // 关闭时不清除SO_ZEROCOPY, 已发出的零拷贝调用仍需要读取完成通知
+    int on = 1;
+    if (threshold && -1 == setsockopt(sock_fd_->rawFd(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on))) {
+        WarnL << "setsockopt SO_ZEROCOPY failed: " << get_uv_errmsg(true);
+        return false;
+    }
+    std::lock_guard<decltype(mtx_zerocopy_)> zc_lock(mtx_zerocopy_);
+    zerocopy_threshold_ = threshold;
+    if (threshold) {
+        zerocopy_ = true;
+        ++send_result_version_;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Socket::enableUdpGso(bool enable) {
+#ifdef UDP_SEGMENT
+    std::lock_guard<decltype(mtx_sock_fd_)> lock(mtx_sock_fd_);
+    if (!sock_fd_ || sock_fd_->type() != SockNum::SockType::UDP) {
+        return false;
+    }
+    // 段长在每次发送的控制信息中指定, 这里只检查内核是否支持
+    int seg = 0;
+    if (enable && -1 == setsockopt(sock_fd_->rawFd(), SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg))) {
+        WarnL << "setsockopt UDP_SEGMENT failed: " << get_uv_errmsg(true);
+        return false;
+    }
+    udp_gso_ = enable;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Socket::enableUdpGro(bool enable) {
+#ifdef UDP_GRO
+    int fd;
+    {
+        std::lock_guard<decltype(mtx_sock_fd_)> lock(mtx_sock_fd_);
+        if (!sock_fd_ || sock_fd_->type() != SockNum::SockType::UDP) {
+            return false;
+        }
+        fd = sock_fd_->rawFd();
+    }
+    int on = 0;
+    socklen_t len = sizeof(on);
+    if (-1 == getsockopt(fd, SOL_UDP, UDP_GRO, &on, &len)) {
+        WarnL << "getsockopt UDP_GRO failed: " << get_uv_errmsg(true);
+        return false;
+    }
+    // 先换成足够大的读缓存再开启GRO; 关闭后队列中可能还有已合并的数据包, 保留该读缓存
+    std::weak_ptr<Socket> weak_self = shared_from_this();
+    poller_->async([weak_self, enable]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return;
+        }
+        std::lock_guard<decltype(strong_self->mtx_sock_fd_)> lock(strong_self->mtx_sock_fd_);
+        if (!strong_self->sock_fd_) {
+            return;
+        }
+        if (enable && !strong_self->udp_gro_) {
+            strong_self->udp_gro_ = true;
+            strong_self->resetUdpRecvBuffer();
+        }
+        int on = enable;
+        if (-1 == setsockopt(strong_self->sock_fd_->rawFd(), SOL_UDP, UDP_GRO, &on, sizeof(on))) {
+            WarnL << "setsockopt UDP_GRO failed: " << get_uv_errmsg(true);
+        }
+    });
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Socket::setRecvmmsgOptions(const RecvmmsgOptions& options) {
+    std::weak_ptr<Socket> weak_self = shared_from_this();
+    poller_->async([weak_self, options]() {
+        if (auto strong_self = weak_self.lock()) {
+            strong_self->udp_recv_options_ = std::make_shared<RecvmmsgOptions>(options);
+            strong_self->resetUdpRecvBuffer();
+        }
+    });
+}
+
+void Socket::resetUdpRecvBuffer() {
+    if (udp_recv_options_) {
+        auto options = *udp_recv_options_;
+        options.gro = udp_gro_;
+        udp_recv_buffer_ = std::make_shared<SocketRecvmmsgBuffer>(options);
+    } else if (udp_gro_) {
+        udp_recv_buffer_ = poller_->getSharedBuffer(true, true);
+    }
+}
+
+uint64_t Socket::getZeroCopyCopied() const { return zerocopy_copied_.load(std::memory_order_relaxed); }
+
+ssize_t Socket::sendZeroCopy(const SockNum::Ptr& sock, const BufferList::Ptr& packet) {
+    ssize_t n;
+    int err;
+    {
+        // 加锁保证序号与内核对发送调用的计数一致
+        std::lock_guard<decltype(mtx_zerocopy_)> lock(mtx_zerocopy_);
+        bool zerocopy = zerocopy_threshold_ && packet->remainSize() >= zerocopy_threshold_;
+        auto calls = packet->sendCalls();
+#ifdef MSG_ZEROCOPY
+        n = packet->send(sock->rawFd(), zerocopy ? sock_flags_ | MSG_ZEROCOPY : sock_flags_);
+#else
+        n = packet->send(sock->rawFd(), sock_flags_);
+#endif
+        err = errno;
+        if (zerocopy) {
+            zerocopy_seq_ += packet->sendCalls() - calls;
+        }
+        // 本次发送完成的缓冲区, 需要等之前所有零拷贝发送都完成后才能释放
+        zerocopy_pending_.forEach([&](ZeroCopyBuffer& item) {
+            if (!item.tagged) {
+                item.tagged = true;
+                item.seq = zerocopy_seq_;
+            }
+        });
+    }
+    releaseZeroCopy();
+    errno = err;  // 调用方根据errno判断发送失败的原因
+    return n;
+}
+
+bool Socket::onZeroCopyEvent(const SockNum::Ptr& sock) {
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    {
+        std::lock_guard<decltype(mtx_zerocopy_)> lock(mtx_zerocopy_);
+        if (!zerocopy_ || (!zerocopy_threshold_ && zerocopy_seq_ == zerocopy_done_)) {
+            return false;
+        }
+    }
+    bool notified = false;
+    char control[128];
+    for (;;) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (-1 == recvmsg(sock->rawFd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT)) {
+            break;
+        }
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            auto ee = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cmsg));
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            notified = true;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zerocopy_copied_.fetch_add(ee->ee_data - ee->ee_info + 1, std::memory_order_relaxed);
+            }
+            onZeroCopyDone(ee->ee_info, ee->ee_data);
+        }
+    }
+    if (!notified) {
+        return false;
+    }
+    releaseZeroCopy();
+    // 错误队列中只有完成通知时不是真正的错误
+    auto err = getSockErr(sock->rawFd(), false);
+    if (err) {
+        emitErr(err);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Socket::onZeroCopyDone(uint32_t lo, uint32_t hi) {
+    std::lock_guard<decltype(mtx_zerocopy_)> lock(mtx_zerocopy_);
+    if (lo != zerocopy_done_) {
+        zerocopy_ranges_.emplace_back(lo, hi);
+        return;
+    }
+    zerocopy_done_ = hi + 1;
+    // 合并之前乱序到达的通知
+    bool merged = true;
+    while (merged && !zerocopy_ranges_.empty()) {
+        merged = false;
+        for (auto it = zerocopy_ranges_.begin(); it != zerocopy_ranges_.end(); ++it) {
+            if (it->first == zerocopy_done_) {
+                zerocopy_done_ = it->second + 1;
+                zerocopy_ranges_.erase(it);
+                merged = true;
+                break;
+            }
+        }
+    }
+}
+
+void Socket::releaseZeroCopy(bool close) {
+    decltype(zerocopy_pending_) released;
+    {
+        std::lock_guard<decltype(mtx_zerocopy_)> lock(mtx_zerocopy_);
+        if (close) {
+            released.swap(zerocopy_pending_);
+        } else {
+            while (!zerocopy_pending_.empty()) {
+                auto& front = zerocopy_pending_.front();
+                if (!front.tagged || static_cast<int32_t>(zerocopy_done_ - front.seq) < 0) {
+                    break;
+                }
+                released.emplace_back(std::move(front));
+                zerocopy_pending_.pop_front();
+            }
+        }
+    }
+    // 在锁外回调, 回调中可能继续发送数据
+    released.forEach([&](ZeroCopyBuffer& item) {
+        if (item.cb) {
+            item.cb(item.buffer, !close);
+        }
+    });
+}
+
 uint64_t Socket::elapsedTimeAfterFlushed() {
     return send_flush_ticker_.elapsedTime();
 }
 
 int Socket::getRecvSpeed() {
-    enable_speed_ = true;
+    if (!enable_speed_) {
+        enable_speed_ = true;
+        ++send_result_version_;
+    }
     return recv_speed_.getSpeed();
 }
 
 int Socket::getSendSpeed() {
-    enable_speed_ = true;
+    if (!enable_speed_) {
+        enable_speed_ = true;
+        ++send_result_version_;
+    }
     return send_speed_.getSpeed();
 }
 
@@ -660,7 +1174,9 @@ int Socket::onAccept(const SockNum::Ptr& sock, EventPoller::Poll_Event event) no
     while (true) {
         if (!(event & EventPoller::Poll_Event::Read_Event)) {
             do {
-                fd = accept(sock->rawFd(), reinterpret_cast<struct sockaddr*>(&peer_addr), &addr_len);
+                // 新fd直接是非阻塞和FD_CLOEXEC的, 省去两次fcntl
+                fd = accept4(sock->rawFd(), reinterpret_cast<struct sockaddr*>(&peer_addr), &addr_len,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
             } while ( -1 == fd && UV_EINTR == get_uv_error(true));
         }
         // accept失败
@@ -683,54 +1199,7 @@ int Socket::onAccept(const SockNum::Ptr& sock, EventPoller::Poll_Event event) no
             return -1;
         }
 
-        SockUtil::setNoSigpipe(fd);
-        SockUtil::setNoBlocked(fd);
-        SockUtil::setNoDelay(fd);
-        SockUtil::setSendBuf(fd);
-        SockUtil::setRecvBuf(fd);
-        SockUtil::setCloseWait(fd);
-        SockUtil::setCloExec(fd);
-
-        Socket::Ptr peer_sock;
-        try {
-            std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
-            peer_sock = on_before_accept_(poller_);
-        } catch (std::exception& ex) {
-            ErrorL << "Exception occurred when emit on_before_accept: " << ex.what();
-            close(fd);
-            continue;
-        }
-
-        if (!peer_sock) {
-            // 子Socket共用父Socket的poll线程并且关闭互斥锁
-            peer_sock = Socket::createSocket(poller_, false);
-        }
-
-        auto sock = std::make_shared<SockNum>(fd, SockNum::SockType::TCP);
-        peer_sock->setSock(sock);
-        memcpy(&peer_sock->peer_addr_, &peer_addr, addr_len);
-
-        std::shared_ptr<void> completed(nullptr, [peer_sock, sock](void*) {
-            try {
-                if (!peer_sock->attachEvent(sock)) {
-                    peer_sock->emitErr(SockException(
-                        ErrorCode::Eof,
-                        "add event to poller failed when accept a socket"
-                    ));
-                }
-            } catch (std::exception& ex) {
-                ErrorL << "Exception occurred: " << ex.what();
-            }
-        });
-
-        try {
-            // 捕获异常，防止socket未accept尽，epoll边沿触发失效的问题
-            std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
-            on_accept_(peer_sock, completed);
-        } catch (std::exception& ex) {
-            ErrorL << "Exception occured when emit on_accept: " << ex.what();
-            continue;
-        }
+        onAcceptFd(fd);
     }
 
     if (!(event & EventPoller::Poll_Event::Error_Event)) {
@@ -741,30 +1210,69 @@ int Socket::onAccept(const SockNum::Ptr& sock, EventPoller::Poll_Event event) no
     }
 }
 
-void Socket::onWriteAble(const SockNum::Ptr& sock) {
-    bool empty_waiting;
-    bool empty_sending;
-    {
-        std::lock_guard<decltype(mtx_send_buf_waiting_)> lock(mtx_send_buf_waiting_);
-        empty_waiting = send_buf_waiting_.empty();
+void Socket::onAcceptFd(int fd) noexcept {
+    // fd由accept4或io_uring创建, 已是非阻塞和FD_CLOEXEC的; 继承时其他选项已经从监听socket复制
+    SockUtil::setNoSigpipe(fd);
+    if (!accept_options_.inherit) {
+        applyAcceptOptions(fd, accept_options_);
     }
 
-    {
-        std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
-        empty_sending = send_buf_sending_.empty();
+    Socket::Ptr peer_sock;
+    try {
+        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+        peer_sock = on_before_accept_(poller_);
+    } catch (std::exception& ex) {
+        ErrorL << "Exception occurred when emit on_before_accept: " << ex.what();
+        close(fd);
+        return;
     }
 
-    if (empty_waiting && empty_sending) {
-        stopWriteAbleEvent(sock);  // 数据已经清空了，我们停止监听可写事件
-    } else {
-        flushData(sock, true);  // 尝试发送剩余的数据
+    if (!peer_sock) {
+        // 子Socket共用父Socket的poll线程并且关闭互斥锁
+        peer_sock = Socket::createSocket(poller_, false);
+    }
+
+    auto sock = std::make_shared<SockNum>(fd, SockNum::SockType::TCP);
+    peer_sock->setSock(sock);  // 同时取得对端地址
+
+    std::shared_ptr<void> completed(nullptr, [peer_sock, sock](void*) {
+        try {
+            if (!peer_sock->attachEvent(sock)) {
+                peer_sock->emitErr(SockException(
+                    ErrorCode::Eof,
+                    "add event to poller failed when accept a socket"
+                ));
+            }
+        } catch (std::exception& ex) {
+            ErrorL << "Exception occurred: " << ex.what();
+        }
+    });
+
+    try {
+        // 捕获异常，防止socket未accept尽，epoll边沿触发失效的问题
+        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+        on_accept_(peer_sock, completed);
+    } catch (std::exception& ex) {
+        ErrorL << "Exception occured when emit on_accept: " << ex.what();
     }
 }
 
+void Socket::onWriteAble(const SockNum::Ptr& sock) {
+    // 可写事件一直以边沿触发监听, 读事件也会带上可写标记; 先计数再检查, 与flushData中的检查配对
+    ++write_events_;
+    if (sendable_) {
+        return;  // 没有等待可写的数据
+    }
+    tryFlush(sock, true);  // 尝试发送剩余的数据
+}
+
 bool Socket::flushData(const SockNum::Ptr& sock, bool poller_thread) {
     decltype(send_buf_sending_) send_buf_sending_tmp;
     {
         std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
+        if (async_pending_) {
+            return true;  // 等本批异步发送全部完成后再继续
+        }
         if (!send_buf_sending_.empty()) {
             send_buf_sending_tmp.swap(send_buf_sending_);
         }
@@ -773,40 +1281,69 @@ bool Socket::flushData(const SockNum::Ptr& sock, bool poller_thread) {
     // 二级发送缓存为空，则消费一级发送缓存数据
     if (send_buf_sending_tmp.empty()) {
         send_flush_ticker_.resetTime();
-        do {
-            {
-                std::lock_guard<decltype(mtx_send_buf_waiting_)> lock(mtx_send_buf_waiting_);
-                if (!send_buf_waiting_.empty()) {
-                    std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
-                    auto send_result = enable_speed_ ? [this](const Buffer::Ptr& buffer, bool send_success) {
-                        if (send_success) {
-                            send_speed_ += buffer->size();
-                        }
-                        std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
-                        if (send_result_) {
-                            send_result_(buffer, send_success);
-                        }
-                    } : send_result_;
-                    send_buf_sending_tmp.emplace_back(BufferList::create(
-                        std::move(send_buf_waiting_), std::move(send_result),
-                        sock->type() == SockNum::SockType::UDP
-                    ));
-                    break;
-                }
+        List<std::pair<Buffer::Ptr, bool>> send_buf_waiting;
+        {
+            std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
+            std::pair<Buffer::Ptr, bool> item;
+            while (send_buf_waiting_.tryPop(item)) {
+                send_buf_waiting.emplace_back(std::move(item));
+            }
+        }
+        send_waiting_count_ -= send_buf_waiting.size();
+
+        if (send_buf_waiting.empty()) {
+            // 如果一级发送缓存也为空, 说明数据已全部写入socket
+            if (poller_thread) {
+                stopWriteAbleEvent();
+                onFlushed();
+            }
+            return true;
+        }
 
-                // 如果一级发送缓存也为空, 说明数据已全部写入socket
-                if (poller_thread) {
-                    stopWriteAbleEvent(sock);
-                    onFlushed();
+        auto send_result = getSendResult();
+        if (send_file_count_) {
+            // 文件单独用sendfile发送, 文件之间的内存数据仍合并发送, 保持调用顺序
+            size_t file_count = 0;
+            decltype(send_buf_waiting) batch;
+            send_buf_waiting.forEach([&](std::pair<Buffer::Ptr, bool>& pr) {
+                if (!std::dynamic_pointer_cast<BufferFile>(pr.first)) {
+                    batch.emplace_back(std::move(pr));
+                    return;
                 }
-                return true;
+                if (!batch.empty()) {
+                    send_buf_sending_tmp.emplace_back(BufferList::create(std::move(batch), send_result, false));
+                    batch.clear();
+                }
+                decltype(send_buf_waiting) file;
+                file.emplace_back(std::move(pr));
+                send_buf_sending_tmp.emplace_back(std::make_shared<BufferSendFile>(std::move(file), send_result));
+                ++file_count;
+            });
+            if (!batch.empty()) {
+                send_buf_sending_tmp.emplace_back(BufferList::create(std::move(batch), send_result, false));
             }
-        } while (false);
+            send_file_count_ -= file_count;
+        } else {
+            send_buf_sending_tmp.emplace_back(BufferList::create(
+                std::move(send_buf_waiting), std::move(send_result),
+                sock->type() == SockNum::SockType::UDP, udp_gso_
+            ));
+        }
     }
 
     while (!send_buf_sending_tmp.empty()) {
         auto& packet = send_buf_sending_tmp.front();
-        auto n = packet->send(sock->rawFd(), sock_flags_);
+        auto write_events = write_events_.load();
+        if (async_io_ && !zerocopy_ && packet->asyncMsg()) {
+            if (!sendAsync(sock, send_buf_sending_tmp)) {
+                return false;
+            }
+            break;
+        }
+        auto n = zerocopy_ ? sendZeroCopy(sock, packet) : packet->send(sock->rawFd(), sock_flags_);
+        if (packet->gsoFailed() && udp_gso_.exchange(false)) {
+            WarnL << "Send udp socket[" << sock << "] with UDP_SEGMENT failed, fallback to sendmmsg";
+        }
         if (n > 0) {
             // 全部发送成功
             if (packet->empty()) {
@@ -814,8 +1351,8 @@ bool Socket::flushData(const SockNum::Ptr& sock, bool poller_thread) {
                 continue;
             }
             // 部分发送成功
-            if (!poller_thread) {
-                startWriteAbleEvent(sock);
+            if (startWriteAbleEvent(sock, write_events)) {
+                continue;
             }
             break;
         }
@@ -823,8 +1360,8 @@ bool Socket::flushData(const SockNum::Ptr& sock, bool poller_thread) {
         int err = get_uv_error(true);
         if (err == UV_EAGAIN) {
             // 等待下一次发送
-            if (!poller_thread) {
-                startWriteAbleEvent(sock);
+            if (startWriteAbleEvent(sock, write_events)) {
+                continue;
             }
             break;
         }
@@ -853,32 +1390,173 @@ bool Socket::flushData(const SockNum::Ptr& sock, bool poller_thread) {
     return poller_thread ? flushData(sock, poller_thread) : true;
 }
 
-void Socket::startWriteAbleEvent(const SockNum::Ptr& sock) {
+BufferList::SendResult Socket::getSendResult() {
+    auto version = send_result_version_.load();
+    if (send_result_built_ != version) {
+        send_result_built_ = version;
+        BufferList::SendResult send_result;
+        {
+            std::lock_guard<decltype(mtx_event_)> lock(mtx_event_);
+            send_result = send_result_;
+        }
+        if (enable_speed_) {
+            send_result = [this, send_result](const Buffer::Ptr& buffer, bool send_success) {
+                if (send_success) {
+                    send_speed_ += buffer->size();
+                }
+                if (send_result) {
+                    send_result(buffer, send_success);
+                }
+            };
+        }
+        if (zerocopy_) {
+            // 缓冲区写入socket后暂存, 等内核确认零拷贝发送完成后再回调
+            send_result = [this, send_result](const Buffer::Ptr& buffer, bool send_success) {
+                if (!send_success) {
+                    if (send_result) {
+                        send_result(buffer, false);
+                    }
+                    return;
+                }
+                std::lock_guard<decltype(mtx_zerocopy_)> lock(mtx_zerocopy_);
+                zerocopy_pending_.emplace_back(ZeroCopyBuffer{false, 0, buffer, send_result});
+            };
+        }
+        send_result_cb_ = send_result ? std::make_shared<BufferList::SendResult>(std::move(send_result)) : nullptr;
+    }
+    if (!send_result_cb_) {
+        return nullptr;
+    }
+    // 只捕获一个shared_ptr, std::function内部存放, 每次flush不再分配
+    auto cb = send_result_cb_;
+    return [cb](const Buffer::Ptr& buffer, bool send_success) { (*cb)(buffer, send_success); };
+}
+
+bool Socket::sendAsync(const SockNum::Ptr& sock, List<BufferList::Ptr>& packets) {
+    static constexpr size_t kMaxLinkedSends = 16;
+    std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
+    while (!packets.empty() && async_sending_.size() < kMaxLinkedSends) {
+        auto msg = packets.front()->asyncMsg();
+        if (!msg) {
+            break;
+        }
+        bool whole = msg->msg_iovlen == packets.front()->count();
+        async_sending_.emplace_back(std::move(packets.front()));
+        packets.pop_front();
+        if (!whole) {
+            break;  // 超出IOV_MAX的部分要等本次完成后再提交, 后面的不能与它串联
+        }
+    }
     sendable_ = false;
-    EventPoller::Poll_Event flag = enable_recv_ ? EventPoller::Poll_Event::Read_Event 
-                                                : EventPoller::Poll_Event::None_Event;
-    poller_->modifyEvent(sock->rawFd(), 
-                         flag | EventPoller::Poll_Event::Error_Event | EventPoller::Poll_Event::Write_Event,
-                         [sock](bool) {});
+    async_err_ = 0;
+    std::weak_ptr<Socket> weak_self = shared_from_this();
+    for (size_t i = 0; i < async_sending_.size(); ++i) {
+        auto& packet = async_sending_[i];
+        // 回调持有缓冲区, 保证取消后内核完成之前内存仍然有效
+        auto id = poller_->addSend(sock->rawFd(), packet->asyncMsg(), i + 1 < async_sending_.size(),
+                                   [weak_self, sock, packet](ssize_t ret) {
+            if (auto strong_self = weak_self.lock()) {
+                strong_self->onAsyncSent(sock, packet, ret);
+            }
+        });
+        if (!id) {
+            async_err_ = ENOBUFS;
+            break;
+        }
+        ++async_pending_;
+    }
+    if (!async_pending_) {
+        async_sending_.clear();
+        emitErr(SockException(ErrorCode::Other, "add send to io_uring failed"));
+        return false;
+    }
+    return true;
 }
 
-void Socket::stopWriteAbleEvent(const SockNum::Ptr& sock) {
+void Socket::onAsyncSent(const SockNum::Ptr& sock, const BufferList::Ptr& packet, ssize_t ret) {
+    {
+        std::lock_guard<decltype(mtx_sock_fd_)> lock(mtx_sock_fd_);
+        if (!sock_fd_ || sock_fd_->sockNum() != sock) {
+            return;
+        }
+    }
+    if (ret > 0) {
+        packet->asyncSent(ret);
+    }
+    decltype(send_buf_sending_) unsent;
+    {
+        std::lock_guard<decltype(mtx_send_buf_sending_)> lock(mtx_send_buf_sending_);
+        if (ret < 0 && ret != -ECANCELED && !async_err_) {
+            async_err_ = static_cast<int>(-ret);
+        }
+        if (!async_pending_ || --async_pending_) {
+            return;
+        }
+        // 本批全部结束, 没有发完的(出错后被取消的、超出IOV_MAX的)按原顺序放回二级缓存的头部
+        for (auto& buf : async_sending_) {
+            if (!buf->empty()) {
+                unsent.emplace_back(std::move(buf));
+            }
+        }
+        async_sending_.clear();
+        unsent.append(send_buf_sending_);
+        send_buf_sending_.swap(unsent);
+    }
+    if (async_err_) {
+        emitErr(toSockException(uv_translate_posix_error(async_err_)));
+        return;
+    }
     sendable_ = true;
-    EventPoller::Poll_Event flag = enable_recv_ ? EventPoller::Poll_Event::Read_Event 
-                                                : EventPoller::Poll_Event::None_Event;
-    poller_->modifyEvent(sock->rawFd(), flag | EventPoller::Poll_Event::Error_Event, [sock](bool) {});
+    tryFlush(sock, true);
 }
 
+bool Socket::startWriteAbleEvent(const SockNum::Ptr& sock, uint32_t write_events) {
+    // 可写事件在attachEvent时已经注册, 这里只标记等待可写, 不再修改epoll事件
+    sendable_ = false;
+    if (write_events_ == write_events) {
+        // 部分内核(如unix socket)在EAGAIN之后不一定再产生可写边沿, 标记后再查询一次是否已经可写
+        struct pollfd pfd = {sock->rawFd(), POLLOUT, 0};
+        if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLOUT)) {
+            return false;
+        }
+    }
+    // 发送期间poller线程收到了可写事件, 可能在标记之前就被忽略了, 由本线程立即重试
+    sendable_ = true;
+    return true;
+}
+
+void Socket::stopWriteAbleEvent() { sendable_ = true; }
+
 void Socket::enableRecv(bool enabled) {
     if (enable_recv_ == enabled) {
         return ;
     }
     enable_recv_ = enabled;
+    if (async_io_) {
+        // 异步接收通过提交或取消multishot recv开关, 可写事件的监听不变
+        std::weak_ptr<Socket> weak_self = shared_from_this();
+        poller_->async([weak_self, enabled]() {
+            auto strong_self = weak_self.lock();
+            if (!strong_self) {
+                return;
+            }
+            std::lock_guard<decltype(strong_self->mtx_sock_fd_)> lock(strong_self->mtx_sock_fd_);
+            if (!strong_self->sock_fd_ || strong_self->sock_fd_->type() != SockNum::SockType::TCP) {
+                return;
+            }
+            if (enabled) {
+                strong_self->startAsyncRecv(strong_self->sock_fd_->sockNum());
+            } else if (strong_self->async_recv_id_) {
+                strong_self->poller_->cancelIo(strong_self->async_recv_id_);
+                strong_self->async_recv_id_ = 0;
+            }
+        });
+        return;
+    }
     EventPoller::Poll_Event read_flag = enabled ? EventPoller::Poll_Event::Read_Event 
                                                 : EventPoller::Poll_Event::None_Event;
-    EventPoller::Poll_Event send_flag = sendable_ ? EventPoller::Poll_Event::None_Event 
-                                                  : EventPoller::Poll_Event::Write_Event;  // 可写时，不监听可写事件
-    poller_->modifyEvent(rawFd(), read_flag | send_flag | EventPoller::Poll_Event::Error_Event);
+    // 可写事件一直监听, 是否需要处理由sendable_决定
+    poller_->modifyEvent(rawFd(), read_flag | EventPoller::Poll_Event::Write_Event | EventPoller::Poll_Event::Error_Event);
 }
 
 int Socket::rawFd() const {
@@ -956,7 +1634,7 @@ SockSender& SockSender::operator<<(const char* buf) {
 }
 
 ssize_t SockSender::send(std::string buf) {
-    return send(std::make_shared<BufferString>(std::move(buf)));
+    return send(BufferArena::makeShared<BufferString>(std::move(buf)));
 }
 
 ssize_t SockSender::send(const char* buf, size_t size) {
@@ -980,6 +1658,8 @@ const EventPoller::Ptr& SocketHelper::getPoller() const {
 
 void SocketHelper::setSendFlushFlag(bool try_flush) { try_flush_ = try_flush; }
 
+void SocketHelper::setSendCork(bool cork) { cork_ = cork; }
+
 void SocketHelper::setSendFlags(int flags) {
     if (!sock_) {
         return ;
@@ -1037,7 +1717,67 @@ ssize_t SocketHelper::send(Buffer::Ptr buf) {
     if (!sock_) {
         return -1;
     }
-    return sock_->send(std::move(buf), nullptr, 0, try_flush_);
+    if (!cork_) {
+        return sock_->send(std::move(buf), nullptr, 0, try_flush_);
+    }
+    auto ret = sock_->send(std::move(buf), nullptr, 0, false);
+    if (ret > 0) {
+        sock_->flushLater();
+    }
+    return ret;
+}
+
+ssize_t SocketHelper::sendFile(int fd, off_t offset, size_t len) {
+    if (!sock_) {
+        return -1;
+    }
+    if (!overSsl()) {
+        if (!cork_) {
+            return sock_->sendFile(fd, offset, len, try_flush_);
+        }
+        auto ret = sock_->sendFile(fd, offset, len, false);
+        if (ret > 0) {
+            sock_->flushLater();
+        }
+        return ret;
+    }
+    auto file = BufferFile::create(fd, offset, len);
+    if (!file) {
+        return -1;
+    }
+    sendFileChunked(file, 0);
+    return file->size();
+}
+
+void SocketHelper::sendFileChunked(const BufferFile::Ptr& file, size_t sent) {
+    static constexpr size_t kChunkSize = 16 * 1024;     // 单个TLS记录的最大长度
+    static constexpr size_t kWindowSize = 256 * 1024;   // 每批读取的数据量, 发送完后再读取下一批
+    size_t window = std::min(file->size() - sent, kWindowSize);
+    while (window) {
+        auto size = std::min(window, kChunkSize);
+        auto buf = BufferRaw::create(size);
+        auto n = pread(file->fd(), buf->data(), size, file->offset() + sent);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            shutdown(SockException(ErrorCode::Other, "read file failed"));
+            return;
+        }
+        buf->setSize(n);
+        send(std::move(buf));
+        sent += n;
+        window -= n;
+    }
+    if (sent == file->size() || !sock_) {
+        return;
+    }
+    std::weak_ptr<SocketHelper> weak_self = shared_from_this();
+    sock_->onceFlushed([weak_self, file, sent]() {
+        if (auto strong_self = weak_self.lock()) {
+            strong_self->sendFileChunked(file, sent);
+        }
+    });
 }
 
 void SocketHelper::shutdown(const SockException& ex) {
@@ -1065,7 +1805,7 @@ void SocketHelper::setSock(const Socket::Ptr& sock) {
 }
 
 std::ostream& operator<<(std::ostream& os, const SockException& ex) {
-    os << ex.getErrCode() << "(" << ex.what() << ")";
+    os << static_cast<int>(ex.getErrCode()) << "(" << ex.what() << ")";
     return os;
 }
 
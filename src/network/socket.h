@@ -10,6 +10,7 @@
 
 #include "buffersock.h"
 #include "eventpoller.h"
+#include "mpscqueue.h"
 #include "timer.h"
 #include "sockutil.h"
 #include "utility.h"
@@ -150,6 +151,15 @@ public:
 #define ErrorP(ptr)  \
     ErrorL << ptr->getIdentifier() << "(" << ptr->getPeerIp() << ":" << ptr->getPeerPort() << ")"
 
+// TCP监听socket对新连接设置的选项, 缓冲区大小不大于0、close_wait小于0时不设置
+struct AcceptOptions {
+    bool no_delay = true;                    // TCP_NODELAY
+    int send_buf = SOCKET_DEFAULT_BUF_SIZE;  // SO_SNDBUF
+    int recv_buf = SOCKET_DEFAULT_BUF_SIZE;  // SO_RCVBUF
+    int close_wait = 0;                      // SO_LINGER等待秒数
+    bool inherit = true;                     // 只在监听socket上设置一次, linux下由新连接继承, 不再逐个设置
+};
+
 class Socket : public std::enable_shared_from_this<Socket>,
                public Noncopyable,
                public SockInfo {
@@ -170,10 +180,12 @@ public:
     void connect(const std::string& url, uint16_t port, const onErrCb& cb,
                 float timeout_sec = 5,
                 const std::string& local_ip = "::", uint16_t local_port = 0);  // 创建和初始化tcp客户端socket
-    bool listen(uint16_t port, const std::string& local_ip = "::", int backlog = 1024);  // 创建和初始化tcp服务器 监听socket
+    bool listen(uint16_t port, const std::string& local_ip = "::", int backlog = 1024, bool reuse_port = false);  // 创建和初始化tcp服务器 监听socket
     bool bindUdpSock(uint16_t port, const std::string& local_ip = "::", bool enable_reuse = true);  // 创建和初始化udp socket
     bool fromSock(int fd, SockNum::SockType type);  // 从已有fd创建socket
     bool cloneSocket(const Socket& other);  // 从另一个Socket复制， 让一个Socket被多个poller监听
+    void setAcceptExclusive(bool exclusive);  // 监听socket以EPOLLEXCLUSIVE注册, 被多个poller监听时新连接只唤醒一个; 在listen或cloneSocket之前调用
+    void setAcceptOptions(const AcceptOptions& options);  // 监听socket对新连接设置的选项, 在listen之前调用, cloneSocket时复制
     // 设置事件回调
     void setOnRead(onReadCb cb);
     void setOnMultiRead(onMultiReadCb cb);
@@ -190,7 +202,12 @@ public:
                 socklen_t addr_len = 0, bool try_flush = true);
     ssize_t send(Buffer::Ptr buf, struct sockaddr* addr = nullptr, 
                 socklen_t addr_len = 0, bool try_flush = true);
+    // 发送文件中的一段(TCP), len为0时到文件末尾; 与send的数据按调用顺序发送, 使用sendfile不经过用户态内存
+    // fd被复制, 调用后可以立即关闭; 返回待发送的字节数, 失败时返回-1
+    ssize_t sendFile(int fd, off_t offset = 0, size_t len = 0, bool try_flush = true);
+    void onceFlushed(std::function<void()> cb);  // 发送缓存清空后回调一次, 当前已为空时异步回调
     int flushAll();
+    void flushLater();  // 在poller本轮循环的最后调用flushAll, 同一轮内多次调用只发送一次; 其他线程调用时投递一次flush任务
     bool emitErr(const SockException& err) noexcept;  // 安全添加错误事件，避免重复触发错误回调
     void enableRecv(bool enabled);  // 设置是否启用接收监听socket可读事件
     int rawFd() const;
@@ -202,7 +219,17 @@ public:
     bool bindPeerAddr(const struct sockaddr* dst_addr, socklen_t addr_len = 0, bool soft_bind = false);  // udp socket绑定对端地址
     void setSendFlags(int flags = SOCKET_DEFAULT_FLAGS);
     void closeSock(bool close_fd = true);
-    size_t getSendBufferCount();
+    size_t getSendBufferCount();  // 包括零拷贝发送后等待内核确认的缓冲区
+    // TCP一次待发送的数据不小于threshold字节时使用MSG_ZEROCOPY发送, 0为关闭; 需要在fd创建之后调用, 内核不支持时返回false
+    // 零拷贝发送的缓冲区在内核通过错误队列确认完成后才释放并回调setOnSendResult
+    bool enableZeroCopy(size_t threshold = 64 * 1024);
+    uint64_t getZeroCopyCopied() const;  // 内核退回为拷贝发送的零拷贝调用次数(如回环网卡)
+    // UDP发送时把发往同一目标、长度相同的连续数据包合并为一次UDP_SEGMENT发送; 需要在fd创建之后调用, 内核不支持时返回false
+    bool enableUdpGso(bool enable = true);
+    // UDP接收时由内核合并同一来源的数据包(UDP_GRO), 读取后按段长拆分为切片交给读回调; 内核不支持时返回false
+    bool enableUdpGro(bool enable = true);
+    // 自定义UDP的批量接收参数, 之后该socket使用独立的读缓存, 不再共享poller的读缓存
+    void setRecvmmsgOptions(const RecvmmsgOptions& options);
     uint64_t elapsedTimeAfterFlushed();
     int getRecvSpeed();
     int getSendSpeed();
@@ -217,13 +244,29 @@ private:
     Socket(EventPoller::Ptr poller, bool enable_mutex = true);
     void setSock(SockNum::Ptr sock);  // 设置sock_fd_和local_addr_、peer_addr_
     int onAccept(const SockNum::Ptr& sock, EventPoller::Poll_Event event) noexcept;  // TCP_Server类型的socket监听到Read_Event事件的回调
+    void onAcceptFd(int fd) noexcept;  // 为新连接创建Socket并回调on_accept_
+    static void applyAcceptOptions(int fd, const AcceptOptions& options);  // 对监听socket或新连接设置选项
+    bool attachAsyncIo(const SockNum::Ptr& sock);  // poller支持异步io时, 监听socket使用multishot accept, TCP使用multishot recv
+    void startAsyncRecv(const SockNum::Ptr& sock);  // 在poller线程调用
+    void onAsyncRecv(const SockNum::Ptr& sock, const char* data, ssize_t len) noexcept;
+    bool sendAsync(const SockNum::Ptr& sock, List<BufferList::Ptr>& packets);  // 把开头可以异步发送的缓冲区串联提交, 一个都没有提交时返回false
+    void onAsyncSent(const SockNum::Ptr& sock, const BufferList::Ptr& packet, ssize_t ret);
+    EventPoller::Poll_Event readFlag() const;  // 需要监听的读事件, 异步接收时不监听
     ssize_t onRead(const SockNum::Ptr& sock, const SocketRecvBuffer::Ptr& buffer) noexcept;  // TCP/UDP socket监听到Read_Event事件的回调
     void onWriteAble(const SockNum::Ptr& sock);  // socket可写事件触发时的回调
     void onConnected(const SockNum::Ptr& sock, const onErrCb& cb);  // TCP异步连接完成回调
     void onFlushed();  // 发送缓冲发送完成回调
-    void startWriteAbleEvent(const SockNum::Ptr& sock);
-    void stopWriteAbleEvent(const SockNum::Ptr& sock);
-    bool flushData(const SockNum::Ptr& sock, bool poller_thread);
+    bool startWriteAbleEvent(const SockNum::Ptr& sock, uint32_t write_events);  // 标记等待可写; 发送之后收到过可写事件或socket已经可写时撤销标记并返回true, 需要立即重试
+    void stopWriteAbleEvent();
+    bool flushData(const SockNum::Ptr& sock, bool poller_thread);  // 需要持有发送权
+    bool tryFlush(const SockNum::Ptr& sock, bool poller_thread);  // 取得发送权后flushData, 其他线程正在发送时不等待
+    void postFlush();  // 投递一次flush任务到poller线程, 执行前重复投递会被合并
+    BufferList::SendResult getSendResult();  // 持有发送权时调用, 设置变化后才重新生成回调
+    ssize_t sendZeroCopy(const SockNum::Ptr& sock, const BufferList::Ptr& packet);
+    bool onZeroCopyEvent(const SockNum::Ptr& sock);  // 读取错误队列中的零拷贝完成通知, 没有通知时返回false
+    void onZeroCopyDone(uint32_t lo, uint32_t hi);  // 序号lo~hi的零拷贝发送已完成
+    void releaseZeroCopy(bool close = false);  // 释放已确认的缓冲区, close为true时全部以发送失败回调
+    void resetUdpRecvBuffer();  // 根据GRO和自定义接收参数更换UDP读缓存, 在poller线程调用
     bool attachEvent(const SockNum::Ptr& sock);  // 根据socket类型，添加对应的事件回调(注册事件监听)
     ssize_t send_l(Buffer::Ptr buf, bool is_buf_sock, bool try_flush = true);
     void connect_l(const std::string& url, uint16_t port,
@@ -235,7 +278,8 @@ private:
     int sock_flags_ = SOCKET_DEFAULT_FLAGS;                   // socket发送时的flag
     uint32_t max_send_buffer_ms_ = SEND_TIME_OUT_SEC * 1000;  // 最大发送缓存，单位毫秒，距上次发送缓存清空时间不能超过该参数
     std::atomic<bool> enable_recv_{true};                      // 标记是否启用接收监听socket可读事件
-    std::atomic<bool> sendable_{true};                        // 标记socket是否可以直接发送数据(不通过缓冲区)
+    std::atomic<bool> sendable_{true};                        // 标记socket是否可以直接发送数据(不通过缓冲区), 为false时等待可写事件
+    std::atomic<uint32_t> write_events_{0};                   // poller线程收到的可写事件个数
     bool err_emit_ = false;                                    // 标记是否已经触发err回调
     bool enable_speed_ = false;                               // 标记是否启用网速统计
     std::shared_ptr<struct sockaddr_storage> udp_send_dst_;   // udp发送目标地址
@@ -251,15 +295,54 @@ private:
     onErrCb on_err_;                                        // socket异常事件回调
     onMultiReadCb on_multi_read_;                           // 收到数据事件
     onFlush on_flush_;                                      // socket缓存清空事件
+    List<std::shared_ptr<std::function<void()>>> once_flushed_;  // onceFlushed注册的一次性回调
     onAcceptCb on_accept_;                                  // tcp监听收到accept请求事件
     onCreateSocket on_before_accept_;                       // tcp监听收到accept请求，自定义创建peer
     MutexWrapper<std::recursive_mutex> mtx_event_;          // 设置自定义回调的锁
 
-    List<std::pair<Buffer::Ptr, bool>> send_buf_waiting_;   // 一级发送缓存, socket可写时会把一级缓存批量送入二级缓存
-    MutexWrapper<std::recursive_mutex> mtx_send_buf_waiting_;  // 一级发送缓存锁
+    // 一级发送缓存, 任意线程无锁写入, 取得发送权的线程(或closeSock)持有mtx_send_buf_sending_时批量取出送入二级缓存
+    MpscLinkedQueue<std::pair<Buffer::Ptr, bool>> send_buf_waiting_;
+    std::atomic<size_t> send_waiting_count_{0};                // 一级发送缓存中的个数, 写入前增加, 取出后减少
+    std::atomic<size_t> send_file_count_{0};                   // 一级发送缓存中BufferFile的个数
+    std::atomic<bool> flushing_{false};                        // 发送权, 同一时间只有一个线程取出一级缓存并写入socket
+    std::atomic<bool> flush_missed_{false};                    // 有线程写入后没有抢到发送权, 由持有者释放后继续发送
+    std::atomic<bool> poller_flush_missed_{false};             // poller线程的可写事件没有抢到发送权, 由持有者释放后交回poller线程
+    std::atomic<bool> flush_posted_{false};                    // 已向poller投递了flush任务还没有执行
+    std::atomic<bool> flush_later_{false};                     // 已加入poller本轮待发送的socket列表
     List<BufferList::Ptr> send_buf_sending_;                   // 二级发送缓存, socket可写时会把二级缓存批量写入socket
-    MutexWrapper<std::recursive_mutex> mtx_send_buf_sending_;  // 二级发送缓存锁
+    MutexWrapper<std::recursive_mutex> mtx_send_buf_sending_;  // 二级发送缓存锁, 同时与closeSock互斥地取出一级缓存
     BufferList::SendResult send_result_;                        // 发送buffer结果回调
+    std::atomic<uint32_t> send_result_version_{1};              // 影响发送结果回调的设置每变化一次加一
+    uint32_t send_result_built_ = 0;                            // send_result_cb_对应的版本, 只在持有发送权时访问
+    std::shared_ptr<BufferList::SendResult> send_result_cb_;    // 合并了网速统计和零拷贝的发送结果回调, 为空表示不需要回调
+
+    struct ZeroCopyBuffer {
+        bool tagged;        // 所在的发送调用已结束, seq有效
+        uint32_t seq;       // 序号小于seq的零拷贝发送全部完成后才能释放
+        Buffer::Ptr buffer;
+        BufferList::SendResult cb;
+    };
+    std::atomic<bool> zerocopy_{false};                         // 该fd开启过零拷贝发送, 之后的发送都要跟踪完成通知
+    size_t zerocopy_threshold_ = 0;                             // 0为不使用零拷贝发送
+    uint32_t zerocopy_seq_ = 0;                                 // 下一次零拷贝发送的序号, 与内核的计数一致
+    uint32_t zerocopy_done_ = 0;                                // 序号小于该值的零拷贝发送都已完成
+    std::vector<std::pair<uint32_t, uint32_t>> zerocopy_ranges_;  // 乱序到达的完成通知
+    std::atomic<uint64_t> zerocopy_copied_{0};
+    List<ZeroCopyBuffer> zerocopy_pending_;                     // 已写入socket, 等待内核确认的缓冲区
+    MutexWrapper<std::recursive_mutex> mtx_zerocopy_;
+    std::atomic<bool> udp_gso_{false};                          // UDP发送使用UDP_SEGMENT合并
+    std::atomic<bool> async_io_{false};                         // TCP通过poller的io_uring异步接收和发送
+    bool accept_exclusive_ = false;                             // 监听fd以EPOLLEXCLUSIVE加入poller
+    AcceptOptions accept_options_;                              // 监听socket对新连接设置的选项
+    std::atomic<bool> connection_counted_{false};               // 已计入poller的连接数, 只统计accept和connect得到的tcp连接
+    std::vector<BufferList::Ptr> async_sending_;                // 已提交给io_uring还没有全部完成的发送, 受mtx_send_buf_sending_保护
+    size_t async_pending_ = 0;                                  // async_sending_中还没有完成的个数
+    int async_err_ = 0;                                         // 本批异步发送的第一个错误
+    uint64_t async_recv_id_ = 0;                                // multishot recv的请求id, 只在poller线程访问
+    // 以下只在poller线程访问
+    bool udp_gro_ = false;                                      // 开启了UDP_GRO
+    std::shared_ptr<RecvmmsgOptions> udp_recv_options_;         // 自定义的UDP接收参数
+    SocketRecvBuffer::Ptr udp_recv_buffer_;                     // 开启GRO或自定义接收参数后替代poller共享的读缓存
     ObjectCounter<Socket> statistic_;                           // 对象个数统计
     // 缓存地址，防止tcp reset 导致无法获取对端的地址
     struct sockaddr_storage local_addr_;
@@ -301,6 +384,7 @@ public:
 public:
     const EventPoller::Ptr& getPoller() const;
     void setSendFlushFlag(bool try_flush);
+    void setSendCork(bool cork);  // 开启后send只写入发送缓存, 在poller本轮循环的最后合并发送, 优先于setSendFlushFlag
     void setSendFlags(int flags);
     bool isSocketBusy() const;
     void setOnCreateSocket(Socket::onCreateSocket cb);
@@ -319,6 +403,8 @@ public:
     // 重载SockSender接口
     using SockSender::send;
     ssize_t send(Buffer::Ptr buf) override;
+    // 发送文件中的一段, 明文直接sendfile; SSL连接时分块读取后经send加密, 每次等发送缓存清空后再读取下一批
+    virtual ssize_t sendFile(int fd, off_t offset = 0, size_t len = 0);
     void shutdown(const SockException& ex = SockException(ErrorCode::Shutdown, "self shutdown")) override;
     void safeShutdown(const SockException& ex = SockException(ErrorCode::Shutdown, "self shutdown"));
 
@@ -331,8 +417,12 @@ protected:
     void setPoller(const EventPoller::Ptr& poller);
     void setSock(const Socket::Ptr& sock);
 
+private:
+    void sendFileChunked(const BufferFile::Ptr& file, size_t sent);
+
 private:
     bool try_flush_ = true;
+    bool cork_ = false;
     Socket::Ptr sock_;
     EventPoller::Ptr poller_;
     Socket::onCreateSocket on_create_socket_;
@@ -3,6 +3,7 @@
 #include <sys/socket.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <linux/filter.h>
 #include <netinet/tcp.h>
 #include <string>
 #include <unordered_map>
@@ -83,15 +84,15 @@ int SockUtil::connect(const char* host, uint16_t port, bool async,
 }
 
 // 创建tcp监听套接字
-int SockUtil::listen(const uint16_t port, const char* local_ip, int back_log) {
+int SockUtil::listen(const uint16_t port, const char* local_ip, int back_log, bool reuse_port) {
     int fd = -1;
     int family = supportIpv6() ? (isIpv4(local_ip) ? AF_INET : AF_INET6) : AF_INET;
-    if (fd = static_cast<int>(socket(family, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+    if ((fd = static_cast<int>(socket(family, SOCK_STREAM, IPPROTO_TCP))) == -1) {
         WarnL << "Create socket failed: " << get_uv_errmsg(true);
         return -1;
     }
 
-    setReuseable(fd, true, false);
+    setReuseable(fd, true, reuse_port);
     setNoBlocked(fd);
     setCloExec(fd);
 
@@ -103,6 +104,7 @@ int SockUtil::listen(const uint16_t port, const char* local_ip, int back_log) {
 
     if (::listen(fd, back_log) == -1) {
         WarnL << "Listen socket failed: " << get_uv_errmsg(true);
+        close(fd);
         return -1;
     }
     return fd;
@@ -123,6 +125,9 @@ int SockUtil::bindUdpSock(const uint16_t port, const char* local_ip, bool enable
     setRecvBuf(fd);
     setCloseWait(fd);
     setCloExec(fd);
+    if (enable_reuse) {
+        setReuseable(fd);  // 会话的socket需要绑定到服务器的端口上
+    }
 
     if (bind_sock(fd, local_ip, port, family) == -1) {
         WarnL << "Bind socket failed: " << get_uv_errmsg();
@@ -279,6 +284,39 @@ int SockUtil::setCloseWait(int fd, int second) {
     return ret;
 }
 
+int SockUtil::setBusyPoll(int fd, int usec) {
+#if defined(SO_BUSY_POLL)
+    int ret = setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, static_cast<socklen_t>(sizeof(usec)));
+    if (ret == -1) {
+        TraceL << "setsockopt SO_BUSY_POLL failed";
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+int SockUtil::setReusePortCpuSteering(int fd, uint32_t groups) {
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+    if (groups == 0) {
+        return -1;
+    }
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},  // A = 收包cpu
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, groups},  // A = A % groups
+        {BPF_RET | BPF_A, 0, 0, 0},  // 返回组内序号
+    };
+    struct sock_fprog prog = {static_cast<unsigned short>(sizeof(code) / sizeof(code[0])), code};
+    int ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, static_cast<socklen_t>(sizeof(prog)));
+    if (ret == -1) {
+        TraceL << "setsockopt SO_ATTACH_REUSEPORT_CBPF failed";
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
 // 配置是否允许发送或接收udp广播信息
 int setBroadcast(int fd, bool on) {
     int opt = on ? 1 : 0;
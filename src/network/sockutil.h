@@ -28,8 +28,8 @@ public:
     // 创建tcp客服端套接字并连接到服务器
     static int connect(const char* host, uint16_t port, bool async = true,
                        const char* local_ip = "::", uint16_t local_port = 0);
-    // 创建tcp监听套接字
-    static int listen(const uint16_t port, const char* local_ip = "::", int back_log = 1024);
+    // 创建tcp监听套接字, reuse_port为true时多个套接字可以监听同一端口, 由内核分发新连接
+    static int listen(const uint16_t port, const char* local_ip = "::", int back_log = 1024, bool reuse_port = false);
     // 创建udp套接字
     static int bindUdpSock(const uint16_t port, const char* local_ip = "::", 
                         bool enable_reuse = true);
@@ -58,6 +58,10 @@ public:
     static int setCloExec(int fd, bool on = true);
     // 设置socket关闭等待时间, 如果关闭时还有数据未发送完，允许等待second秒
     static int setCloseWait(int fd, int second = 0);
+    // 配置SO_BUSY_POLL, 阻塞读或者poll时在网卡驱动队列上忙轮询usec微秒(调大需要CAP_NET_ADMIN权限)
+    static int setBusyPoll(int fd, int usec);
+    // 给fd所在的SO_REUSEPORT组挂载cBPF程序, 按收包cpu编号对groups取模选择组内第几个socket
+    static int setReusePortCpuSteering(int fd, uint32_t groups);
     // 进行dns解析
     static bool getDomainIP(const char* host, uint16_t port,
                             struct sockaddr_storage& addr,
@@ -139,12 +139,34 @@ void TcpServer::start_l(uint16_t port, const std::string& host, uint32_t backlog
         });
     }
 
+    if (multi_poller_ && accept_mode_ == AcceptMode::ReusePort) {
+        // 每个poller单独监听, 端口为0时其他socket监听第一个socket分配的端口
+        if (!socket_->listen(port, host.c_str(), backlog, true)) {
+            std::string err = (StrPrinter << "Listen on " << host << " " << port
+                                          << " failed: " << get_uv_errmsg(true));
+            throw std::runtime_error(err);
+        }
+        port = socket_->getLocalPort();
+        for (auto& pr : cloned_server_) {
+            if (!pr.second->socket_->listen(port, host.c_str(), backlog, true)) {
+                std::string err = (StrPrinter << "Listen on " << host << " " << port
+                                              << " with SO_REUSEPORT failed: " << get_uv_errmsg(true));
+                throw std::runtime_error(err);
+            }
+        }
+        InfoL << "TCP server listening on [" << host << "]: " << port << " with "
+              << cloned_server_.size() + 1 << " SO_REUSEPORT sockets";
+        return;
+    }
+
+    socket_->setAcceptExclusive(multi_poller_ && accept_mode_ == AcceptMode::Exclusive);
     if (!socket_->listen(port, host.c_str(), backlog)) {
         std::string err = (StrPrinter << "Listen on " << host << " " << port
                                       << " failed: " << get_uv_errmsg(true));
         throw std::runtime_error(err);
     }
     for (auto& pr : cloned_server_) {
+        pr.second->socket_->setAcceptExclusive(multi_poller_ && accept_mode_ == AcceptMode::Exclusive);
         pr.second->socket_->cloneSocket(*socket_);
     }
     InfoL << "TCP server listening on [" << host << "]: " << port;
@@ -154,10 +176,12 @@ void TcpServer::cloneFrom(const TcpServer& that) {
     if (!that.socket_) {
         throw std::invalid_argument("TcpServer::cloneFrom other with null socket");
     }
+    accept_options_ = that.accept_options_;
     setupEvent();
     main_server_ = false;
     on_create_socket_ = that.on_create_socket_;
     session_alloc_ = that.session_alloc_;
+    accept_mode_ = that.accept_mode_;
     std::weak_ptr<TcpServer> weak_self = std::static_pointer_cast<TcpServer>(shared_from_this());
     timer_ = std::make_shared<Timer>(2.0f, [weak_self]() -> bool {
         auto strong_self = weak_self.lock();
@@ -173,9 +197,15 @@ void TcpServer::cloneFrom(const TcpServer& that) {
 
 Socket::Ptr TcpServer::onBeforeAcceptConnection(const EventPoller::Ptr& poller) {
     assert(poller_->isCurrentThread());
-    return createSocket(multi_poller_ ? EventPollerPool::Instance().getPoller(false) : poller_);
+    // 每个poller都在接受连接时, 连接留在本poller, 不再重新分配
+    return createSocket(multi_poller_ && accept_mode_ == AcceptMode::Shared
+                            ? EventPollerPool::Instance().getPoller(false) : poller_);
 }
 
+void TcpServer::setAcceptMode(AcceptMode mode) { accept_mode_ = mode; }
+
+void TcpServer::setAcceptOptions(const AcceptOptions& options) { accept_options_ = options; }
+
 void TcpServer::onManagerSession() {
     assert(poller_->isCurrentThread());
     onceToken token([&]() { is_on_manager_ = true; }, [&]() { is_on_manager_ = false; });
@@ -210,6 +240,7 @@ TcpServer::Ptr TcpServer::getServer(const EventPoller* poller) const {
 
 void TcpServer::setupEvent() {
     socket_ = createSocket(poller_);  // 调用构造tcpserver时初始化的_on_create_socket回调函数创建socket
+    socket_->setAcceptOptions(accept_options_);
     std::weak_ptr<TcpServer> weak_self = std::static_pointer_cast<TcpServer>(shared_from_this());
     socket_->setOnBeforeAccept([weak_self](const EventPoller::Ptr& poller) -> Socket::Ptr {
         if (auto strong_self = weak_self.lock()) {
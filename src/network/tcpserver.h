@@ -17,6 +17,13 @@ class TcpServer : public Server {
 public:
     using Ptr = std::shared_ptr<TcpServer>;
 
+    // 多线程模式下各poller接受新连接的方式
+    enum class AcceptMode {
+        Shared,  // 所有poller监听同一个fd, 主server接受的连接按负载分配到其他poller
+        ReusePort,  // 每个poller一个SO_REUSEPORT监听socket, 由内核分发, 连接留在接受它的poller
+        Exclusive,  // 所有poller以EPOLLEXCLUSIVE监听同一个fd, 每次只唤醒一个poller, 连接留在接受它的poller
+    };
+
     explicit TcpServer(const EventPoller::Ptr& poller = nullptr);
     ~TcpServer() override;
 
@@ -43,6 +50,8 @@ public:
 
     uint16_t getPort() const;
     void setOnCreateSocket(Socket::onCreateSocket cb);
+    void setAcceptMode(AcceptMode mode);  // 需要在start之前调用
+    void setAcceptOptions(const AcceptOptions& options);  // 新连接的socket选项, 需要在start之前调用
     Session::Ptr createSession(const Socket::Ptr& socket);
 
 protected:
@@ -60,6 +69,8 @@ private:
 
 private:
     bool multi_poller_;
+    AcceptMode accept_mode_ = AcceptMode::Shared;
+    AcceptOptions accept_options_;
     bool is_on_manager_ = false;
     bool main_server_ = true;
     std::weak_ptr<TcpServer> parent_;
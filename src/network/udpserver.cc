@@ -15,29 +15,125 @@ static const uint8_t s_in6_addr_maped[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 
 static constexpr auto kUdpDelayCloseMs = 3 * 1000;
 
-static UdpServer::PeerIdType makeSockId(struct sockaddr* addr, int addr_len) {
-    UdpServer::PeerIdType ret;
-    ret.resize(18);
+////////////////////////////////////////// UdpPeerId //////////////////////////////////////////
+
+UdpPeerId UdpPeerId::make(const struct sockaddr* addr) {
+    UdpPeerId ret;
     switch (addr->sa_family) {
         case AF_INET: {
-            ret[0] = reinterpret_cast<sockaddr_in*>(addr)->sin_port >> 8;
-            ret[1] = reinterpret_cast<sockaddr_in*>(addr)->sin_port & 0xFF;
-            memcpy(&ret[2], &s_in6_addr_maped, 12);  // 填充前缀
-            memcpy(&ret[14], &reinterpret_cast<sockaddr_in*>(addr)->sin_addr, 4);  // 填充ip
+            auto in = reinterpret_cast<const sockaddr_in*>(addr);
+            ret.port = in->sin_port;
+            memcpy(ret.addr, s_in6_addr_maped, 12);  // 填充前缀
+            memcpy(ret.addr + 12, &in->sin_addr, 4);  // 填充ip
             return ret;
         }
         case AF_INET6: {
-            ret[0] = reinterpret_cast<sockaddr_in6*>(addr)->sin6_port >> 8;
-            ret[1] = reinterpret_cast<sockaddr_in6*>(addr)->sin6_port & 0xFF;
-            memcpy(&ret[2], &reinterpret_cast<sockaddr_in6*>(addr)->sin6_addr, 16);
+            auto in6 = reinterpret_cast<const sockaddr_in6*>(addr);
+            ret.port = in6->sin6_port;
+            memcpy(ret.addr, &in6->sin6_addr, 16);
             return ret;
         }
         default:
             assert(0);
-            return "";
+            memset(&ret, 0, sizeof(ret));
+            return ret;
+    }
+}
+
+size_t UdpPeerIdHash::operator()(const UdpPeerId& id) const {
+    uint64_t hi, lo;
+    memcpy(&hi, id.addr, 8);
+    memcpy(&lo, id.addr + 8, 8);
+    // 每段乘以不同的奇数常量后合并, 最后再混合一次使高低位都均匀
+    uint64_t h = (hi * 0x9E3779B97F4A7C15ULL) ^ (lo * 0xC2B2AE3D27D4EB4FULL) ^ (id.port * 0x165667B19E3779F9ULL);
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 32;
+    return static_cast<size_t>(h);
+}
+
+////////////////////////////////////// UdpSessionTable //////////////////////////////////////
+
+UdpSessionTable::UdpSessionTable(size_t shards) {
+    size_t size = 1;
+    while (size < shards) {
+        size <<= 1;
+    }
+    mask_ = size - 1;
+    shards_.reset(new Shard[size]);
+}
+
+UdpSessionTable::Shard& UdpSessionTable::shard(const UdpPeerId& id) {
+    // 分片用哈希的高位, unordered_map的桶用低位
+    return shards_[(UdpPeerIdHash()(id) >> 48) & mask_];
+}
+
+SessionHelper::Ptr UdpSessionTable::find(const UdpPeerId& id) {
+    auto& s = shard(id);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.map.find(id);
+    return it == s.map.end() ? nullptr : it->second;
+}
+
+SessionHelper::Ptr UdpSessionTable::findOrCreate(const UdpPeerId& id, const Creator& creator) {
+    auto& s = shard(id);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.map.find(id);
+    if (it != s.map.end()) {
+        return it->second;
+    }
+    auto helper = creator();
+    if (helper) {
+        s.map.emplace(id, helper);
     }
+    return helper;
 }
 
+SessionHelper::Ptr UdpSessionTable::erase(const UdpPeerId& id) {
+    auto& s = shard(id);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.map.find(id);
+    if (it == s.map.end()) {
+        return nullptr;
+    }
+    auto helper = std::move(it->second);
+    s.map.erase(it);
+    return helper;
+}
+
+std::vector<SessionHelper::Ptr> UdpSessionTable::getAll() {
+    std::vector<SessionHelper::Ptr> ret;
+    for (size_t i = 0; i <= mask_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mtx);
+        for (auto& pr : shards_[i].map) {
+            ret.emplace_back(pr.second);
+        }
+    }
+    return ret;
+}
+
+void UdpSessionTable::clear() {
+    for (size_t i = 0; i <= mask_; ++i) {
+        decltype(shards_[i].map) map;
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mtx);
+            map.swap(shards_[i].map);
+        }
+        // 会话在锁外析构
+    }
+}
+
+size_t UdpSessionTable::size() {
+    size_t ret = 0;
+    for (size_t i = 0; i <= mask_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mtx);
+        ret += shards_[i].map.size();
+    }
+    return ret;
+}
+
+///////////////////////////////////////// UdpServer /////////////////////////////////////////
+
 UdpServer::UdpServer(const EventPoller::Ptr& poller) {
     multi_poller_ = !poller;
     setOnCreateSocket(nullptr);
@@ -51,9 +147,8 @@ UdpServer::~UdpServer() {
     timer_.reset();
     socket_.reset();
     cloned_server_.clear();
-    if (!cloned_ && session_mutex_ && session_map_) {
-        std::lock_guard<decltype(*session_mutex_)> lock(*session_mutex_);
-        session_map_->clear();
+    if (!cloned_ && session_table_) {
+        session_table_->clear();
     }
 }
 
@@ -78,6 +173,11 @@ void UdpServer::setOnCreateSocket(onCreateSocket cb) {
     }
 }
 
+void UdpServer::enableReusePort(bool enable, bool cpu_steering) {
+    reuse_port_ = enable;
+    cpu_steering_ = enable && cpu_steering;
+}
+
 UdpServer::Ptr UdpServer::onCreateServer(const EventPoller::Ptr& poller) {
     return Ptr(new UdpServer(poller), [poller](UdpServer* ptr) {
         poller->async([ptr]() { delete ptr; });
@@ -92,16 +192,17 @@ void UdpServer::cloneFrom(const UdpServer& that) {
     cloned_ = true;
     on_create_socket_ = that.on_create_socket_;
     session_alloc_ = that.session_alloc_;
-    session_mutex_ = that.session_mutex_;
-    session_map_ = that.session_map_;
+    session_table_ = that.session_table_;
+    reuse_port_ = that.reuse_port_;
+    cpu_steering_ = that.cpu_steering_;
     this->mIni::operator=(that);  // 复制配置
 }
 
 void UdpServer::start_l(uint16_t port, const std::string& host) {
     setupEvent();
-    // 主server才创建session map，其他cloned server共享
-    session_mutex_ = std::make_shared<std::recursive_mutex>();
-    session_map_ = std::make_shared<std::unordered_map<PeerIdType, SessionHelper::Ptr>>();
+    // 主server才创建会话表，其他cloned server共享; 每个poller对应一个分片, 分片越多锁冲突越少
+    session_table_ = std::make_shared<UdpSessionTable>(
+        multi_poller_ ? 2 * EventPollerPool::Instance().getExecutorSize() : 1);
 
     std::weak_ptr<UdpServer> weak_self =
         std::static_pointer_cast<UdpServer>(shared_from_this());
@@ -132,6 +233,13 @@ void UdpServer::start_l(uint16_t port, const std::string& host) {
         });
     }
 
+    if (multi_poller_ && reuse_port_) {
+        bindReusePort(port, host);
+        InfoL << "UDP server bind to [" << host << "]: " << getPort() << " with " << cloned_server_.size() + 1
+              << " SO_REUSEPORT sockets";
+        return;
+    }
+
     if (!socket_->bindUdpSock(port, host.c_str())) {
         std::string err = (StrPrinter << "Bind udp socket on" << host << " "
                                       << port << " failed: " << get_uv_errmsg(true));
@@ -144,16 +252,32 @@ void UdpServer::start_l(uint16_t port, const std::string& host) {
     InfoL << "UDP server bind to [" << host << "]: " << port;
 }
 
-void UdpServer::onManagerSession() {
-    decltype(session_map_) copy_map;
-    {
-        std::lock_guard<decltype(*session_mutex_)> lock(*session_mutex_);
-        copy_map = std::make_shared<
-            std::unordered_map<PeerIdType, SessionHelper::Ptr>>(*session_map_);  // 防止遍历时移除
+void UdpServer::bindReusePort(uint16_t port, const std::string& host) {
+    // 按poller编号顺序绑定, 监听socket在reuseport组中的序号与poller编号(也是亲和的cpu编号)一致
+    std::vector<Socket::Ptr> socks;
+    EventPollerPool::Instance().forEach([&](const TaskExecutor::Ptr& executor) {
+        auto poller = static_cast<EventPoller*>(executor.get());
+        socks.emplace_back(poller == poller_.get() ? socket_ : cloned_server_[poller]->socket_);
+    });
+    for (auto& sock : socks) {
+        if (!sock->bindUdpSock(port, host.c_str(), true)) {
+            std::string err = (StrPrinter << "Bind udp socket on" << host << " "
+                                          << port << " failed: " << get_uv_errmsg(true));
+            throw std::runtime_error(err);
+        }
+        port = sock->getLocalPort();  // 端口为0时其他socket绑定到第一个socket分配的端口
+    }
+    if (cpu_steering_ && -1 == SockUtil::setReusePortCpuSteering(socks.front()->rawFd(), socks.size())) {
+        WarnL << "Attach reuseport cpu steering program failed: " << get_uv_errmsg(true);
     }
-    auto lam = [copy_map]() {
-        for (auto& pr : *copy_map) {
-            auto& session = pr.second->session();
+}
+
+void UdpServer::onManagerSession() {
+    // 拷贝一份, 防止遍历时移除
+    auto copy_list = std::make_shared<std::vector<SessionHelper::Ptr>>(session_table_->getAll());
+    auto lam = [copy_list]() {
+        for (auto& helper : *copy_list) {
+            auto& session = helper->session();
             if (!session->getPoller()->isCurrentThread()) {
                 continue;
             }
@@ -175,8 +299,7 @@ void UdpServer::onManagerSession() {
 }
 
 void UdpServer::onRead(Buffer::Ptr& buf, struct sockaddr* addr, int addr_len) {
-    const auto id = makeSockId(addr, addr_len);
-    onRead_l(true, id, buf, addr, addr_len);
+    onRead_l(true, UdpPeerId::make(addr), buf, addr, addr_len);
 }
 
 static void emitSessionRecv(const SessionHelper::Ptr& helper, const Buffer::Ptr& buf) {
@@ -195,34 +318,33 @@ static void emitSessionRecv(const SessionHelper::Ptr& helper, const Buffer::Ptr&
 void UdpServer::onRead_l(bool is_server_fd, const PeerIdType& id, Buffer::Ptr& buf,
               struct sockaddr* addr, int addr_len) {
     bool is_new = false;
-    if (auto helper = getOrCreateSession(id, buf, addr, addr_len, is_new)) {
+    auto helper = getOrCreateSession(id, buf, addr, addr_len, is_new);
+    if (!helper) {
+        return;  // 会话在其他线程创建, 数据随创建任务一起投递
+    }
+    if (helper->session()->getPoller()->isCurrentThread()) {
         emitSessionRecv(helper, buf);  // 当前线程收到数据，直接处理
-    } else {
-        WarnL << "UDP packet incoming from other thread";
-        std::weak_ptr<SessionHelper> weak_helper = helper;
-        auto cacheable_buf = std::move(buf);
-        helper->session()->async([weak_helper, cacheable_buf]() {
-            if (auto strong_helper = weak_helper.lock()) {
-                emitSessionRecv(strong_helper, cacheable_buf);
-            }
-        });
+        return;
+    }
+    std::weak_ptr<SessionHelper> weak_helper = helper;
+    auto cacheable_buf = std::move(buf);
+    helper->session()->async([weak_helper, cacheable_buf]() {
+        if (auto strong_helper = weak_helper.lock()) {
+            emitSessionRecv(strong_helper, cacheable_buf);
+        }
+    });
 
 #if !defined(NDEBUG)
-        if (is_new) {
-            TraceL << "UDP packet incoming from " << (is_server_fd ? "server fd" : "other peer fd");
-        }
-#endif
+    if (is_new) {
+        TraceL << "UDP packet incoming from " << (is_server_fd ? "server fd" : "other peer fd");
     }
+#endif
 }
 
 SessionHelper::Ptr UdpServer::getOrCreateSession(
     const PeerIdType& id, Buffer::Ptr& buf, struct sockaddr* addr, int addr_len, bool& is_new) {
-    {
-        std::lock_guard<decltype(*session_mutex_)> lock(*session_mutex_);
-        auto it = session_map_->find(id);
-        if (it != session_map_->end()) {
-            return it->second;
-        }
+    if (auto helper = session_table_->find(id)) {
+        return helper;
     }
     is_new = true;
     return createSession(id, buf, addr, addr_len);
@@ -230,8 +352,9 @@ SessionHelper::Ptr UdpServer::getOrCreateSession(
 
 SessionHelper::Ptr UdpServer::createSession(
     const PeerIdType& id, Buffer::Ptr& buf, struct sockaddr* addr, int addr_len) {
+    // 每个poller有自己的监听socket时, 会话留在收包的poller上
     auto socket = createSocket(
-        multi_poller_ ? EventPollerPool::Instance().getPoller(false) : poller_,
+        multi_poller_ && !reuse_port_ ? EventPollerPool::Instance().getPoller(false) : poller_,
         buf, addr, addr_len);
     if (!socket) {
         return nullptr;
@@ -244,64 +367,55 @@ SessionHelper::Ptr UdpServer::createSession(
         if (!server) {
             return nullptr;
         }
-
-        std::lock_guard<decltype(*session_mutex_)> lock(*session_mutex_);
         // 如果已经创建该客户端对应的UdpSession类，那么直接返回
-        auto it = session_map_->find(id);
-        if (it != session_map_->end()) {
-            return it->second;
-        }
-
-        assert(server->socket_);
-        socket->bindUdpSock(server->socket_->getLocalPort(), socket_->getLocalIp());
-        socket->bindPeerAddr(reinterpret_cast<const struct sockaddr*>(addr_str.data()), addr_str.size());
-        auto helper = session_alloc_(server, socket);
-        helper->session()->attachServer(*this);  // 把本服务器的配置传递给 Session
-
-        std::weak_ptr<SessionHelper> weak_helper = helper;
-        socket->setOnRead([weak_self, weak_helper, id](
-            Buffer::Ptr& buf, struct sockaddr* addr, int addr_len) {
-                auto strong_self = weak_self.lock();
-                if (!strong_self) {
-                    return ;
-                }
+        return session_table_->findOrCreate(id, [&]() -> SessionHelper::Ptr {
+            assert(server->socket_);
+            socket->bindUdpSock(server->socket_->getLocalPort(), socket_->getLocalIp());
+            socket->bindPeerAddr(reinterpret_cast<const struct sockaddr*>(addr_str.data()), addr_str.size());
+            auto helper = session_alloc_(server, socket);
+            helper->session()->attachServer(*this);  // 把本服务器的配置传递给 Session
+
+            std::weak_ptr<SessionHelper> weak_helper = helper;
+            socket->setOnRead([weak_self, weak_helper, id](
+                Buffer::Ptr& buf, struct sockaddr* addr, int addr_len) {
+                    auto strong_self = weak_self.lock();
+                    if (!strong_self) {
+                        return ;
+                    }
 
-                if (id == makeSockId(addr, addr_len)) {
-                   if (auto strong_helper = weak_helper.lock()) {
-                        emitSessionRecv(strong_helper, buf);
-                   }
-                   return ;
-                }
+                    if (id == UdpPeerId::make(addr)) {
+                       if (auto strong_helper = weak_helper.lock()) {
+                            emitSessionRecv(strong_helper, buf);
+                       }
+                       return ;
+                    }
 
-                strong_self->onRead_l(false, id, buf, addr, addr_len);
-        });
+                    strong_self->onRead_l(false, id, buf, addr, addr_len);
+            });
 
-        socket->setOnErr([weak_self, weak_helper, id](const SockException& err) {
-            onceToken token(nullptr, [&]() {
-                auto strong_self = weak_self.lock();
-                if (!strong_self) {
-                    return ;
-                }
-                // 延时关闭会话，防止频繁快速重建对象
-                strong_self->poller_->doDelayTask(kUdpDelayCloseMs, [weak_self, id]() {
-                    if (auto strong_self = weak_self.lock()) {
-                        std::lock_guard<decltype(*strong_self->session_mutex_)>
-                            lock(*strong_self->session_mutex_);
-                        strong_self->session_map_->erase(id);
+            socket->setOnErr([weak_self, weak_helper, id](const SockException& err) {
+                onceToken token(nullptr, [&]() {
+                    auto strong_self = weak_self.lock();
+                    if (!strong_self) {
+                        return ;
                     }
-                    return 0;
+                    // 延时关闭会话，防止频繁快速重建对象
+                    strong_self->poller_->doDelayTask(kUdpDelayCloseMs, [weak_self, id]() {
+                        if (auto strong_self = weak_self.lock()) {
+                            strong_self->session_table_->erase(id);
+                        }
+                        return 0;
+                    });
                 });
-            });
 
-            if (auto strong_helper = weak_helper.lock()) {
-                TraceP(strong_helper->session()) << strong_helper->className() << "on error: " << err;
-                strong_helper->enable = false;
-                strong_helper->session()->onErr(err);
-            }
+                if (auto strong_helper = weak_helper.lock()) {
+                    TraceP(strong_helper->session()) << strong_helper->className() << "on error: " << err;
+                    strong_helper->enable = false;
+                    strong_helper->session()->onErr(err);
+                }
+            });
+            return helper;
         });
-        auto pr = session_map_->emplace(id, std::move(helper));
-        assert(pr.second);
-        return pr.first->second;
     };
 
     if (socket->getPoller()->isCurrentThread()) {
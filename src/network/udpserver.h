@@ -1,16 +1,68 @@
 #ifndef _UDPSERVER_H_
 #define _UDPSERVER_H_
 
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "server.h"
 #include "session.h"
 #include "socket.h"
 
 namespace xkernel {
 
+// UDP对端地址, ipv4地址按映射后的ipv6地址保存, 两种形式的同一对端得到相同的id
+struct UdpPeerId {
+    uint8_t addr[16];
+    uint16_t port;  // 网络字节序
+
+    static UdpPeerId make(const struct sockaddr* addr);
+
+    bool operator==(const UdpPeerId& that) const {
+        return port == that.port && memcmp(addr, that.addr, sizeof(addr)) == 0;
+    }
+    bool operator!=(const UdpPeerId& that) const { return !(*this == that); }
+};
+
+struct UdpPeerIdHash {
+    size_t operator()(const UdpPeerId& id) const;
+};
+
+// UDP会话表, 按对端id的哈希分片, 每个分片一把锁, 不同分片的查找和插入互不阻塞
+class UdpSessionTable {
+public:
+    using Ptr = std::shared_ptr<UdpSessionTable>;
+    using Creator = std::function<SessionHelper::Ptr()>;
+
+    explicit UdpSessionTable(size_t shards);
+
+    SessionHelper::Ptr find(const UdpPeerId& id);
+    // 没有找到时在分片锁内调用creator创建, 保证同一对端只创建一次; creator返回nullptr时不插入
+    SessionHelper::Ptr findOrCreate(const UdpPeerId& id, const Creator& creator);
+    SessionHelper::Ptr erase(const UdpPeerId& id);  // 返回被移除的会话, 由调用者在锁外释放
+    std::vector<SessionHelper::Ptr> getAll();
+    void clear();
+    size_t size();
+
+private:
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        std::unordered_map<UdpPeerId, SessionHelper::Ptr, UdpPeerIdHash> map;
+    };
+
+    Shard& shard(const UdpPeerId& id);
+
+private:
+    size_t mask_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
 class UdpServer : public Server {
 public:
     using Ptr = std::shared_ptr<UdpServer>;
-    using PeerIdType = std::string;
+    using PeerIdType = UdpPeerId;
     using onCreateSocket = std::function<Socket::Ptr(
         const EventPoller::Ptr&, const Buffer::Ptr&, struct sockaddr*, int)>;
     
@@ -43,6 +95,10 @@ public:
 
     uint16_t getPort();
     void setOnCreateSocket(onCreateSocket cb);
+    // 多线程模式下每个poller绑定自己的SO_REUSEPORT监听socket, 新对端的首包由内核按4元组哈希分发,
+    // 会话创建在收包的poller上, 不再跨线程转发; cpu_steering为true时改为挂载cBPF程序按收包cpu选择poller,
+    // 配合poller的cpu亲和性使数据包在网卡队列所在的cpu上处理; 需要在start之前调用
+    void enableReusePort(bool enable = true, bool cpu_steering = false);
 
 protected:
     virtual Ptr onCreateServer(const EventPoller::Ptr& poller);
@@ -50,6 +106,7 @@ protected:
 
 private:
     void start_l(uint16_t port, const std::string& host = "::");
+    void bindReusePort(uint16_t port, const std::string& host);
     void onManagerSession();
     void onRead(Buffer::Ptr& buf, struct sockaddr* addr, int addr_len);
     void onRead_l(bool is_server_fd, const PeerIdType& id, Buffer::Ptr& buf,
@@ -65,11 +122,12 @@ private:
 private:
     bool cloned_ = false;
     bool multi_poller_ = false;
+    bool reuse_port_ = false;
+    bool cpu_steering_ = false;
     Socket::Ptr socket_;
     std::shared_ptr<Timer> timer_;
     onCreateSocket on_create_socket_;
-    std::shared_ptr<std::recursive_mutex> session_mutex_;
-    std::shared_ptr<std::unordered_map<PeerIdType, SessionHelper::Ptr>> session_map_;
+    UdpSessionTable::Ptr session_table_;  // 主server创建, 所有cloned server共享
     std::unordered_map<EventPoller*, Ptr> cloned_server_;
     std::function<SessionHelper::Ptr(
         const UdpServer::Ptr&, const Socket::Ptr&)> session_alloc_;
@@ -2,15 +2,18 @@
 
 #include <sys/epoll.h>
 #include <unistd.h>
+#include <chrono>
+#include <climits>
 #include <thread>
 
 #include "sockutil.h"
+#include "socket.h"
 #include "timeticker.h"
+#include "iouring.h"
 #include "uv_errno.h"
 #include "utility.h"
 #include "threadpool.h"
 // #include "taskexecutor.h"
-#include "pipe.h"
 #include "noticecenter.h"
 
 namespace xkernel {
@@ -21,7 +24,8 @@ inline uint32_t toEpoll(EventPoller::Poll_Event event) noexcept {
     return ((event_i & 1 << 0) ? EPOLLIN : 0) |
            ((event_i & 1 << 1) ? EPOLLOUT : 0) |
            ((event_i & 1 << 2) ? (EPOLLHUP | EPOLLERR) : 0) |
-           ((event_i & 1 << 3) ? 0 : EPOLLET);
+           ((event_i & 1 << 3) ? 0 : EPOLLET) |
+           ((event_i & 1 << 4) ? EPOLLEXCLUSIVE : 0);
 }
 
 inline EventPoller::Poll_Event toPoller(uint32_t epoll_event) noexcept {
@@ -35,6 +39,22 @@ inline EventPoller::Poll_Event toPoller(uint32_t epoll_event) noexcept {
 #define EPOLL_SIZE 1024
 #define create_event() epoll_create(EPOLL_SIZE)
 
+static constexpr size_t kTaskQueueSize = 8192;  // 无锁任务队列容量
+static constexpr size_t kTaskBatchSize = 64;  // 每批从任务队列中取出的任务数
+static constexpr size_t kMinEventSize = 64;  // epoll_wait批量大小的范围
+static constexpr size_t kMaxEventSize = EPOLL_SIZE * 8;
+static constexpr size_t kEventShrinkRounds = 128;  // 连续多少轮就绪事件不足1/4时减半
+
+static inline uint64_t makeEventData(int fd, uint32_t gen) {
+    return (static_cast<uint64_t>(gen) << 32) | static_cast<uint32_t>(fd);
+}
+
+static Wakeup::Type s_wakeup_type = Wakeup::Type::EventFd;
+static bool s_enable_io_uring = false;
+static std::atomic<uint64_t> s_busy_poll_usec{0};
+static std::atomic<int> s_sock_busy_poll_usec{0};
+static bool s_enable_recv_ring = false;
+
 //////////////////////////////// EventPoller /////////////////////////////////
 
 EventPoller& EventPoller::Instance() {
@@ -47,7 +67,7 @@ EventPoller::~EventPoller() {
         close(event_fd_);
         event_fd_ = -1;
     }
-    onPipeEvent(true);  // 退出前清理管道中的数据
+    while (flushTask()) {}  // 退出前执行完剩余的任务
     InfoL << getThreadName();
 }
 
@@ -59,12 +79,27 @@ int EventPoller::addEvent(int fd, Poll_Event event, PollEventCb cb) {
     }
     // 如果当前线程就是事件轮询器线程，则直接操作epoll实例
     if (isCurrentThread()) {
-        struct epoll_event ev = {0};
-        ev.events = toEpoll(event);
-        ev.data.fd = fd;
-        int ret = epoll_ctl(event_fd_, EPOLL_CTL_ADD, fd, &ev);
+        if (fd < 0) {
+            errno = EBADF;
+            return -1;
+        }
+        auto& slot = event_slots_.at(fd);
+        if (slot.cb) {
+            errno = EEXIST;
+            return -1;
+        }
+        int ret;
+        if (uring_) {
+            ret = uring_->addEvent(fd, toEpoll(event) & ~EPOLLEXCLUSIVE);  // io_uring的poll不支持
+        } else {
+            struct epoll_event ev = {0};
+            ev.events = toEpoll(event);
+            ev.data.u64 = makeEventData(fd, slot.gen + 1);
+            ret = epoll_ctl(event_fd_, EPOLL_CTL_ADD, fd, &ev);
+        }
         if (ret != -1) {
-            event_map_.emplace(fd, std::make_shared<PollEventCb>(std::move(cb)));
+            ++slot.gen;
+            slot.cb = std::make_unique<PollEventCb>(std::move(cb));
         }
         return ret;
     }
@@ -82,9 +117,14 @@ int EventPoller::delEvent(int fd, PollCompleteCb cb) {
     }
     if (isCurrentThread()) {
         int ret = -1;
-        if (event_map_.erase(fd)) {
-            event_cache_expired_.emplace(fd);
-            ret = epoll_ctl(event_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        if (uring_) {
+            uring_->cancelFd(fd);
+        }
+        auto slot = event_slots_.get(fd);
+        if (slot && slot->cb) {
+            ++slot->gen;  // 本轮已经取出的该fd的事件会因为gen不一致被丢弃
+            expired_cbs_.emplace_back(std::move(slot->cb));
+            ret = uring_ ? uring_->delEvent(fd) : epoll_ctl(event_fd_, EPOLL_CTL_DEL, fd, nullptr);
         }
         cb(ret != -1);
         return ret;
@@ -102,10 +142,16 @@ int EventPoller::modifyEvent(int fd, Poll_Event event, PollCompleteCb cb) {
     }
 
     if (isCurrentThread()) {
-        struct epoll_event ev = {0};
-        ev.events = toEpoll(event);
-        ev.data.fd = fd;
-        auto ret = epoll_ctl(event_fd_, EPOLL_CTL_MOD, fd, &ev);
+        int ret;
+        if (uring_) {
+            ret = uring_->modifyEvent(fd, toEpoll(event) & ~EPOLLEXCLUSIVE);
+        } else {
+            auto slot = event_slots_.get(fd);
+            struct epoll_event ev = {0};
+            ev.events = toEpoll(event) & ~EPOLLEXCLUSIVE;  // EPOLL_CTL_MOD不允许EPOLLEXCLUSIVE
+            ev.data.u64 = makeEventData(fd, slot ? slot->gen : 0);
+            ret = epoll_ctl(event_fd_, EPOLL_CTL_MOD, fd, &ev);
+        }
         cb(ret != -1);
         return ret;
     }
@@ -131,18 +177,33 @@ Task::Ptr EventPoller::async_l(TaskIn task, bool may_sync, bool first) {
     }
 
     auto ret = std::make_shared<Task>(std::move(task));
-    {
+    if (first) {
         std::lock_guard<decltype(mtx_task_)> lck(mtx_task_);
-        if (first) {
-            list_task_.emplace_front(ret);
-        } else {
-            list_task_.emplace_back(ret);
-        }
+        list_task_first_.emplace_front(ret);
+        task_first_.store(true, std::memory_order_relaxed);
+    } else if (task_overflow_.load(std::memory_order_acquire) || !task_queue_.tryPush(Task::Ptr(ret))) {
+        // 无锁队列已满, 或者溢出队列中还有任务未执行
+        std::lock_guard<decltype(mtx_task_)> lck(mtx_task_);
+        list_task_.emplace_back(ret);
+        task_overflow_.store(true, std::memory_order_relaxed);
     }
-    pipe_->write("", 1);
+    wakeUp();
     return ret;
 }
 
+void EventPoller::wakeUp() {
+    // 与runLoop中设置sleeping_后检查任务队列配对, 保证两边至少有一方能看到对方的写入
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed) && sleeping_.exchange(false)) {
+        wakeup_->notify();
+    }
+}
+
+bool EventPoller::hasPendingTask() const {
+    return !task_queue_.empty() || task_overflow_.load(std::memory_order_relaxed) ||
+           task_first_.load(std::memory_order_relaxed);
+}
+
 // 判断当前线程是否是eventpoller线程
 bool EventPoller::isCurrentThread() {
     return !loop_thread_ || loop_thread_->get_id() == std::this_thread::get_id();
@@ -152,7 +213,10 @@ EventPoller::DelayTask::Ptr EventPoller::doDelayTask(uint64_t delay_ms, std::fun
     DelayTask::Ptr ret = std::make_shared<DelayTask>(std::move(task));
     auto time_line = TimeUtil::getCurrentMillisecond() + delay_ms;
     asyncFirst([time_line, ret, this]() {
-        delay_task_map_.emplace(time_line, ret);
+        if (delay_task_wheel_.empty()) {
+            delay_task_wheel_.advance(TimeUtil::getCurrentMillisecond(), nullptr);  // 时间轮空闲时先同步到当前时间
+        }
+        delay_task_wheel_.add(ret, time_line);
     });
     return ret;
 }
@@ -161,11 +225,12 @@ static thread_local std::weak_ptr<EventPoller> s_current_poller;
 
 EventPoller::Ptr EventPoller::getCurrentPoller() { return s_current_poller.lock(); }
 
-SocketRecvBuffer::Ptr EventPoller::getSharedBuffer(bool is_udp) {
-    auto ret = shared_buffer_[is_udp].lock();
+SocketRecvBuffer::Ptr EventPoller::getSharedBuffer(bool is_udp, bool udp_gro) {
+    auto index = is_udp && udp_gro ? 2 : is_udp;
+    auto ret = shared_buffer_[index].lock();
     if (!ret) {
-        ret = SocketRecvBuffer::create(is_udp);
-        shared_buffer_[is_udp] = ret;
+        ret = SocketRecvBuffer::create(is_udp, recv_ring_, udp_gro);
+        shared_buffer_[index] = ret;
     }
     return ret;
 }
@@ -176,16 +241,90 @@ std::thread::id EventPoller::getThreadId() const {
 
 const std::string& EventPoller::getThreadName() const { return name_; }
 
-EventPoller::EventPoller(std::string name) {
-    event_fd_ = create_event();
-    if (event_fd_ == -1) {
-        throw std::runtime_error(StrPrinter << "Create event fd failed: " << get_uv_errmsg());
+Wakeup::Type EventPoller::getWakeupType() const { return wakeup_->type(); }
+
+bool EventPoller::useIoUring() const { return uring_ != nullptr; }
+
+void EventPoller::addDirtySocket(const std::shared_ptr<Socket>& sock) { dirty_socks_.emplace_back(sock); }
+
+void EventPoller::flushDirtySocket() {
+    if (dirty_socks_.empty()) {
+        return;
+    }
+    // 发送时的回调中再标记的socket留到下一轮
+    dirty_flushing_.swap(dirty_socks_);
+    for (auto& weak_sock : dirty_flushing_) {
+        auto sock = weak_sock.lock();
+        if (!sock) {
+            continue;
+        }
+        try {
+            sock->flushAll();
+        } catch (std::exception& ex) {
+            ErrorL << "Exception occurred when flush socket: " << ex.what();
+        }
+    }
+    dirty_flushing_.clear();
+}
+
+bool EventPoller::supportAsyncIo() const { return uring_ && uring_->supportAsyncIo(); }
+
+uint64_t EventPoller::addAccept(int fd, AcceptCb cb) {
+    assert(isCurrentThread());
+    return uring_ ? uring_->addAccept(fd, std::move(cb)) : 0;
+}
+
+uint64_t EventPoller::addRecv(int fd, RecvCb cb) {
+    assert(isCurrentThread());
+    return uring_ ? uring_->addRecv(fd, std::move(cb)) : 0;
+}
+
+uint64_t EventPoller::addSend(int fd, const struct msghdr* msg, bool link, SendCb cb) {
+    assert(isCurrentThread());
+    return uring_ ? uring_->addSend(fd, msg, link, std::move(cb)) : 0;
+}
+
+void EventPoller::cancelIo(uint64_t id) {
+    if (uring_) {
+        uring_->cancel(id);
+    }
+}
+
+void EventPoller::setBusyPoll(uint64_t usec) { busy_poll_usec_.store(usec, std::memory_order_relaxed); }
+
+uint64_t EventPoller::getBusyPoll() const { return busy_poll_usec_.load(std::memory_order_relaxed); }
+
+void EventPoller::setSockBusyPoll(int usec) { sock_busy_poll_usec_.store(usec, std::memory_order_relaxed); }
+
+int EventPoller::getSockBusyPoll() const { return sock_busy_poll_usec_.load(std::memory_order_relaxed); }
+
+bool EventPoller::useRecvRing() const { return recv_ring_; }
+
+EventPoller::EventPoller(std::string name) 
+    : task_queue_(kTaskQueueSize), delay_task_wheel_(TimeUtil::getCurrentMillisecond()) {
+    task_batch_.resize(kTaskBatchSize);
+    events_.resize(kMinEventSize);
+    busy_poll_usec_ = s_busy_poll_usec.load();
+    sock_busy_poll_usec_ = s_sock_busy_poll_usec.load();
+    recv_ring_ = s_enable_recv_ring;
+    if (s_enable_io_uring) {
+        try {
+            uring_ = std::make_unique<IoUringPoller>();
+        } catch (std::exception& ex) {
+            WarnL << ex.what() << ", fallback to epoll";
+        }
+    }
+    if (!uring_) {
+        event_fd_ = create_event();
+        if (event_fd_ == -1) {
+            throw std::runtime_error(StrPrinter << "Create event fd failed: " << get_uv_errmsg());
+        }
+        SockUtil::setCloExec(event_fd_);
     }
-    SockUtil::setCloExec(event_fd_);
     name_ = std::move(name);
     logger_ = Logger::Instance().shared_from_this();
-    pipe_ = std::make_unique<PipeWrap>();
-    addEventPipe();
+    wakeup_ = Wakeup::create(s_wakeup_type);
+    addWakeupEvent();
 }
 
 void EventPoller::runLoop(bool blocked, bool ref_self) {
@@ -197,36 +336,47 @@ void EventPoller::runLoop(bool blocked, bool ref_self) {
         exit_flag_ = false;
         uint64_t minDelay;
         
-        struct epoll_event events[EPOLL_SIZE];
+        // io_uring后端内部已经过滤了过期事件
+        IoUringPoller::onEvent on_event = [this](int fd, uint32_t events) {
+            auto slot = event_slots_.get(fd);
+            onEvent(fd, slot ? slot->gen : 0, events);
+        };
         while (!exit_flag_) {
             minDelay = getMinDelay();
-            startSleep();
-            int ret = epoll_wait(event_fd_, events, EPOLL_SIZE, minDelay ? minDelay : -1);
-            sleepWakeUp();
-            if (ret <= 0) {
-                continue;  // 超时或被打断
+            int timeout = minDelay ? static_cast<int>(std::min<uint64_t>(minDelay, INT_MAX)) : -1;
+            int ret = 0;
+            auto busy_poll = busy_poll_usec_.load(std::memory_order_relaxed);
+            if (busy_poll && timeout != 0 && !hasPendingTask() && dirty_socks_.empty()) {
+                ret = busyPoll(busy_poll, timeout);
             }
-
-            event_cache_expired_.clear();
-            for (int i = 0; i < ret; ++i) {
-                struct epoll_event& ev = events[i];
-                int fd = ev.data.fd;
-                if (event_cache_expired_.count(fd)) {
-                    continue;  // 事件缓存刷新
+            if (ret == 0) {
+                sleeping_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (hasPendingTask() || !dirty_socks_.empty()) {
+                    timeout = 0;  // 还有任务未执行或socket待发送, 只检查一下io事件, 不休眠
                 }
+                startSleep();
+                ret = uring_ ? uring_->wait(timeout) : epoll_wait(event_fd_, events_.data(), events_.size(), timeout);
+                sleepWakeUp();
+                sleeping_.store(false, std::memory_order_relaxed);
+            }
 
-                auto it = event_map_.find(fd);
-                if (it == event_map_.end()) {
-                    epoll_ctl(event_fd_, EPOLL_CTL_DEL, fd, nullptr);
-                    continue;
+            if (uring_) {
+                if (ret == -1) {
+                    ErrorL << "Wait io_uring failed: " << get_uv_errmsg();
                 }
-                auto cb = it->second;
-                try {
-                    (*cb)(toPoller(ev.events));
-                } catch (std::exception& ex) {
-                    ErrorL << "Exception occurred when do event task: " << ex.what();
+                addEvents(uring_->dispatch(on_event));
+            } else {
+                for (int i = 0; i < ret; ++i) {
+                    auto data = events_[i].data.u64;
+                    onEvent(static_cast<int>(data & 0xFFFFFFFF), static_cast<uint32_t>(data >> 32), events_[i].events);
                 }
+                adjustEventSize(ret);
+                addEvents(ret > 0 ? ret : 0);
             }
+            flushTask();
+            flushDirtySocket();  // 本轮的io事件和任务都处理完了, 每个socket合并发送一次
+            expired_cbs_.clear();
         }
     } else {
         loop_thread_ = new std::thread(&EventPoller::runLoop, this, true, ref_self);
@@ -234,6 +384,56 @@ void EventPoller::runLoop(bool blocked, bool ref_self) {
     }
 }
 
+int EventPoller::busyPoll(uint64_t usec, int timeout) {
+    if (timeout > 0) {
+        usec = std::min<uint64_t>(usec, timeout * 1000ULL);  // 不能错过定时任务
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::microseconds(usec);
+    int ret = 0;
+    while (true) {
+        if (uring_) {
+            ret = uring_->wait(0) == 0 && uring_->hasEvent() ? 1 : 0;
+        } else {
+            ret = epoll_wait(event_fd_, events_.data(), events_.size(), 0);
+        }
+        if (ret > 0 || hasPendingTask() || std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+    auto spin = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    addSpinTime(spin.count());
+    return ret < 0 ? 0 : ret;
+}
+
+inline void EventPoller::adjustEventSize(int ret) {
+    auto size = events_.size();
+    if (static_cast<size_t>(ret) == size && size < kMaxEventSize) {
+        events_.resize(size * 2);  // 缓存被填满, 说明还有事件没有取出
+        event_idle_ = 0;
+    } else if (static_cast<size_t>(ret) < size / 4 && size > kMinEventSize) {
+        if (++event_idle_ >= kEventShrinkRounds) {
+            events_.resize(size / 2);
+            events_.shrink_to_fit();
+            event_idle_ = 0;
+        }
+    } else {
+        event_idle_ = 0;
+    }
+}
+
+inline void EventPoller::onEvent(int fd, uint32_t gen, uint32_t events) {
+    auto slot = event_slots_.get(fd);
+    if (!slot || slot->gen != gen || !slot->cb) {
+        return;  // 事件已过期, fd在本轮中已被删除(或删除后又重新添加)
+    }
+    try {
+        (*slot->cb)(toPoller(events));
+    } catch (std::exception& ex) {
+        ErrorL << "Exception occurred when do event task: " << ex.what();
+    }
+}
+
 void EventPoller::shutdown() {
     async_l([]() { throw ExitException(); }, false, true);
     if (loop_thread_) {
@@ -247,31 +447,18 @@ void EventPoller::shutdown() {
     }
 }
 
-inline void EventPoller::onPipeEvent(bool flush) {
-    char buf[1024];
-    int err = 0;
-    if (!flush) {
-        while (true) {
-            if ((err = pipe_->read(buf, sizeof(buf))) > 0) {
-                continue;  // 直到把管道中的数据读空为止
-            }
-            if (err == 0 || get_uv_error(true) != UV_EAGAIN) {
-                ErrorL << "Invalid pipe fd of event poller, reopen it";
-                delEvent(pipe_->readFD());
-                pipe_->reOpen();
-                addEventPipe();
-            }
-            break;
-        }
-    }
-
-    decltype(list_task_) list_swap;
-    {
-        std::lock_guard<decltype(mtx_task_)> lck(mtx_task_);
-        list_swap.swap(list_task_);
+inline void EventPoller::onWakeupEvent() {
+    if (!wakeup_->drain()) {
+        ErrorL << "Invalid wakeup fd of event poller, reopen it";
+        delEvent(wakeup_->fd());
+        wakeup_->reOpen();
+        addWakeupEvent();
     }
+    // 唤醒事件只负责唤醒, 任务在每次轮询结束时统一执行
+}
 
-    list_swap.forEach([&](const Task::Ptr& task) {
+bool EventPoller::flushTask() {
+    auto run = [this](const Task::Ptr& task) {
         try {
             (*task)();
         } catch (ExitException&) {
@@ -279,53 +466,84 @@ inline void EventPoller::onPipeEvent(bool flush) {
         } catch (std::exception& ex) {
             ErrorL << "Exception occurred when do async task: " << ex.what();
         }
-    });
+    };
+
+    if (task_first_.load(std::memory_order_acquire)) {
+        decltype(list_task_first_) list_swap;
+        {
+            std::lock_guard<decltype(mtx_task_)> lck(mtx_task_);
+            list_swap.swap(list_task_first_);
+            task_first_.store(false, std::memory_order_relaxed);
+        }
+        list_swap.forEach(run);
+    }
+
+    // 单次最多执行一整个队列容量的任务, 避免生产者持续投递时饿死io事件
+    size_t budget = task_queue_.capacity();
+    while (budget) {
+        auto count = task_queue_.popBulk(task_batch_.begin(), std::min(budget, task_batch_.size()));
+        for (size_t i = 0; i < count; ++i) {
+            run(task_batch_[i]);
+            task_batch_[i] = nullptr;
+        }
+        if (count < task_batch_.size()) {
+            break;
+        }
+        budget -= count;
+    }
+    if (!task_queue_.empty()) {
+        return true;
+    }
+
+    // 无锁队列中的任务都先于溢出队列中的任务投递, 执行完之后才能执行溢出队列
+    if (task_overflow_.load(std::memory_order_acquire)) {
+        decltype(list_task_) list_swap;
+        {
+            std::lock_guard<decltype(mtx_task_)> lck(mtx_task_);
+            list_swap.swap(list_task_);
+            task_overflow_.store(false, std::memory_order_release);
+        }
+        list_swap.forEach(run);
+    }
+    return hasPendingTask();
 }
 
 uint64_t EventPoller::flushDelayTask(uint64_t now_time) {
-    decltype(delay_task_map_) task_copy;
-    task_copy.swap(delay_task_map_);
-    // 遍历取出所有已到期的任务, 因为是有序的，遍历到第一个未到期任务退出
-    for (auto it = task_copy.begin();
-        it != task_copy.end() && it->first <= now_time;
-        it = task_copy.erase(it)) {
+    // 推进时间轮，执行所有已到期的任务，需要重复执行的任务重新挂载
+    delay_task_wheel_.advance(now_time, [&](DelayTask::Ptr& task) {
         try {
-            auto next_delay = (*(it->second))();
+            auto next_delay = (*task)();
             if (next_delay) {
-                delay_task_map_.emplace(next_delay + now_time, std::move(it->second));
+                delay_task_wheel_.add(std::move(task), next_delay + now_time);
             }
         } catch (std::exception& ex) {
             ErrorL << "Exception occurred when do delay task: " << ex.what();
         }
-    }
+    });
 
-    task_copy.insert(delay_task_map_.begin(), delay_task_map_.end());
-    task_copy.swap(delay_task_map_);
-    auto it = delay_task_map_.begin();
-    if (it == delay_task_map_.end()) {
+    auto expire = delay_task_wheel_.nextExpire();
+    if (!expire) {
         return 0;
     }
-    return it->first - now_time;
+    return expire > now_time ? expire - now_time : 1;
 }
 
 uint64_t EventPoller::getMinDelay() {
-    auto it = delay_task_map_.begin();
-    if (it == delay_task_map_.end()) {
+    auto expire = delay_task_wheel_.nextExpire();
+    if (!expire) {
         return 0;
     }
     auto now = TimeUtil::getCurrentMillisecond();
-    if (it->first > now) {
-        return it->first - now;  // 所有任务尚未到期
+    if (expire > now) {
+        return expire - now;  // 所有任务尚未到期
     }
-    return flushDelayTask(now);  // 有任务到期，则遍历delay_task_map_执行所有到期任务
+    return flushDelayTask(now);  // 有任务到期，则推进时间轮执行所有到期任务
 }
 
-void EventPoller::addEventPipe() {
-    SockUtil::setNoBlocked(pipe_->readFD());
-    SockUtil::setNoBlocked(pipe_->writeFD());
-    if (addEvent(pipe_->readFD(), Poll_Event::Read_Event, 
-                [this](Poll_Event event) { onPipeEvent(false); }) == -1) {
-        throw std::runtime_error("Add pipe fd to poller failed");
+void EventPoller::addWakeupEvent() {
+    if (addEvent(wakeup_->fd(), Poll_Event::Read_Event, 
+                [this](Poll_Event event) { onWakeupEvent(); }) == -1) {
+        throw std::runtime_error("Add wakeup fd to poller failed");
     }
 }
 
@@ -333,6 +551,12 @@ void EventPoller::addEventPipe() {
 
 static size_t s_pool_size = 0;
 static bool s_enable_cpu_affinity = true;
+static std::atomic<EventPollerPool*> s_pool_instance{nullptr};  // 创建完所有poller后才设置
+
+// 对EventPollerPool中已经运行的所有poller执行设置
+static void forEachPoller(EventPollerPool& pool, const std::function<void(EventPoller&)>& cb) {
+    pool.forEach([&cb](const TaskExecutor::Ptr& executor) { cb(static_cast<EventPoller&>(*executor)); });
+}
 
 INSTANCE_IMP(EventPollerPool)
 
@@ -341,13 +565,37 @@ const std::string EventPollerPool::KOnStarted = "kBroadcastEventPollerPoolStarte
 EventPollerPool::EventPollerPool() {
     auto size = addPoller("event poller", s_pool_size, Thread_Priority::Highest, 
                           true, s_enable_cpu_affinity);
+    // 创建poller期间修改的参数可能没有被新poller读到, 设置实例后再应用一次
+    s_pool_instance = this;
+    forEachPoller(*this, [](EventPoller& poller) {
+        poller.setBusyPoll(s_busy_poll_usec);
+        poller.setSockBusyPoll(s_sock_busy_poll_usec);
+    });
     NOTICE_EMIT(EventPollerPoolOnStartedArgs, KOnStarted, *this, size);
     InfoL << "EventPoller created size: " << size;
 }
 
-// 在调用instance()方法之前调用这两个方法
+// 在调用instance()方法之前调用这些方法
 void EventPollerPool::setPoolSize(size_t size) { s_pool_size = size; }
 void EventPollerPool::enableCpuAffinity(bool enable) { s_enable_cpu_affinity = enable; } 
+void EventPollerPool::setWakeupType(Wakeup::Type type) { s_wakeup_type = type; }
+void EventPollerPool::enableIoUring(bool enable) { s_enable_io_uring = enable; }
+
+void EventPollerPool::setBusyPoll(uint64_t usec) {
+    s_busy_poll_usec = usec;
+    if (auto pool = s_pool_instance.load()) {
+        forEachPoller(*pool, [usec](EventPoller& poller) { poller.setBusyPoll(usec); });
+    }
+}
+
+void EventPollerPool::setSockBusyPoll(int usec) {
+    s_sock_busy_poll_usec = usec;
+    if (auto pool = s_pool_instance.load()) {
+        forEachPoller(*pool, [usec](EventPoller& poller) { poller.setSockBusyPoll(usec); });
+    }
+}
+
+void EventPollerPool::enableRecvRing(bool enable) { s_enable_recv_ring = enable; }
 
 EventPoller::Ptr EventPollerPool::getFirstPoller() {
     return std::static_pointer_cast<EventPoller>(threads_.front());
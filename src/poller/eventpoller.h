@@ -1,24 +1,30 @@
 #ifndef _EVENTPOLLER_H_
 #define _EVENTPOLLER_H_
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
-#include <unordered_map>
-#include <unordered_set>
-#include <map>
-#include <thread>
+#include <vector>
 
 #include "taskexecutor.h"
+#include "mpscqueue.h"
+#include "fdtable.h"
+#include "timingwheel.h"
+#include "wakeup.h"
 #include "buffersock.h"
 #include "utility.h"
 #include "logger.h"
 
+struct epoll_event;
+struct msghdr;
+
 namespace xkernel {
 
-class PipeWrap;
+class IoUringPoller;
+class Socket;
 
 class EventPoller : public TaskExecutor, 
                     public AnyStorage,
@@ -32,12 +38,16 @@ public:
         Write_Event = 1 << 1,
         Error_Event = 1 << 2,
         Event_LT = 1 << 3,
+        Exclusive_Event = 1 << 4,  // 只对addEvent有效(EPOLLEXCLUSIVE), 多个poller监听同一fd时每次只唤醒其中一个
     };
 
     using Ptr = std::shared_ptr<EventPoller>;
     using PollEventCb = std::function<void(Poll_Event event)>;
     using PollCompleteCb = std::function<void(bool success)>;
-    using DelayTask = TaskCancelableImpl<uint64_t(void)>;
+    using AcceptCb = std::function<void(int fd)>;  // fd小于0时为-errno
+    using RecvCb = std::function<void(const char* data, ssize_t len)>;  // len为0时对端关闭, 小于0时为-errno
+    using SendCb = std::function<void(ssize_t ret)>;  // ret为发送的字节数或-errno
+    using DelayTask = xkernel::DelayTask;
 
     static EventPoller& Instance(); 
     ~EventPoller();
@@ -53,37 +63,77 @@ public:
     bool isCurrentThread();  // 判断执行该接口的线程是否为本对象的轮询线程
     DelayTask::Ptr doDelayTask(uint64_t delay_ms, std::function<uint64_t()> task);
     static EventPoller::Ptr getCurrentPoller();  // 获取当前线程关联的Poller实例
-    SocketRecvBuffer::Ptr getSharedBuffer(bool is_udp);  // 获取当前线程下所有socket共享的读缓存
+    SocketRecvBuffer::Ptr getSharedBuffer(bool is_udp, bool udp_gro = false);  // 获取当前线程下所有socket共享的读缓存
     std::thread::id getThreadId() const;
     const std::string& getThreadName() const;
+    Wakeup::Type getWakeupType() const;
+    bool useIoUring() const;  // 是否使用io_uring作为事件轮询后端
+    bool supportAsyncIo() const;  // io_uring后端是否支持以下基于完成事件的异步io
+    // 异步io只能在poller线程调用, 返回请求id, 失败时返回0; 出错或被取消后请求结束, 不再回调; delEvent会取消fd上所有的异步io
+    uint64_t addAccept(int fd, AcceptCb cb);  // multishot accept, 新fd已设置为非阻塞和CLOEXEC
+    uint64_t addRecv(int fd, RecvCb cb);  // multishot recv, 数据在poller的缓冲区环中, 只在回调期间有效
+    uint64_t addSend(int fd, const struct msghdr* msg, bool link, SendCb cb);  // 发送完整个msg, link为true时与下一个发送串联
+    void cancelIo(uint64_t id);
+    void setBusyPoll(uint64_t usec);  // 设置忙轮询时长, 没有事件时先忙轮询usec微秒再休眠, 0为关闭
+    uint64_t getBusyPoll() const;
+    void setSockBusyPoll(int usec);  // 设置之后加入本poller的udp socket和tcp连接的SO_BUSY_POLL, 0为不设置
+    int getSockBusyPoll() const;
+    bool useRecvRing() const;  // TCP是否使用共享接收环, 会话收到的是接收环的切片
+    void addDirtySocket(const std::shared_ptr<Socket>& sock);  // 只能在poller线程调用, 本轮io事件和异步任务处理完后调用一次它的flushAll
 
 private:
     EventPoller(std::string name);
 
     void runLoop(bool blocked, bool ref_self);  // 执行事件轮询
     void shutdown();
-    void onPipeEvent(bool flush = false);  // 内部管道事件，用于唤醒轮询线程
+    int busyPoll(uint64_t usec, int timeout);  // 忙轮询直到有io事件或任务, 返回epoll就绪事件数
+    void adjustEventSize(int ret);  // 根据本轮就绪事件数调整下一轮epoll_wait的批量大小
+    void onEvent(int fd, uint32_t gen, uint32_t events);  // 分发fd的就绪事件, gen与注册时不一致的事件已过期
+    void onWakeupEvent();  // 内部唤醒事件，用于唤醒轮询线程
     Task::Ptr async_l(TaskIn task, bool may_sync = true, bool first = false);
+    void wakeUp();  // 轮询线程休眠时才触发唤醒事件
+    bool hasPendingTask() const;
+    bool flushTask();  // 批量执行异步任务, 返回是否还有未执行的任务
     uint64_t flushDelayTask(uint64_t now_time);
     uint64_t getMinDelay();
-    void addEventPipe();
+    void addWakeupEvent();
+    void flushDirtySocket();  // 发送本轮被标记的socket的发送缓存
 
 private:
     class ExitException : public std::exception {};
 
+    struct EventSlot {
+        uint32_t gen = 0;  // 每次添加或删除fd时递增, 和fd一起保存在epoll_event.data.u64中
+        std::unique_ptr<PollEventCb> cb;
+    };
+
     bool exit_flag_;  // 标记loop线程是否退出
     std::string name_;  // 线程名
-    std::weak_ptr<SocketRecvBuffer> shared_buffer_[2];  // 当前线程下，所有socket共享的读缓存
+    std::weak_ptr<SocketRecvBuffer> shared_buffer_[3];  // 当前线程下，所有socket共享的读缓存: TCP、UDP、开启GRO的UDP
     std::thread* loop_thread_ = nullptr;
     semaphore sem_run_started_;
-    std::unique_ptr<PipeWrap> pipe_;
+    Wakeup::Ptr wakeup_;  // 唤醒轮询线程, 默认使用eventfd
     std::mutex mtx_task_;
-    List<Task::Ptr> list_task_;  // 任务队列
+    List<Task::Ptr> list_task_;  // 无锁队列满时的溢出任务队列
+    List<Task::Ptr> list_task_first_;  // asyncFirst投递的优先任务
+    std::atomic<bool> task_overflow_{false};  // list_task_非空, 此时新任务也要进入溢出队列以保证顺序
+    std::atomic<bool> task_first_{false};  // list_task_first_非空
+    MpscQueue<Task::Ptr> task_queue_;  // 异步任务队列
+    std::vector<Task::Ptr> task_batch_;  // 批量取出任务的缓存
+    std::atomic<bool> sleeping_{false};  // 轮询线程是否即将或正在epoll_wait中休眠
     Logger::Ptr logger_;
     int event_fd_ = -1;  // epoll实例的fd
-    std::unordered_map<int, std::shared_ptr<PollEventCb>> event_map_;  // 事件回调映射, fd, cb
-    std::unordered_set<int> event_cache_expired_;  // 已过期事件的缓存
-    std::multimap<uint64_t, DelayTask::Ptr> delay_task_map_;  // 定时任务映射 
+    std::vector<struct epoll_event> events_;  // epoll_wait的事件缓存, 大小随负载调整
+    size_t event_idle_ = 0;  // 就绪事件数连续偏少的轮数
+    std::atomic<uint64_t> busy_poll_usec_{0};
+    std::atomic<int> sock_busy_poll_usec_{0};  // socket在网卡驱动队列上忙轮询的时长
+    bool recv_ring_ = false;
+    std::unique_ptr<IoUringPoller> uring_;  // 不为空时使用io_uring代替epoll
+    FdTable<EventSlot> event_slots_;  // 事件回调, 以fd为下标
+    std::vector<std::unique_ptr<PollEventCb>> expired_cbs_;  // 已删除的回调可能正在执行, 本轮事件分发结束后再释放
+    std::vector<std::weak_ptr<Socket>> dirty_socks_;  // 本轮循环中写入了数据、等待在循环最后发送的socket
+    std::vector<std::weak_ptr<Socket>> dirty_flushing_;  // 正在发送的dirty_socks_, 交换使用以复用内存
+    TimingWheel delay_task_wheel_;  // 定时任务时间轮
 };
 
 
@@ -117,9 +167,14 @@ public:
     static EventPollerPool& Instance();
     static void setPoolSize(size_t size = 0);  // 必须在创建EventPollerPool实例之前调用才有效
     static void enableCpuAffinity(bool enable);
+    static void setWakeupType(Wakeup::Type type);  // 必须在创建EventPoller之前调用才有效
+    static void enableIoUring(bool enable);  // 必须在创建EventPoller之前调用才有效, 内核不支持时退回epoll
+    static void setBusyPoll(uint64_t usec);  // 设置之后创建的EventPoller的默认值, 并修改EventPollerPool中已经运行的所有poller
+    static void setSockBusyPoll(int usec);  // 同上, 设置socket的SO_BUSY_POLL, 只影响之后创建的socket
+    static void enableRecvRing(bool enable);  // 必须在创建EventPoller之前调用才有效
 
     EventPoller::Ptr getFirstPoller();
-    EventPoller::Ptr getPoller(bool prefer_current_thread = true);  // 根据负载情况选择Poller
+    EventPoller::Ptr getPoller(bool prefer_current_thread = true);  // 按setSelectPolicy设置的策略选择Poller
     void preferCurrentThread(bool flag = true);  // 设置getPoller()是否优先返回当前线程
 
 private:
@@ -0,0 +1,55 @@
+/*
+ * 以fd为下标的分页表
+ *
+ * fd由内核从小到大分配, 比较稠密, 用数组下标代替哈希查找
+ * 按页(1024个元素)按需分配, 已分配的页不会移动, 返回的指针在表析构前一直有效
+ * 只能在所属的poller线程中访问
+ */
+#ifndef _FDTABLE_H_
+#define _FDTABLE_H_
+
+#include <memory>
+#include <vector>
+
+#include "utility.h"
+
+namespace xkernel {
+
+template <typename T>
+class FdTable : public Noncopyable {
+public:
+    FdTable() = default;
+    ~FdTable() = default;
+
+public:
+    // 查找fd对应的元素, 所在页未分配时返回nullptr
+    T* get(int fd) {
+        size_t page = static_cast<size_t>(fd) >> kPageBits;
+        if (fd < 0 || page >= pages_.size() || !pages_[page]) {
+            return nullptr;
+        }
+        return &pages_[page][fd & kPageMask];
+    }
+
+    // 获取fd对应的元素, 所在页未分配时先分配, fd必须非负
+    T& at(int fd) {
+        size_t page = static_cast<size_t>(fd) >> kPageBits;
+        if (page >= pages_.size()) {
+            pages_.resize(page + 1);
+        }
+        if (!pages_[page]) {
+            pages_[page].reset(new T[kPageSize]);
+        }
+        return pages_[page][fd & kPageMask];
+    }
+
+private:
+    static constexpr size_t kPageBits = 10;
+    static constexpr size_t kPageSize = 1 << kPageBits;
+    static constexpr size_t kPageMask = kPageSize - 1;
+
+    std::vector<std::unique_ptr<T[]>> pages_;
+};
+
+}  // namespace xkernel
+#endif  // _FDTABLE_H_
@@ -0,0 +1,484 @@
+#include "iouring.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "logger.h"
+#include "uv_errno.h"
+
+namespace xkernel {
+
+static constexpr uint64_t kIgnoreData = UINT64_MAX;  // POLL_REMOVE等内部请求的user_data, 完成事件直接忽略
+static constexpr uint64_t kOpFlag = 1ULL << 63;  // 异步io请求的user_data, 低位为请求id; poll的gen不使用最高位
+static constexpr unsigned kBufCount = 128;  // 缓冲区环的大小, 必须是2的幂
+static constexpr unsigned kBufSize = 16 * 1024;
+static constexpr uint16_t kBufGroup = 0;
+
+static inline uint64_t makeUserData(int fd, uint32_t gen) {
+    return (static_cast<uint64_t>(gen) << 32) | static_cast<uint32_t>(fd);
+}
+
+template <typename T>
+static inline T* ringPtr(void* ring, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+IoUringPoller::IoUringPoller(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;  // 完成队列需要同时容纳poll事件和内部请求的完成事件
+    ring_fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring_fd_ == -1) {
+        throw std::runtime_error(StrPrinter << "Create io_uring failed: " << get_uv_errmsg());
+    }
+    // EXT_ARG(5.11)用于带超时的等待, RSRC_TAGS(5.13)与multishot poll同一版本引入
+    auto required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+    if ((params.features & required) != required) {
+        close(ring_fd_);
+        throw std::runtime_error("io_uring of this kernel is too old");
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);  // SINGLE_MMAP, 两个环共用一块映射
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sq_ring_ == MAP_FAILED || sqes == MAP_FAILED) {
+        auto err = get_uv_errmsg();
+        sq_ring_ = sq_ring_ == MAP_FAILED ? nullptr : sq_ring_;
+        sqes_ = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+        unmap();
+        close(ring_fd_);
+        throw std::runtime_error(StrPrinter << "Mmap io_uring failed: " << err);
+    }
+    cq_ring_ = sq_ring_;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sq_head_ = ringPtr<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = ringPtr<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_array_ = ringPtr<unsigned>(sq_ring_, params.sq_off.array);
+    sq_mask_ = *ringPtr<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    cq_head_ = ringPtr<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = ringPtr<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *ringPtr<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = ringPtr<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+    // 提交队列的索引数组和sqe一一对应, 初始化一次即可
+    for (unsigned i = 0; i < sq_entries_; ++i) {
+        sq_array_[i] = i;
+    }
+    setupBufRing();
+}
+
+// multishot recv(6.0)是异步io依赖的最新特性, 缓冲区环(5.19)和multishot accept(5.19)都早于它
+static bool kernelAtLeast(int major, int minor) {
+    struct utsname name;
+    int cur_major = 0, cur_minor = 0;
+    if (uname(&name) == -1 || sscanf(name.release, "%d.%d", &cur_major, &cur_minor) != 2) {
+        return false;
+    }
+    return cur_major > major || (cur_major == major && cur_minor >= minor);
+}
+
+// C++中__DECLARE_FLEX_ARRAY的空结构体占1字节, bufs成员的偏移与内核不一致, 直接从环的起始地址访问
+static inline io_uring_buf* ringBufs(io_uring_buf_ring* ring) {
+    return reinterpret_cast<io_uring_buf*>(ring);
+}
+
+void IoUringPoller::setupBufRing() {
+#ifdef IORING_RECV_MULTISHOT
+    if (!kernelAtLeast(6, 0)) {
+        return;
+    }
+    buf_ring_size_ = kBufCount * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return;
+    }
+    memset(ring, 0, buf_ring_size_);  // 注册前先写入, 否则内核固定的可能是共享的零页, 之后的写入会被写时复制到新页
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = kBufCount;
+    reg.bgid = kBufGroup;
+    if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        WarnL << "Register io_uring buffer ring failed: " << get_uv_errmsg();
+        munmap(ring, buf_ring_size_);
+        return;
+    }
+    buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+    bufs_.resize(kBufCount * kBufSize);
+    for (unsigned i = 0; i < kBufCount; ++i) {
+        auto& buf = ringBufs(buf_ring_)[i];
+        buf.addr = reinterpret_cast<uint64_t>(&bufs_[i * kBufSize]);
+        buf.len = kBufSize;
+        buf.bid = i;
+    }
+    buf_tail_ = kBufCount;
+    __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+    async_io_ = true;
+#endif
+}
+
+IoUringPoller::~IoUringPoller() {
+    unmap();
+    if (ring_fd_ != -1) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+}
+
+void IoUringPoller::unmap() {
+    if (buf_ring_) {
+        munmap(buf_ring_, buf_ring_size_);
+        buf_ring_ = nullptr;
+    }
+    if (sq_ring_) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = cq_ring_ = nullptr;
+    }
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+}
+
+int IoUringPoller::addEvent(int fd, uint32_t events) {
+    // poll请求的错误要在完成事件中才能拿到, 这里先检查fd是否有效, 与epoll_ctl的行为保持一致
+    if (fcntl(fd, F_GETFD) == -1 || polls_.count(fd)) {
+        errno = polls_.count(fd) ? EEXIST : EBADF;
+        return -1;
+    }
+    auto& poll = polls_[fd];
+    poll.events = events;
+    if (armPoll(fd, poll) == -1) {
+        polls_.erase(fd);
+        return -1;
+    }
+    return 0;
+}
+
+int IoUringPoller::modifyEvent(int fd, uint32_t events) {
+    auto it = polls_.find(fd);
+    if (it == polls_.end()) {
+        errno = ENOENT;
+        return -1;
+    }
+    removePoll(fd, it->second);
+    it->second.events = events;
+    if (armPoll(fd, it->second) == -1) {
+        polls_.erase(it);  // 旧的poll已经移除, 与epoll不同, 失败后需要重新添加
+        return -1;
+    }
+    return 0;
+}
+
+int IoUringPoller::delEvent(int fd) {
+    auto it = polls_.find(fd);
+    if (it == polls_.end()) {
+        errno = ENOENT;
+        return -1;
+    }
+    removePoll(fd, it->second);
+    polls_.erase(it);
+    return 0;
+}
+
+int IoUringPoller::wait(int timeout_ms) {
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    // 完成队列中已经有事件时不需要等待
+    unsigned min_complete = (hasEvent() || timeout_ms == 0) ? 0 : 1;
+    if (enter(min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) == -1) {
+        if (errno != ETIME && errno != EINTR && errno != EBUSY) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int IoUringPoller::dispatch(const onEvent& cb) {
+    int count = 0;
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        auto& cqe = cqes_[head & cq_mask_];
+        auto user_data = cqe.user_data;
+        int res = cqe.res;
+        uint32_t flags = cqe.flags;
+        bool more = flags & IORING_CQE_F_MORE;
+        // 先释放该cqe, 回调中可能会提交新的请求
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        if (user_data == kIgnoreData) {
+            continue;
+        }
+        if (user_data & kOpFlag) {
+            ++count;
+            onOpEvent(user_data & ~kOpFlag, res, flags);
+            continue;
+        }
+        int fd = static_cast<int>(user_data & 0xFFFFFFFF);
+        uint32_t gen = static_cast<uint32_t>(user_data >> 32);
+        auto it = polls_.find(fd);
+        if (it == polls_.end() || it->second.gen != gen || res == -ECANCELED) {
+            continue;  // fd已被删除或修改
+        }
+
+        ++count;
+        cb(fd, res < 0 ? EPOLLERR : static_cast<uint32_t>(res));
+
+        // 单次poll或者multishot被内核终止时, 需要重新提交
+        it = polls_.find(fd);
+        if (!more && it != polls_.end() && it->second.gen == gen) {
+            armPoll(fd, it->second);
+        }
+    }
+    return count;
+}
+
+bool IoUringPoller::hasEvent() const {
+    return *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+}
+
+io_uring_sqe* IoUringPoller::getSqe() {
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+        // 提交队列已满, 先提交一批; 内核一个都没有取走时不能覆盖未提交的sqe
+        if (enter(0, 0, nullptr, 0) == -1 || tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+            WarnL << "Submit io_uring requests failed: " << get_uv_errmsg();
+            errno = EBUSY;
+            return nullptr;
+        }
+    }
+    auto sqe = &sqes_[tail & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+int IoUringPoller::armPoll(int fd, Poll& poll) {
+    gen_ = (gen_ + 1) & ~(1U << 31);
+    poll.gen = gen_;
+    auto sqe = getSqe();
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll.events;
+    if (poll.events & EPOLLET) {
+        sqe->len = IORING_POLL_ADD_MULTI;  // 水平触发时内核会自动加上EPOLLONESHOT
+    }
+    sqe->user_data = makeUserData(fd, poll.gen);
+    return 0;
+}
+
+void IoUringPoller::removePoll(int fd, const Poll& poll) {
+    auto sqe = getSqe();
+    if (!sqe) {
+        return;  // 旧的poll仍在内核中, 它的事件会因为gen不一致被丢弃
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, poll.gen);
+    sqe->user_data = kIgnoreData;
+}
+
+bool IoUringPoller::supportAsyncIo() const { return async_io_; }
+
+uint64_t IoUringPoller::addAccept(int fd, onAccept cb) {
+    Op op;
+    op.type = OpType::Accept;
+    op.fd = fd;
+    op.accept_cb = std::move(cb);
+    return addOp(std::move(op));
+}
+
+uint64_t IoUringPoller::addRecv(int fd, onRecv cb) {
+    Op op;
+    op.type = OpType::Recv;
+    op.fd = fd;
+    op.recv_cb = std::move(cb);
+    return addOp(std::move(op));
+}
+
+uint64_t IoUringPoller::addSend(int fd, const struct msghdr* msg, bool link, onSend cb) {
+    Op op;
+    op.type = OpType::Send;
+    op.fd = fd;
+    op.msg = msg;
+    op.link = link;
+    op.send_cb = std::move(cb);
+    return addOp(std::move(op));
+}
+
+void IoUringPoller::cancel(uint64_t id) {
+    auto it = ops_.find(id);
+    if (it == ops_.end() || it->second.cancelled) {
+        return;
+    }
+    // 请求在最后一个完成事件到达后才删除, 在此之前其引用的内存和缓冲区仍可能被内核使用
+    it->second.cancelled = true;
+    auto sqe = getSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = kOpFlag | id;
+    sqe->user_data = kIgnoreData;
+}
+
+void IoUringPoller::cancelFd(int fd) {
+    auto it = fd_ops_.find(fd);
+    if (it == fd_ops_.end()) {
+        return;
+    }
+    for (auto id : it->second) {
+        cancel(id);
+    }
+}
+
+uint64_t IoUringPoller::addOp(Op op) {
+    if (!async_io_) {
+        errno = ENOTSUP;
+        return 0;
+    }
+    auto id = ++op_id_;
+    if (!armOp(id, op)) {
+        return 0;
+    }
+    fd_ops_[op.fd].emplace_back(id);
+    ops_.emplace(id, std::move(op));
+    return id;
+}
+
+bool IoUringPoller::armOp(uint64_t id, const Op& op) {
+#ifdef IORING_RECV_MULTISHOT
+    auto sqe = getSqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->fd = op.fd;
+    sqe->user_data = kOpFlag | id;
+    switch (op.type) {
+        case OpType::Accept:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            break;
+        case OpType::Recv:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = kBufGroup;
+            break;
+        case OpType::Send:
+            // MSG_WAITALL时内核在socket缓冲区满后自动等待可写并继续发送, 只有出错时才会部分完成
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = reinterpret_cast<uint64_t>(op.msg);
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            sqe->flags = op.link ? IOSQE_IO_LINK : 0;
+            break;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IoUringPoller::onOpEvent(uint64_t id, int res, uint32_t flags) {
+    bool has_buf = flags & IORING_CQE_F_BUFFER;
+    uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    auto it = ops_.find(id);
+    if (it == ops_.end()) {
+        if (has_buf) {
+            recycleBuf(bid);
+        }
+        return;
+    }
+    // unordered_map插入新元素时不会移动已有元素, 回调中可以添加新的请求, op的引用保持有效; 删除只在这里进行
+    auto& op = it->second;
+    bool more = flags & IORING_CQE_F_MORE;
+    bool done = !more;
+    if (op.cancelled) {
+        if (op.type == OpType::Accept && res >= 0) {
+            close(res);  // 取消生效前已经接收的连接
+        }
+    } else {
+        switch (op.type) {
+            case OpType::Accept:
+                op.accept_cb(res);
+                break;
+            case OpType::Recv:
+                if (res > 0 && has_buf) {
+                    op.recv_cb(&bufs_[bid * kBufSize], res);
+                } else if (res != -ENOBUFS) {
+                    op.recv_cb(nullptr, res);  // 缓冲区暂时用完时不回调, 重新提交即可
+                }
+                break;
+            case OpType::Send:
+                op.send_cb(res);
+                break;
+        }
+    }
+    if (has_buf) {
+        recycleBuf(bid);
+    }
+    // multishot被内核终止(如缓冲区用完、完成队列溢出)时重新提交, 出错时结束
+    if (done && !op.cancelled && op.type != OpType::Send && (res >= 0 || res == -ENOBUFS) &&
+        !(op.type == OpType::Recv && res == 0)) {
+        done = !armOp(id, op);
+    }
+    if (!done) {
+        return;
+    }
+    auto fd_it = fd_ops_.find(op.fd);
+    if (fd_it != fd_ops_.end()) {
+        auto& ids = fd_it->second;
+        ids.erase(std::find(ids.begin(), ids.end(), id));
+        if (ids.empty()) {
+            fd_ops_.erase(fd_it);
+        }
+    }
+    ops_.erase(id);  // 回调中添加请求可能导致rehash, it已经失效
+}
+
+void IoUringPoller::recycleBuf(uint16_t bid) {
+    auto& buf = ringBufs(buf_ring_)[buf_tail_ & (kBufCount - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(&bufs_[bid * kBufSize]);
+    buf.len = kBufSize;
+    buf.bid = bid;
+    __atomic_store_n(&buf_ring_->tail, ++buf_tail_, __ATOMIC_RELEASE);
+}
+
+int IoUringPoller::enter(unsigned min_complete, unsigned flags, void* arg, size_t arg_size) {
+    unsigned to_submit = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, arg_size);
+    } while (ret == -1 && errno == EINTR && !(flags & IORING_ENTER_GETEVENTS));
+    return ret;
+}
+
+}  // namespace xkernel
@@ -0,0 +1,124 @@
+/*
+ * 基于io_uring的事件轮询后端
+ *
+ * 通过IORING_OP_POLL_ADD监听fd就绪事件, 对外提供和epoll相同的add/modify/del接口, 事件掩码使用epoll的定义
+ * 边沿触发的fd使用multishot poll, 只需要提交一次; 水平触发的fd使用单次poll, 每次回调后重新提交
+ * 所有的注册、修改、删除操作先写入提交队列, 在下一次wait时和等待事件合并为一次io_uring_enter系统调用
+ * 不依赖liburing, 直接使用系统调用, 内核不支持时构造函数抛出异常, 由EventPoller退回到epoll
+ *
+ * 除就绪事件外还提供基于完成事件的异步io(内核6.0及以上, supportAsyncIo()):
+ * multishot accept: 一次提交持续接收新连接, 完成事件中直接带有新fd
+ * multishot recv: 一次提交持续接收数据, 内核从注册的缓冲区环中取缓冲区, 回调结束后归还
+ * sendmsg: 使用MSG_WAITALL由内核发完整个消息, 同一fd的多次发送用IOSQE_IO_LINK串联保证顺序
+ * 这些请求同样在下一次wait时批量提交, 一轮事件循环只需要一次io_uring_enter
+ * 只能在所属的poller线程中访问
+ */
+#ifndef _IOURING_H_
+#define _IOURING_H_
+
+#include <sys/types.h>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "utility.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+struct msghdr;
+
+namespace xkernel {
+
+class IoUringPoller : public Noncopyable {
+public:
+    using onEvent = std::function<void(int fd, uint32_t events)>;
+    using onAccept = std::function<void(int fd)>;  // fd小于0时为-errno
+    using onRecv = std::function<void(const char* data, ssize_t len)>;  // len为0时对端关闭, 小于0时为-errno
+    using onSend = std::function<void(ssize_t ret)>;  // ret为发送的字节数或-errno
+
+    explicit IoUringPoller(unsigned entries = 1024);
+    ~IoUringPoller();
+
+public:
+    int addEvent(int fd, uint32_t events);  // events为epoll事件掩码, 包含EPOLLET时使用multishot poll
+    int modifyEvent(int fd, uint32_t events);
+    int delEvent(int fd);
+    int wait(int timeout_ms);  // 提交所有待提交的请求并等待事件, 返回-1表示出错
+    int dispatch(const onEvent& cb);  // 分发完成队列中的事件, 返回分发的事件个数
+    bool hasEvent() const;  // 完成队列中是否有事件
+
+    bool supportAsyncIo() const;  // 是否支持multishot accept/recv和缓冲区环
+    // 以下异步io返回请求id, 失败时返回0; 出错或被取消后请求自动结束, 不再回调
+    uint64_t addAccept(int fd, onAccept cb);  // 新fd已设置为非阻塞和CLOEXEC
+    uint64_t addRecv(int fd, onRecv cb);  // data只在回调期间有效
+    // msg及其指向的内存在回调之前必须保持有效; link为true时与同一批中下一个发送串联, 前一个失败时后续的以-ECANCELED结束
+    uint64_t addSend(int fd, const struct msghdr* msg, bool link, onSend cb);
+    void cancel(uint64_t id);
+    void cancelFd(int fd);  // 取消fd上所有的异步io
+
+private:
+    struct Poll {
+        uint32_t events;
+        uint32_t gen;  // 每次提交poll时递增, 用于过滤已删除或已修改的fd的旧事件
+    };
+
+    enum class OpType { Accept, Recv, Send };
+
+    struct Op {
+        OpType type;
+        int fd;
+        const struct msghdr* msg = nullptr;
+        bool link = false;
+        bool cancelled = false;  // 已提交取消, 等待最后一个完成事件
+        onAccept accept_cb;
+        onRecv recv_cb;
+        onSend send_cb;
+    };
+
+    io_uring_sqe* getSqe();  // 提交队列已满且提交失败时返回nullptr
+    int armPoll(int fd, Poll& poll);
+    void removePoll(int fd, const Poll& poll);
+    uint64_t addOp(Op op);
+    bool armOp(uint64_t id, const Op& op);
+    void onOpEvent(uint64_t id, int res, uint32_t flags);
+    void setupBufRing();
+    void recycleBuf(uint16_t bid);
+    int enter(unsigned min_complete, unsigned flags, void* arg, size_t arg_size);
+    void unmap();
+
+private:
+    int ring_fd_ = -1;
+    uint32_t gen_ = 0;
+    std::unordered_map<int, Poll> polls_;  // 已注册的fd
+    uint64_t op_id_ = 0;
+    std::unordered_map<uint64_t, Op> ops_;  // 进行中的异步io
+    std::unordered_map<int, std::vector<uint64_t>> fd_ops_;  // fd上进行中的异步io
+
+    io_uring_buf_ring* buf_ring_ = nullptr;  // multishot recv使用的缓冲区环
+    size_t buf_ring_size_ = 0;
+    uint16_t buf_tail_ = 0;
+    std::vector<char> bufs_;
+    bool async_io_ = false;
+
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+
+}  // namespace xkernel
+#endif  // _IOURING_H_
@@ -0,0 +1,190 @@
+#include "timingwheel.h"
+
+#include <algorithm>
+
+namespace xkernel {
+
+// 第level层(level >= 1)槽位索引在时间戳中的起始位
+static constexpr size_t levelShift(size_t level) { return 8 + (level - 1) * 6; }
+
+// 在root位图的[from, 256)范围内查找第一个非空槽位, 找不到返回256
+static size_t nextRootBit(const uint64_t* bitmap, size_t from) {
+    for (size_t word = from / 64; word < 4; ++word) {
+        uint64_t bits = bitmap[word];
+        if (word == from / 64) {
+            bits &= ~0ULL << (from % 64);
+        }
+        if (bits) {
+            return word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return 256;
+}
+
+TimingWheel::TimingWheel(uint64_t now_ms) : current_(now_ms) {}
+
+TimingWheel::~TimingWheel() {
+    for (auto& slot : root_) {
+        release(detach(slot));
+    }
+    for (auto& level : levels_) {
+        for (auto& slot : level) {
+            release(detach(slot));
+        }
+    }
+}
+
+void TimingWheel::add(DelayTask::Ptr task, uint64_t expire_ms) {
+    auto ptr = task.get();
+    ptr->expire_ = expire_ms;
+    ptr->self_ = std::move(task);
+    link(ptr);
+    ++size_;
+}
+
+void TimingWheel::advance(uint64_t now_ms, const onExpired& cb) {
+    if (!size_) {
+        current_ = std::max(current_, now_ms + 1);  // 没有任务时直接拨到当前时间, 避免之后逐槽追赶
+        return;
+    }
+    while (current_ <= now_ms) {
+        size_t index = current_ & (kRootSize - 1);
+        if (index == 0) {
+            // 第0层转完一圈, 逐层把高层当前槽位的任务降级
+            for (size_t level = 1; level < kLevels && cascade(level) == 0; ++level)
+                ;
+        }
+        // 先推进时间再执行任务, 执行过程中新增的已到期任务会落到下一个槽位
+        auto head = detach(root_[index]);
+        ++current_;
+        while (head) {
+            auto task = head;
+            head = head->next_;
+            task->prev_ = task->next_ = nullptr;
+            auto ptr = std::move(task->self_);
+            --size_;
+            if (!ptr->canceled()) {
+                cb(ptr);
+            }
+        }
+
+        // 跳过空槽位, 最远跳到第0层下一圈的起点(需要降级高层任务)
+        index = current_ & (kRootSize - 1);
+        if (index) {
+            auto next = nextRootBit(root_bitmap_, index);
+            current_ = std::min(current_ - index + next, now_ms + 1);
+        }
+    }
+}
+
+uint64_t TimingWheel::nextExpire() const {
+    if (!size_) {
+        return 0;
+    }
+    uint64_t ret = UINT64_MAX;
+    size_t index = current_ & (kRootSize - 1);
+    uint64_t base = current_ - index;
+    auto next = nextRootBit(root_bitmap_, index);
+    if (next < kRootSize) {
+        ret = base + next;  // 第0层槽位的到期时间是精确的
+    } else if ((next = nextRootBit(root_bitmap_, 0)) < kRootSize) {
+        ret = base + kRootSize + next;  // 下一圈才到期的任务
+    }
+
+    for (size_t level = 1; level < kLevels; ++level) {
+        auto bitmap = level_bitmap_[level - 1];
+        if (!bitmap) {
+            continue;
+        }
+        auto shift = levelShift(level);
+        uint64_t block = current_ >> shift;
+        size_t pos = block & (kLevelSize - 1);
+        if ((current_ & ((1ULL << shift) - 1)) == 0 && (bitmap & (1ULL << pos))) {
+            return current_;  // 当前时间点就需要降级
+        }
+        // 从pos + 1开始循环查找, pos本身代表转完一圈后的槽位
+        auto rotated = (bitmap >> ((pos + 1) & (kLevelSize - 1))) |
+                       (bitmap << ((kLevelSize - pos - 1) & (kLevelSize - 1)));
+        uint64_t distance = __builtin_ctzll(rotated) + 1;
+        ret = std::min(ret, (block + distance) << shift);
+    }
+    return ret;
+}
+
+size_t TimingWheel::size() const { return size_; }
+
+bool TimingWheel::empty() const { return size_ == 0; }
+
+void TimingWheel::link(DelayTask* task) {
+    uint64_t expire = std::max(task->expire_, current_);
+    uint64_t delta = expire - current_;
+    Slot* slot;
+    if (delta < kRootSize) {
+        size_t index = expire & (kRootSize - 1);
+        root_bitmap_[index / 64] |= 1ULL << (index % 64);
+        slot = &root_[index];
+    } else {
+        size_t level = 1;
+        while (level < kLevels - 1 && delta >= (1ULL << (levelShift(level) + kLevelBits))) {
+            ++level;
+        }
+        if (delta > UINT32_MAX) {
+            expire = current_ + UINT32_MAX;  // 超出时间轮范围, 先挂在最高层, 降级时会重新计算
+        }
+        size_t index = (expire >> levelShift(level)) & (kLevelSize - 1);
+        level_bitmap_[level - 1] |= 1ULL << index;
+        slot = &levels_[level - 1][index];
+    }
+
+    task->next_ = nullptr;
+    task->prev_ = slot->tail;
+    if (slot->tail) {
+        slot->tail->next_ = task;
+    } else {
+        slot->head = task;
+    }
+    slot->tail = task;
+}
+
+DelayTask* TimingWheel::detach(Slot& slot) {
+    auto head = slot.head;
+    slot.head = slot.tail = nullptr;
+    if (&slot >= root_ && &slot < root_ + kRootSize) {
+        size_t index = &slot - root_;
+        root_bitmap_[index / 64] &= ~(1ULL << (index % 64));
+    } else {
+        size_t offset = &slot - &levels_[0][0];
+        level_bitmap_[offset / kLevelSize] &= ~(1ULL << (offset % kLevelSize));
+    }
+    return head;
+}
+
+size_t TimingWheel::cascade(size_t level) {
+    size_t index = (current_ >> levelShift(level)) & (kLevelSize - 1);
+    auto head = detach(levels_[level - 1][index]);
+    while (head) {
+        auto task = head;
+        head = head->next_;
+        if (task->self_->canceled()) {
+            // 已取消的任务在降级时直接移除
+            task->prev_ = task->next_ = nullptr;
+            --size_;
+            task->self_ = nullptr;
+            continue;
+        }
+        link(task);
+    }
+    return index;
+}
+
+void TimingWheel::release(DelayTask* head) {
+    while (head) {
+        auto task = head;
+        head = head->next_;
+        task->prev_ = task->next_ = nullptr;
+        --size_;
+        task->self_ = nullptr;
+    }
+}
+
+}  // namespace xkernel
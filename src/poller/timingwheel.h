@@ -0,0 +1,86 @@
+/*
+ * 分层时间轮, 用于管理EventPoller的延时任务
+ *
+ * 共5层: 第0层256个槽位, 精度1ms; 第1~4层各64个槽位, 每层精度为上一层一圈的时长
+ * 可覆盖 2^32 ms(约49.7天)的延时, 更长的延时会被截断到最大值, 到期前重新挂载
+ * 插入/到期均为O(1), 任务节点内嵌在DelayTask中, 挂载时不需要额外分配内存
+ * 取消任务时只释放任务闭包, 节点在所在槽位到期或降级时被惰性移除
+ * 时间轮只能在所属的poller线程中访问
+ */
+#ifndef _TIMINGWHEEL_H_
+#define _TIMINGWHEEL_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "taskexecutor.h"
+#include "utility.h"
+
+namespace xkernel {
+
+class TimingWheel;
+
+// 延时任务, 返回值为下次执行的延时(ms), 返回0表示不再执行
+class DelayTask : public TaskCancelableImpl<uint64_t(void)> {
+public:
+    using Ptr = std::shared_ptr<DelayTask>;
+
+    template <typename FUNC>
+    DelayTask(FUNC&& task) : TaskCancelableImpl<uint64_t(void)>(std::forward<FUNC>(task)) {}
+    ~DelayTask() = default;
+
+public:
+    bool canceled() const { return weakTask_.expired(); }  // 任务是否已被取消(或执行完毕被释放)
+
+private:
+    friend class TimingWheel;
+
+    uint64_t expire_ = 0;  // 到期时间(ms)
+    DelayTask* prev_ = nullptr;
+    DelayTask* next_ = nullptr;
+    Ptr self_;  // 挂在时间轮上时持有自身的引用, 保证任务在到期前不会被释放
+};
+
+class TimingWheel : public Noncopyable {
+public:
+    using onExpired = std::function<void(DelayTask::Ptr& task)>;
+
+    explicit TimingWheel(uint64_t now_ms);
+    ~TimingWheel();
+
+public:
+    void add(DelayTask::Ptr task, uint64_t expire_ms);  // 挂载任务, 到期时间小于当前时间的任务会在下一次推进时立即到期
+    void advance(uint64_t now_ms, const onExpired& cb);  // 推进时间轮到now_ms, 对每个到期且未取消的任务执行回调
+    uint64_t nextExpire() const;  // 时间轮下次需要推进的时间点(到期或者降级), 为空时返回0
+    size_t size() const;  // 挂载的任务个数(包括已取消但尚未移除的任务)
+    bool empty() const;
+
+private:
+    struct Slot {
+        DelayTask* head = nullptr;
+        DelayTask* tail = nullptr;
+    };
+
+    void link(DelayTask* task);  // 根据到期时间把任务挂到对应层的槽位
+    DelayTask* detach(Slot& slot);  // 摘下整个槽位的链表
+    size_t cascade(size_t level);  // 将第level层当前槽位的任务重新分配到低层, 返回该层的槽位索引
+    void release(DelayTask* head);  // 释放链表上所有任务的引用
+
+private:
+    static constexpr size_t kLevels = 5;
+    static constexpr size_t kRootBits = 8;
+    static constexpr size_t kLevelBits = 6;
+    static constexpr size_t kRootSize = 1 << kRootBits;
+    static constexpr size_t kLevelSize = 1 << kLevelBits;
+
+    uint64_t current_;  // 时间轮当前指向的时间(ms), 小于current_的槽位都已处理
+    size_t size_ = 0;
+    Slot root_[kRootSize];  // 第0层槽位
+    Slot levels_[kLevels - 1][kLevelSize];  // 第1~4层槽位
+    uint64_t root_bitmap_[kRootSize / 64] = {0};  // 第0层非空槽位的位图, 用于跳过空槽位
+    uint64_t level_bitmap_[kLevels - 1] = {0};
+};
+
+}  // namespace xkernel
+#endif  // _TIMINGWHEEL_H_
@@ -0,0 +1,94 @@
+#include "wakeup.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdexcept>
+
+#include "pipe.h"
+#include "sockutil.h"
+#include "uv_errno.h"
+#include "logger.h"
+
+namespace xkernel {
+
+Wakeup::Ptr Wakeup::create(Type type) {
+    if (type == Type::EventFd) {
+        try {
+            return std::make_unique<EventFdWakeup>();
+        } catch (std::exception& ex) {
+            WarnL << ex.what() << ", fallback to pipe";
+        }
+    }
+    return std::make_unique<PipeWakeup>();
+}
+
+//////////////////////////////// EventFdWakeup ////////////////////////////////////
+
+EventFdWakeup::EventFdWakeup() { reOpen(); }
+
+EventFdWakeup::~EventFdWakeup() {
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+void EventFdWakeup::notify() {
+    uint64_t one = 1;
+    int ret;
+    do {
+        ret = ::write(fd_, &one, sizeof(one));
+    } while (-1 == ret && UV_EINTR == get_uv_error(true));
+    // 计数器溢出时返回EAGAIN, 此时已经处于可读状态, 不需要处理
+}
+
+bool EventFdWakeup::drain() {
+    uint64_t count;
+    int ret;
+    do {
+        ret = ::read(fd_, &count, sizeof(count));  // 一次读取即可清零计数器
+    } while (-1 == ret && UV_EINTR == get_uv_error(true));
+    return ret == sizeof(count) || get_uv_error(true) == UV_EAGAIN;
+}
+
+void EventFdWakeup::reOpen() {
+    if (fd_ != -1) {
+        close(fd_);
+    }
+    fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd_ == -1) {
+        throw std::runtime_error(StrPrinter << "Create eventfd failed: " << get_uv_errmsg());
+    }
+}
+
+//////////////////////////////// PipeWakeup ////////////////////////////////////
+
+PipeWakeup::PipeWakeup() : pipe_(std::make_unique<PipeWrap>()) { setNoBlocked(); }
+
+PipeWakeup::~PipeWakeup() = default;
+
+int PipeWakeup::fd() const { return pipe_->readFD(); }
+
+void PipeWakeup::notify() { pipe_->write("", 1); }
+
+bool PipeWakeup::drain() {
+    char buf[1024];
+    int err = 0;
+    while ((err = pipe_->read(buf, sizeof(buf))) > 0) {
+        // 直到把管道中的数据读空为止
+    }
+    return err != 0 && get_uv_error(true) == UV_EAGAIN;
+}
+
+void PipeWakeup::reOpen() {
+    pipe_->reOpen();
+    setNoBlocked();
+}
+
+void PipeWakeup::setNoBlocked() {
+    // PipeWrap默认写端阻塞, 唤醒时不能阻塞生产者线程
+    SockUtil::setNoBlocked(pipe_->readFD());
+    SockUtil::setNoBlocked(pipe_->writeFD());
+}
+
+}  // namespace xkernel
@@ -0,0 +1,72 @@
+/*
+ * 轮询线程的唤醒方式
+ *
+ * EventFdWakeup: 一个eventfd, 多次唤醒会合并到同一个8字节计数器中, linux下默认使用
+ * PipeWakeup: 基于PipeWrap, 每次唤醒写1字节, eventfd不可用时作为备选
+ */
+#ifndef _WAKEUP_H_
+#define _WAKEUP_H_
+
+#include <memory>
+
+namespace xkernel {
+
+class PipeWrap;
+
+class Wakeup {
+public:
+    using Ptr = std::unique_ptr<Wakeup>;
+
+    enum class Type {
+        EventFd = 0,
+        Pipe = 1,
+    };
+
+    static Ptr create(Type type);  // eventfd创建失败时退回到管道
+    virtual ~Wakeup() = default;
+
+public:
+    virtual Type type() const = 0;
+    virtual int fd() const = 0;  // 注册到epoll中监听可读事件的fd
+    virtual void notify() = 0;  // 可在任意线程调用
+    virtual bool drain() = 0;  // 读空所有唤醒信号, 返回false表示fd已失效
+    virtual void reOpen() = 0;
+};
+
+class EventFdWakeup : public Wakeup {
+public:
+    EventFdWakeup();
+    ~EventFdWakeup() override;
+
+public:
+    Type type() const override { return Type::EventFd; }
+    int fd() const override { return fd_; }
+    void notify() override;
+    bool drain() override;
+    void reOpen() override;
+
+private:
+    int fd_ = -1;
+};
+
+class PipeWakeup : public Wakeup {
+public:
+    PipeWakeup();
+    ~PipeWakeup() override;
+
+public:
+    Type type() const override { return Type::Pipe; }
+    int fd() const override;
+    void notify() override;
+    bool drain() override;
+    void reOpen() override;
+
+private:
+    void setNoBlocked();
+
+private:
+    std::unique_ptr<PipeWrap> pipe_;
+};
+
+}  // namespace xkernel
+#endif  // _WAKEUP_H_
@@ -0,0 +1,154 @@
+/*
+ * 有界无锁多生产者单消费者队列
+ *
+ * 基于环形数组, 每个槽位带一个序号, 生产者通过CAS抢占写位置, 写完后发布序号
+ * 消费者只有一个, 读位置不需要原子操作
+ * 队列满时tryPush返回false, 由调用者决定如何处理(如退回到加锁的溢出队列)
+ *
+ * MpscLinkedQueue为无界的链表版本, 生产者只做一次原子交换, 适合不能丢弃也不便退回加锁队列的场景
+ */
+#ifndef _MPSCQUEUE_H_
+#define _MPSCQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "utility.h"
+
+namespace xkernel {
+
+template <typename T>
+class MpscQueue : public Noncopyable {
+public:
+    // 容量会向上取整为2的幂
+    explicit MpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].seq_.store(i, std::memory_order_relaxed);
+        }
+    }
+    ~MpscQueue() = default;
+
+public:
+    // 可在任意线程调用
+    bool tryPush(T&& value) {
+        Cell* cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;  // 队列已满
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);  // 被其他生产者抢先
+            }
+        }
+        cell->value_ = std::move(value);
+        cell->seq_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 只能在消费者线程调用
+    bool tryPop(T& value) {
+        Cell& cell = cells_[head_ & mask_];
+        if (cell.seq_.load(std::memory_order_acquire) != head_ + 1) {
+            return false;  // 队列为空, 或者生产者还未写完
+        }
+        value = std::move(cell.value_);
+        cell.seq_.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+    // 批量取出最多max个元素, 返回实际取出的个数, 只能在消费者线程调用
+    template <typename OutputIt>
+    size_t popBulk(OutputIt out, size_t max) {
+        size_t count = 0;
+        while (count < max && tryPop(*out)) {
+            ++out;
+            ++count;
+        }
+        return count;
+    }
+
+    // 只能在消费者线程调用
+    bool empty() const {
+        return cells_[head_ & mask_].seq_.load(std::memory_order_acquire) != head_ + 1;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq_;
+        T value_;
+    };
+
+    size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> tail_{0};  // 生产者写位置
+    alignas(64) size_t head_ = 0;  // 消费者读位置
+};
+
+// 无界无锁多生产者单消费者队列(Vyukov)
+// 生产者交换head_后再链接到前一个节点, 链接完成前消费者看到的队列可能暂时不含该元素
+template <typename T>
+class MpscLinkedQueue : public Noncopyable {
+public:
+    MpscLinkedQueue() : head_(new Node), tail_(head_.load(std::memory_order_relaxed)) {}
+    ~MpscLinkedQueue() {
+        T value;
+        while (tryPop(value)) {
+        }
+        delete tail_;
+    }
+
+public:
+    // 可在任意线程调用
+    void push(T value) {
+        auto node = new Node;
+        node->value_ = std::move(value);
+        auto prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next_.store(node, std::memory_order_release);
+    }
+
+    // 只能在消费者线程调用
+    bool tryPop(T& value) {
+        auto next = tail_->next_.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        // 取出的节点成为新的哨兵
+        value = std::move(next->value_);
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+
+    // 只能在消费者线程调用
+    bool empty() const { return !tail_->next_.load(std::memory_order_acquire); }
+
+private:
+    struct Node {
+        std::atomic<Node*> next_{nullptr};
+        T value_;
+    };
+
+    alignas(64) std::atomic<Node*> head_;  // 生产者写入的最后一个节点
+    alignas(64) Node* tail_;  // 哨兵节点, 其后为第一个元素
+};
+
+}  // namespace xkernel
+#endif  // _MPSCQUEUE_H_
@@ -33,7 +33,7 @@ public:
  public:
   // 从队列头部取消息
   bool getMsg(Msg& message) {
-    std::unique_lock<std::mutex> lock(get_mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
     // 非阻塞模式下
     if (Msg_len_.load() == 0 && nonblock_) {
       return false;  // 没有消息则返回默认构造的Msg
@@ -53,7 +53,7 @@ public:
   }
 
   void putMsg(Msg message) {
-    std::unique_lock<std::mutex> lock(put_mutex_);  // 作用域结束自动释放
+    std::unique_lock<std::mutex> lock(mutex_);  // 作用域结束自动释放
     while (Msg_len_.load() > Msg_max_ && !nonblock_) {
       put_cond_.wait(lock);
     }
@@ -68,7 +68,7 @@ public:
 
   // 向队列头部插入消息
   void putMsgToHead(Msg message) {
-    std::unique_lock<decltype(put_mutex_)> lock(get_mutex_);  // 头插只需要和get操作互斥
+    std::unique_lock<std::mutex> lock(mutex_);  // 和putMsg、getMsg修改的是同一个deque, 必须使用同一把锁
     while (Msg_len_.load() > Msg_max_ && !nonblock_) {
       put_cond_.wait(lock);
     }
@@ -83,10 +83,10 @@ public:
   void setNonblock() { nonblock_ = true; }
   void setBlock() {
     nonblock_ = false;
-    put_mutex_.lock();
+    mutex_.lock();
     get_cond_.notify_one();
     put_cond_.notify_all();
-    put_mutex_.unlock();
+    mutex_.unlock();
   }
   size_t size() const{
     return Msg_len_.load();
@@ -97,9 +97,7 @@ public:
   std::atomic<size_t> Msg_len_;
   bool nonblock_;
   std::deque<Msg> msgs_;
-  std::mutex get_mutex_;
-  std::mutex put_mutex_;
-  std::mutex len_mutex_;  // 控制对Msg_len_互斥访问
+  std::mutex mutex_;  // 保护msgs_, 所有读写操作共用
   std::condition_variable get_cond_;
   std::condition_variable put_cond_;
 };
@@ -1,7 +1,9 @@
 #include "taskexecutor.h"
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include "timeticker.h"
 #include "utility.h"
 #include "eventpoller.h"
@@ -10,68 +12,89 @@
 namespace xkernel {
 ///////////////////////////// ThreadLoadCounter /////////////////////////////////
 
+static constexpr uint64_t kSleepSumBits = 31;
+static constexpr uint64_t kSleepSumMax = (1ULL << kSleepSumBits) - 1;
+static constexpr uint64_t kRunSumMax = (1ULL << 32) - 1;
+
 ThreadLoadCounter::ThreadLoadCounter(uint64_t max_size, uint64_t max_usec) 
-    : max_size_(max_size), max_usec_(max_usec) {
-    last_sleep_time_ = last_wake_time_ = TimeUtil::getCurrentMicrosecond();
+    : max_size_(max_size ? max_size : 1), max_usec_(max_usec), records_(max_size_) {
+    last_time_.store(TimeUtil::getCurrentMicrosecond(), std::memory_order_relaxed);
+    publish();
 }
 
 void ThreadLoadCounter::startSleep() {
-    std::lock_guard<decltype(mtx_)> lock(mtx_);
-    sleeping_ = true;
     auto current_time = TimeUtil::getCurrentMicrosecond();
-    auto run_time = current_time - last_wake_time_;
-    last_sleep_time_ = current_time;
-    time_list_.emplace_back(run_time, false);
-    if (time_list_.size() > max_size_) {
-        time_list_.pop_front();
-    }
+    auto last_time = last_time_.load(std::memory_order_relaxed);
+    sleeping_ = true;
+    last_time_.store(current_time, std::memory_order_relaxed);
+    addRecord(current_time > last_time ? current_time - last_time : 0, false);
 }
 
 void ThreadLoadCounter::sleepWakeUp() {
-    std::lock_guard<decltype(mtx_)> lock(mtx_);
-    sleeping_ = false;
     auto current_time = TimeUtil::getCurrentMicrosecond();
-    auto sleep_time = current_time - last_sleep_time_;
-    last_wake_time_ = current_time;
-    time_list_.emplace_back(sleep_time, true);
-    if (time_list_.size() > max_size_) {
-        time_list_.pop_front();
+    auto last_time = last_time_.load(std::memory_order_relaxed);
+    auto sleep_time = current_time > last_time ? current_time - last_time : 0;
+    sleeping_ = false;
+    last_time_.store(current_time, std::memory_order_relaxed);
+    total_sleep_usec_.fetch_add(sleep_time, std::memory_order_relaxed);
+    addRecord(sleep_time, true);
+}
+
+void ThreadLoadCounter::addRecord(uint64_t time, bool sleep) {
+    if (count_ == max_size_) {
+        auto& oldest = records_[head_];
+        (oldest.sleep_ ? sleep_sum_ : run_sum_) -= oldest.time_;
+        head_ = (head_ + 1) % max_size_;
+        --count_;
+    }
+    records_[(head_ + count_) % max_size_] = TimeRecord{time, sleep};
+    ++count_;
+    (sleep ? sleep_sum_ : run_sum_) += time;
+    // 超出统计时间窗口的记录直接丢弃
+    while (count_ && run_sum_ + sleep_sum_ > max_usec_) {
+        auto& oldest = records_[head_];
+        (oldest.sleep_ ? sleep_sum_ : run_sum_) -= oldest.time_;
+        head_ = (head_ + 1) % max_size_;
+        --count_;
     }
+    publish();
+}
+
+// 运行时长之和占高32位, 休眠时长之和占中间31位, 最低位表示是否在休眠
+void ThreadLoadCounter::publish() {
+    uint64_t run = std::min(run_sum_, kRunSumMax);
+    uint64_t sleep = std::min(sleep_sum_, kSleepSumMax);
+    state_.store((run << 32) | (sleep << 1) | (sleeping_ ? 1 : 0), std::memory_order_relaxed);
 }
 
 int ThreadLoadCounter::load() {
-    std::lock_guard<decltype(mtx_)> lock(mtx_);
-    uint64_t total_sleep_time = 0;
-    uint64_t total_run_time = 0;
-    time_list_.forEach([&total_sleep_time, &total_run_time](const TimeRecord& rcd) {
-        if (rcd.sleep_) {
-            total_sleep_time += rcd.time_;
-        } else {
-            total_run_time += rcd.time_;
-        }
-    });
-    if (sleeping_) {
-        total_sleep_time += (TimeUtil::getCurrentMicrosecond() - last_sleep_time_);
-    } else {
-        total_run_time += (TimeUtil::getCurrentMicrosecond() - last_wake_time_);
+    auto state = state_.load(std::memory_order_relaxed);
+    auto last_time = last_time_.load(std::memory_order_relaxed);
+    auto current_time = TimeUtil::getCurrentMicrosecond();
+    bool sleeping = state & 1;
+    uint64_t total_sleep_time = (state >> 1) & kSleepSumMax;
+    uint64_t total_run_time = state >> 32;
+    uint64_t elapsed = current_time > last_time ? current_time - last_time : 0;
+    if (elapsed >= max_usec_) {
+        return sleeping ? 0 : 100;  // 当前状态已经持续了整个统计窗口
     }
+    (sleeping ? total_sleep_time : total_run_time) += elapsed;
+    // 两次读取之间可能发生了状态切换, 结果只是一个近似值, 统计窗口也可能略大于max_usec_
     uint64_t total_time = total_sleep_time + total_run_time;
-    while ((time_list_.size() != 0) && (total_time > max_usec_ || time_list_.size() > max_size_)) {
-        TimeRecord& rcd = time_list_.front();
-        if (rcd.sleep_) {
-            total_sleep_time -= rcd.time_;
-        } else {
-            total_run_time -= rcd.time_;
-        }
-        total_time -= rcd.time_;
-        time_list_.pop_front();
-    }
     if (total_time == 0) {
         return 0;
     }
     return static_cast<int>(total_run_time * 100 / total_time);
 }
 
+void ThreadLoadCounter::addSpinTime(uint64_t usec) {
+    total_spin_usec_.fetch_add(usec, std::memory_order_relaxed);
+}
+
+uint64_t ThreadLoadCounter::spinTime() const { return total_spin_usec_.load(std::memory_order_relaxed); }
+
+uint64_t ThreadLoadCounter::sleepTime() const { return total_sleep_usec_.load(std::memory_order_relaxed); }
+
 //////////////////////// TaskExecutorInterface /////////////////////////////////
 
 Task::Ptr TaskExecutorInterface::asyncFirst(TaskIn task, bool may_sync) {
@@ -102,12 +125,68 @@ void TaskExecutorInterface::syncFirst(const TaskIn& task) {
 
 /////////////////////////////// TaskExecutor //////////////////////////////////////
 
+static constexpr uint64_t kEventWindowMs = 1000;  // 事件数统计周期
+
 TaskExecutor::TaskExecutor(uint64_t max_size, uint64_t max_usec) 
-    : ThreadLoadCounter(max_size, max_usec) {}
+    : ThreadLoadCounter(max_size, max_usec), window_start_(TimeUtil::getCurrentMillisecond()) {}
+
+void TaskExecutor::addConnection(int count) { connections_.fetch_add(count, std::memory_order_relaxed); }
+
+size_t TaskExecutor::connectionCount() const {
+    auto count = connections_.load(std::memory_order_relaxed);
+    return count > 0 ? static_cast<size_t>(count) : 0;
+}
+
+void TaskExecutor::addEvents(uint64_t count) {
+    window_events_ += count;
+    auto now = TimeUtil::getCurrentMillisecond();
+    auto start = window_start_.load(std::memory_order_relaxed);
+    if (now < start + kEventWindowMs) {
+        return;
+    }
+    // 和上一个周期的结果取平均, 平滑突发的事件
+    auto rate = window_events_ * 1000 / (now - start);
+    event_rate_.store((event_rate_.load(std::memory_order_relaxed) + rate) / 2, std::memory_order_relaxed);
+    window_events_ = 0;
+    window_start_.store(now, std::memory_order_relaxed);
+}
+
+uint64_t TaskExecutor::eventRate() const {
+    auto rate = event_rate_.load(std::memory_order_relaxed);
+    auto now = TimeUtil::getCurrentMillisecond();
+    auto start = window_start_.load(std::memory_order_relaxed);
+    // 执行器线程一直在休眠, 没有更新统计结果, 每多过一个周期减半
+    auto idle = now > start ? (now - start) / kEventWindowMs : 0;
+    if (idle >= 2) {
+        rate = idle > 64 ? 0 : rate >> (idle - 1);
+    }
+    return rate;
+}
 
 //////////////////////// TaskExecutorGetterImpl /////////////////////////////////
 
+// 线程私有的xorshift随机数, 用于随机选择执行器
+static inline uint32_t randomIndex() {
+    static thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
 TaskExecutor::Ptr TaskExecutorGetterImpl::getExecutor() {
+    if (threads_.size() == 1) {
+        return threads_.front();
+    }
+    switch (policy_.load(std::memory_order_relaxed)) {
+        case SelectPolicy::PowerOfTwo: return getPowerOfTwo();
+        case SelectPolicy::LeastConnection: return getLeastConnection();
+        case SelectPolicy::EventWeighted: return getEventWeighted();
+        default: return getLeastLoad();
+    }
+}
+
+TaskExecutor::Ptr TaskExecutorGetterImpl::getLeastLoad() {
     auto thread_idx = thread_idx_;
     if (thread_idx >= threads_.size()) {
         thread_idx = 0;
@@ -133,6 +212,61 @@ TaskExecutor::Ptr TaskExecutorGetterImpl::getExecutor() {
     return executor_min_load;
 }
 
+TaskExecutor::Ptr TaskExecutorGetterImpl::getPowerOfTwo() {
+    auto size = threads_.size();
+    auto first = randomIndex() % size;
+    auto second = (first + 1 + randomIndex() % (size - 1)) % size;  // 与first不同
+    auto& a = threads_[first];
+    auto& b = threads_[second];
+    auto load_a = a->load();
+    auto load_b = b->load();
+    if (load_a != load_b) {
+        return load_a < load_b ? a : b;
+    }
+    return a->connectionCount() <= b->connectionCount() ? a : b;
+}
+
+// 连接数相同时从上一次选中的下一个开始, 避免总是选中第一个
+TaskExecutor::Ptr TaskExecutorGetterImpl::getLeastConnection() {
+    auto size = threads_.size();
+    auto start = (thread_idx_ + 1) % size;
+    auto best = start;
+    auto min_count = threads_[start]->connectionCount();
+    for (size_t i = 1; i < size && min_count; ++i) {
+        auto idx = (start + i) % size;
+        auto count = threads_[idx]->connectionCount();
+        if (count < min_count) {
+            min_count = count;
+            best = idx;
+        }
+    }
+    thread_idx_ = best;
+    return threads_[best];
+}
+
+// 直接选择事件数最少的执行器时, 统计周期内的新连接会全部集中到同一个执行器, 所以按权重随机选择
+TaskExecutor::Ptr TaskExecutorGetterImpl::getEventWeighted() {
+    double total = 0;
+    for (auto& executor : threads_) {
+        total += 1.0 / (executor->eventRate() + 1);
+    }
+    // 两次遍历之间事件数可能被更新, 没有选中时取最后一个
+    double pick = total * randomIndex() / UINT32_MAX;
+    for (auto& executor : threads_) {
+        pick -= 1.0 / (executor->eventRate() + 1);
+        if (pick <= 0) {
+            return executor;
+        }
+    }
+    return threads_.back();
+}
+
+void TaskExecutorGetterImpl::setSelectPolicy(SelectPolicy policy) { policy_.store(policy, std::memory_order_relaxed); }
+
+TaskExecutorGetterImpl::SelectPolicy TaskExecutorGetterImpl::getSelectPolicy() const {
+    return policy_.load(std::memory_order_relaxed);
+}
+
 size_t TaskExecutorGetterImpl::getExecutorSize() const { return threads_.size(); }
 
 std::vector<int> TaskExecutorGetterImpl::getExecutorLoad() {
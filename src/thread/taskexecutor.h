@@ -11,38 +11,56 @@
 #ifndef _TASKEXCUTOR_H_
 #define _TASKEXCUTOR_H_
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <vector>
 #include "utility.h"
 
 namespace xkernel {
 
 enum class Thread_Priority : int;
 
+// 线程负载统计, 记录最近max_size_次休眠和运行的时长(总时长不超过max_usec_), 计算运行时间占比
+// startSleep和sleepWakeUp只能由被统计的线程调用, 时长记录在固定大小的环形数组中并维护运行和休眠时长之和,
+// 二者和休眠状态打包在一个原子变量中发布, load可以在任意线程无锁调用, 不会分配内存
 class ThreadLoadCounter {
 public:
     ThreadLoadCounter(uint64_t max_size, uint64_t max_usec);
-    ~ThreadLoadCounter() = default;
+    virtual ~ThreadLoadCounter() = default;
 
 public:
     void startSleep();
     void sleepWakeUp();
-    int load();  // 获取当前线程的CPU使用率, 
+    virtual int load();  // 获取当前线程的CPU使用率, 多线程的执行器可以重写为所有线程的汇总
+    void addSpinTime(uint64_t usec);  // 记录一次忙轮询的时长, 忙轮询期间线程占用CPU, 计入运行时间
+    uint64_t spinTime() const;  // 累计忙轮询时长(微秒)
+    uint64_t sleepTime() const;  // 累计休眠时长(微秒)
 
 private:
     struct TimeRecord {
-        TimeRecord(uint64_t tm, bool slp) : time_(tm), sleep_(slp) {}
-        bool sleep_;
         uint64_t time_;
+        bool sleep_;
     };
+    void addRecord(uint64_t time, bool sleep);
+    void publish();
+
+private:
     bool sleeping_ = true;
-    uint64_t last_sleep_time_;  // 上一次休眠时间
-    uint64_t last_wake_time_;  // 上一次唤醒时间
     uint64_t max_size_;  // 统计样本数量
     uint64_t max_usec_;  // 统计时间窗口大小
-    std::mutex mtx_;
-    List<TimeRecord> time_list_;  // 记录每次休眠和唤醒的时长
+    // 以下成员只在被统计的线程中访问
+    std::vector<TimeRecord> records_;  // 环形数组, 记录每次休眠和唤醒的时长
+    size_t head_ = 0;  // 最早的记录
+    size_t count_ = 0;
+    uint64_t run_sum_ = 0;  // records_中的运行时长之和
+    uint64_t sleep_sum_ = 0;  // records_中的休眠时长之和
+    // 以下成员供其他线程读取
+    std::atomic<uint64_t> last_time_;  // 上一次休眠或唤醒的时间
+    std::atomic<uint64_t> state_{0};  // 运行时长之和、休眠时长之和以及是否在休眠, 见publish
+    std::atomic<uint64_t> total_spin_usec_{0};
+    std::atomic<uint64_t> total_sleep_usec_{0};
 };
 
 // 可取消任务的抽象基类
@@ -126,6 +144,18 @@ public:
 
     TaskExecutor(uint64_t max_size = 32, uint64_t max_usec = 2 * 1000 * 1000);
     ~TaskExecutor() = default;
+
+public:
+    void addConnection(int count = 1);  // 绑定到本执行器的连接数增减, 可在任意线程调用
+    size_t connectionCount() const;
+    void addEvents(uint64_t count);  // 记录处理的事件数, 只能在执行器线程调用
+    uint64_t eventRate() const;  // 最近每秒处理的事件数, 长时间没有更新时逐渐衰减, 可在任意线程调用
+
+private:
+    std::atomic<int64_t> connections_{0};
+    uint64_t window_events_ = 0;  // 当前统计周期内的事件数
+    std::atomic<uint64_t> window_start_;  // 当前统计周期的开始时间(毫秒)
+    std::atomic<uint64_t> event_rate_{0};
 };
 
 // 任务执行器获取接口
@@ -143,20 +173,37 @@ public:
 // 任务执行器获取接口的实现类
 class TaskExecutorGetterImpl : public TaskExecutorGetter {
 public: 
+    // getExecutor选择执行器的策略
+    enum class SelectPolicy {
+        LeastLoad,  // 遍历所有执行器, 选择CPU使用率最低的
+        PowerOfTwo,  // 随机选择两个执行器, 取CPU使用率较低的, 相同时取连接数较少的
+        LeastConnection,  // 选择连接数最少的, 适合大量长时间空闲的连接
+        EventWeighted  // 按最近每秒事件数的倒数加权随机选择
+    };
+
     TaskExecutorGetterImpl() = default;
     ~TaskExecutorGetterImpl() = default;
 
 public:
-    TaskExecutor::Ptr getExecutor() override;  // 获取最空闲的任务执行器
+    TaskExecutor::Ptr getExecutor() override;  // 按选择策略获取任务执行器
     size_t getExecutorSize() const override;  // 获取执行器(线程)数量
     std::vector<int> getExecutorLoad();  // 获取所有线程的负载率    
     void getExecutorDelay(const std::function<void(const std::vector<int>&)>& callback);  // 获取所有线程任务执行时延
     void forEach(const std::function<void(const TaskExecutor::Ptr&)>& callback);  // 遍历所有线程
+    void setSelectPolicy(SelectPolicy policy);
+    SelectPolicy getSelectPolicy() const;
 
 protected:
     size_t addPoller(const std::string& name, size_t size, Thread_Priority priority,
         bool register_thread, bool enable_cpu_affinity = true);
+private:
+    TaskExecutor::Ptr getLeastLoad();
+    TaskExecutor::Ptr getPowerOfTwo();
+    TaskExecutor::Ptr getLeastConnection();
+    TaskExecutor::Ptr getEventWeighted();
+
 protected:
+    std::atomic<SelectPolicy> policy_{SelectPolicy::LeastLoad};
     size_t thread_idx_ = 0;  // 跟踪当前选择的线程(TaskExecutor)索引，是上一次选出的负载最小的线程
     std::vector<TaskExecutor::Ptr> threads_;
 };
@@ -1,173 +1,380 @@
-#include "threadpool.h"
-
-#include <stdexcept>
-#include "logger.h"
-#include "msgqueue.h"
-#include "taskexecutor.h"
-#include "utility.h"
-
-
-namespace xkernel {
-
-//////////////////////////////////// ThreadGroup //////////////////////////////////////
-
-ThreadGroup::~ThreadGroup() { threads_.clear();}
-
-bool ThreadGroup::isThisThreadIn() {
-    auto thread_id = std::this_thread::get_id();
-    if (thread_id == thread_id_) {
-        return true;  // 如果是最后创建的线程
-    }
-    return threads_.find(thread_id) != threads_.end();
-}
-
-bool ThreadGroup::isThreadIn(std::thread* thrd) {
-    if (!thrd) {
-        return false;
-    }
-    return threads_.find(thrd->get_id()) != threads_.end();
-}
-
-void ThreadGroup::removeThread(std::thread* thrd) {
-    auto it = threads_.find(thrd->get_id());
-    if (it != threads_.end()) {
-        threads_.erase(it);
-    }
-}
-
-void ThreadGroup::joinAll() {
-    if (isThisThreadIn()) {
-        throw std::runtime_error("Trying joining itself in thread_group");
-    }
-    for (auto& it : threads_) {
-        if (it.second->joinable()) {
-            it.second->join();
-        }
-    }
-    threads_.clear();
-}
-
-size_t ThreadGroup::size() { return threads_.size(); }
-
-//////////////////////////////////// ThreadPool //////////////////////////////////////
-
-ThreadPool::ThreadPool(int num, Thread_Priority priority, bool auto_run, 
-                       bool set_affinity, const std::string& pool_name) {
-    thread_num_ = num;
-    on_setup_ = [pool_name, priority, set_affinity](int index) {
-        std::string name = pool_name + " " + std::to_string(index);
-        setPriority(priority);
-        ThreadUtil::setThreadName(name.data());
-        if (set_affinity) {
-            ThreadUtil::setThreadAffinity(index % std::thread::hardware_concurrency());
-        }
-    };
-    logger_ = Logger::Instance().shared_from_this();
-    if (auto_run) {
-        start();
-    }
-}
-
-ThreadPool::~ThreadPool() {
-    shutdown();
-    wait();
-}
-    
-Task::Ptr ThreadPool::async(TaskIn task, bool may_sync) {
-    if (may_sync && thread_group_.isThisThreadIn()) {
-        task();
-        return nullptr;
-    }
-    auto ret = std::make_shared<Task>(std::move(task));
-    queue_.putMsg(ret);
-    return ret;
-}
-
-Task::Ptr ThreadPool::asyncFirst(TaskIn task, bool may_sync) {
-    if (may_sync && thread_group_.isThisThreadIn()) {
-        task();
-        return nullptr;
-    }
-    auto ret = std::make_shared<Task>(std::move(task));
-    queue_.putMsgToHead(ret);
-    return ret;
-}
-
-size_t ThreadPool::size() { return queue_.size(); }
-
-bool ThreadPool::setPriority(Thread_Priority priority, std::thread::native_handle_type threadId) {
-    static int Min = sched_get_priority_min(SCHED_FIFO);  // 获取SCHED_FIFO调度策略的最小优先级
-    if (Min == -1) {
-        return false;
-    }
-    static int Max = sched_get_priority_max(SCHED_FIFO);  // 获取SCHED_FIFO调度策略的最大优先级
-    if (Max == -1 ) {
-        return false;
-    }
-    static int Priorities[] {Min, Min + (Max - Min)/4,
-                            Min + (Max - Min)/2,
-                            Min + (Max - Min) * 3/4, Max};
-    if (threadId == 0) {
-        threadId = pthread_self();
-    }
-    struct sched_param params;  // 创建调度参数结构体
-    params.sched_priority = Priorities[static_cast<int>(priority)];
-    return pthread_setschedparam(threadId, SCHED_FIFO, &params) == 0;
-}
-
-void ThreadPool::start() {
-    if (thread_num_ <= 0) {
-        return ;
-    }
-    size_t total = thread_num_ - thread_group_.size();
-    for (size_t i = 0; i < total; ++i) {
-        thread_group_.createThread([this, i](){ run(i); });
-    }
-}
-
-void ThreadPool::run(size_t index) {
-    on_setup_(index);
-    Task::Ptr task;
-    while (true) {
-        startSleep();
-        if (!queue_.getMsg(task)) {
-            break;  // 空任务，退出线程
-        }
-        sleepWakeUp();
-        try {
-            (*task)();
-            task = nullptr;
-        } catch (std::exception& ex) {
-            ErrorL << "ThreadPool catch a exception: " << ex.what();
-        }
-    }
-}
-
-void ThreadPool::wait() { thread_group_.joinAll(); }
-void ThreadPool::shutdown() { queue_.pushExit(thread_num_); }
-
-//////////////////////////////////// WorkThreadPool //////////////////////////////////////
-
-static size_t s_pool_size = 0;
-static bool s_enable_cpu_affinity = true;
-
-INSTANCE_IMP(WorkThreadPool)
-
-// 设置线程池大小, 必须在WorkThreadPool单例创建前调用
-void WorkThreadPool::setPoolSize(size_t size) { s_pool_size = size; }
-
-void WorkThreadPool::enableCpuAffinity(bool enable) { s_enable_cpu_affinity = enable; }
-
-EventPoller::Ptr WorkThreadPool::getPoller() {
-    return std::static_pointer_cast<EventPoller>(getExecutor());
-}
-
-EventPoller::Ptr WorkThreadPool::getFirstPoller() {
-    return std::static_pointer_cast<EventPoller>(threads_.front());
-}
-
-WorkThreadPool::WorkThreadPool() {
-    addPoller("work poller", s_pool_size, Thread_Priority::Lowest, false, s_enable_cpu_affinity);
-}
-
-}  // namespace xkernel
+#include "threadpool.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include "logger.h"
+#include "taskexecutor.h"
+#include "utility.h"
+
+
+namespace xkernel {
+
+//////////////////////////////////// ThreadGroup //////////////////////////////////////
+
+ThreadGroup::~ThreadGroup() { threads_.clear();}
+
+bool ThreadGroup::isThisThreadIn() {
+    auto thread_id = std::this_thread::get_id();
+    if (thread_id == thread_id_) {
+        return true;  // 如果是最后创建的线程
+    }
+    return threads_.find(thread_id) != threads_.end();
+}
+
+bool ThreadGroup::isThreadIn(std::thread* thrd) {
+    if (!thrd) {
+        return false;
+    }
+    return threads_.find(thrd->get_id()) != threads_.end();
+}
+
+void ThreadGroup::removeThread(std::thread* thrd) {
+    auto it = threads_.find(thrd->get_id());
+    if (it != threads_.end()) {
+        threads_.erase(it);
+    }
+}
+
+void ThreadGroup::joinAll() {
+    if (isThisThreadIn()) {
+        throw std::runtime_error("Trying joining itself in thread_group");
+    }
+    for (auto& it : threads_) {
+        if (it.second->joinable()) {
+            it.second->join();
+        }
+    }
+    threads_.clear();
+}
+
+size_t ThreadGroup::size() { return threads_.size(); }
+
+//////////////////////////////////// ThreadPool //////////////////////////////////////
+
+// 工作线程每执行这么多个任务后, 把注入队列的一批任务移到自己队列的尾部, 避免自己队列一直不空而饿死外部投递的任务
+static constexpr uint32_t kInjectInterval = 61;
+// 每次从注入队列最多取出的任务个数, 放入自己队列的尾部, 按顺序执行或被其他线程窃取
+static constexpr size_t kInjectBatch = 32;
+
+struct WorkerContext {
+    ThreadPool* pool = nullptr;
+    size_t index = 0;
+};
+static thread_local WorkerContext s_worker;
+
+static inline void futexWait(std::atomic<uint32_t>* addr, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static inline void futexWake(std::atomic<uint32_t>* addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+// 线程私有的xorshift随机数, 用于选择窃取对象
+static inline uint32_t randomVictim() {
+    static thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+ThreadPool::ThreadPool(int num, Thread_Priority priority, bool auto_run, 
+                       bool set_affinity, const std::string& pool_name) {
+    thread_num_ = num;
+    on_setup_ = [pool_name, priority, set_affinity](int index) {
+        std::string name = pool_name + " " + std::to_string(index);
+        setPriority(priority);
+        ThreadUtil::setThreadName(name.data());
+        if (set_affinity) {
+            ThreadUtil::setThreadAffinity(index % std::thread::hardware_concurrency());
+        }
+    };
+    for (int i = 0; i < num; ++i) {
+        queues_.emplace_back(new WorkStealingQueue<TaskHolder>());
+        loads_.emplace_back(new ThreadLoadCounter(32, 2 * 1000 * 1000));
+    }
+    logger_ = Logger::Instance().shared_from_this();
+    if (auto_run) {
+        start();
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+    wait();
+    // 线程池未启动时, 投递的任务不会被执行, 在这里释放
+    TaskHolder task;
+    for (auto& queue : queues_) {
+        while (queue->pop(task)) {
+            delete task;
+        }
+    }
+    for (auto task : inject_) {
+        delete task;
+    }
+    for (auto task : first_) {
+        delete task;
+    }
+}
+    
+Task::Ptr ThreadPool::async(TaskIn task, bool may_sync) {
+    if (may_sync && isThisThreadIn()) {
+        task();
+        return nullptr;
+    }
+    auto ret = std::make_shared<Task>(std::move(task));
+    pushTask(ret, false);
+    return ret;
+}
+
+Task::Ptr ThreadPool::asyncFirst(TaskIn task, bool may_sync) {
+    if (may_sync && isThisThreadIn()) {
+        task();
+        return nullptr;
+    }
+    auto ret = std::make_shared<Task>(std::move(task));
+    pushTask(ret, true);
+    return ret;
+}
+
+size_t ThreadPool::size() {
+    size_t size = inject_size_.load(std::memory_order_relaxed) + first_size_.load(std::memory_order_relaxed);
+    for (auto& queue : queues_) {
+        size += queue->size();
+    }
+    return size;
+}
+
+int ThreadPool::load() {
+    if (loads_.empty()) {
+        return 0;
+    }
+    int total = 0;
+    for (auto& load : loads_) {
+        total += load->load();
+    }
+    return total / static_cast<int>(loads_.size());
+}
+
+bool ThreadPool::setPriority(Thread_Priority priority, std::thread::native_handle_type threadId) {
+    static int Min = sched_get_priority_min(SCHED_FIFO);  // 获取SCHED_FIFO调度策略的最小优先级
+    if (Min == -1) {
+        return false;
+    }
+    static int Max = sched_get_priority_max(SCHED_FIFO);  // 获取SCHED_FIFO调度策略的最大优先级
+    if (Max == -1 ) {
+        return false;
+    }
+    static int Priorities[] {Min, Min + (Max - Min)/4,
+                            Min + (Max - Min)/2,
+                            Min + (Max - Min) * 3/4, Max};
+    if (threadId == 0) {
+        threadId = pthread_self();
+    }
+    struct sched_param params;  // 创建调度参数结构体
+    params.sched_priority = Priorities[static_cast<int>(priority)];
+    return pthread_setschedparam(threadId, SCHED_FIFO, &params) == 0;
+}
+
+void ThreadPool::start() {
+    if (thread_num_ <= 0) {
+        return ;
+    }
+    size_t total = thread_num_ - thread_group_.size();
+    for (size_t i = 0; i < total; ++i) {
+        thread_group_.createThread([this, i](){ run(i); });
+    }
+}
+
+void ThreadPool::run(size_t index) {
+    on_setup_(index);
+    s_worker.pool = this;
+    s_worker.index = index;
+    loads_[index]->sleepWakeUp();  // 负载统计初始为休眠状态, 线程启动后开始计为运行
+    uint32_t tick = 0;
+    while (auto task = getTask(index, tick)) {
+        try {
+            (**task)();
+        } catch (std::exception& ex) {
+            ErrorL << "ThreadPool catch a exception: " << ex.what();
+        }
+        delete task;
+    }
+    s_worker.pool = nullptr;
+}
+
+void ThreadPool::wait() { thread_group_.joinAll(); }
+
+// 已投递的任务执行完后工作线程才会退出
+void ThreadPool::shutdown() {
+    exit_.store(true, std::memory_order_seq_cst);
+    notify(true);
+}
+
+bool ThreadPool::isThisThreadIn() const { return s_worker.pool == this; }
+
+void ThreadPool::pushTask(Task::Ptr task, bool first) {
+    auto holder = new Task::Ptr(std::move(task));
+    if (first) {
+        std::lock_guard<std::mutex> lock(first_mutex_);
+        first_.emplace_front(holder);  // 后投递的优先级更高, 与原来插入队头的语义一致
+        first_size_.fetch_add(1, std::memory_order_relaxed);
+    } else if (isThisThreadIn()) {
+        queues_[s_worker.index]->push(holder);
+    } else {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        inject_.emplace_back(holder);
+        inject_size_.fetch_add(1, std::memory_order_relaxed);
+    }
+    notify();
+}
+
+ThreadPool::TaskHolder ThreadPool::getTask(size_t index, uint32_t& tick) {
+    while (true) {
+        TaskHolder task = getFirstTask();
+        if (task) {
+            return task;
+        }
+        if (++tick % kInjectInterval == 0) {
+            takeInjectTasks(index);
+        }
+        // 所属线程同样从队列顶部按投递顺序取任务, 工作线程内投递的任务保持先进先出
+        if (queues_[index]->steal(task)) {
+            return task;
+        }
+        if (takeInjectTasks(index)) {
+            continue;
+        }
+        if ((task = stealTask(index))) {
+            return task;
+        }
+        if (exit_.load(std::memory_order_acquire) && !hasTask()) {
+            return nullptr;
+        }
+        park(index);
+    }
+}
+
+ThreadPool::TaskHolder ThreadPool::getFirstTask() {
+    if (!first_size_.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(first_mutex_);
+    if (first_.empty()) {
+        return nullptr;
+    }
+    auto task = first_.front();
+    first_.pop_front();
+    first_size_.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+// 只在队列尾部追加, 自己队列中已有的任务先执行, 单个工作线程时也保持投递顺序
+bool ThreadPool::takeInjectTasks(size_t index) {
+    if (!inject_size_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    TaskHolder batch[kInjectBatch];
+    size_t count;
+    {
+        std::lock_guard<std::mutex> lock(inject_mutex_);
+        // 按线程数平分, 避免一个线程把注入队列取空
+        count = std::min(inject_.size() / thread_num_ + 1, kInjectBatch);
+        count = std::min(count, inject_.size());
+        for (size_t i = 0; i < count; ++i) {
+            batch[i] = inject_.front();
+            inject_.pop_front();
+        }
+        inject_size_.fetch_sub(count, std::memory_order_relaxed);
+    }
+    if (!count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        queues_[index]->push(batch[i]);
+    }
+    if (count > 1) {
+        notify();
+    }
+    return true;
+}
+
+ThreadPool::TaskHolder ThreadPool::stealTask(size_t index) {
+    size_t num = queues_.size();
+    size_t start = randomVictim() % num;
+    TaskHolder task;
+    for (size_t i = 0; i < num; ++i) {
+        size_t victim = (start + i) % num;
+        if (victim != index && queues_[victim]->steal(task)) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool ThreadPool::hasTask() const {
+    if (first_size_.load(std::memory_order_relaxed) || inject_size_.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    for (auto& queue : queues_) {
+        if (!queue->empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 投递任务后调用, 有线程在休眠且没有正在进行的唤醒时才需要唤醒, 避免每次投递都产生一次系统调用
+void ThreadPool::notify(bool all) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!all && (!sleepers_.load(std::memory_order_relaxed) || notified_.exchange(true, std::memory_order_seq_cst))) {
+        return;
+    }
+    park_epoch_.fetch_add(1, std::memory_order_seq_cst);
+    futexWake(&park_epoch_, all ? INT_MAX : 1);
+}
+
+// 先登记为休眠状态再检查一遍任务, 与notify中的检查配合, 保证不会丢失唤醒
+void ThreadPool::park(size_t index) {
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    auto epoch = park_epoch_.load(std::memory_order_seq_cst);
+    if (!hasTask() && !exit_.load(std::memory_order_seq_cst)) {
+        loads_[index]->startSleep();
+        futexWait(&park_epoch_, epoch);
+        loads_[index]->sleepWakeUp();
+    }
+    // 必须先退出休眠登记再清除唤醒标记, 否则notify可能在清除之后看到本线程仍在休眠而设置标记, 导致之后不再唤醒
+    sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+    notified_.store(false, std::memory_order_seq_cst);
+}
+
+//////////////////////////////////// WorkThreadPool //////////////////////////////////////
+
+static size_t s_pool_size = 0;
+static bool s_enable_cpu_affinity = true;
+
+INSTANCE_IMP(WorkThreadPool)
+
+// 设置线程池大小, 必须在WorkThreadPool单例创建前调用
+void WorkThreadPool::setPoolSize(size_t size) { s_pool_size = size; }
+
+void WorkThreadPool::enableCpuAffinity(bool enable) { s_enable_cpu_affinity = enable; }
+
+EventPoller::Ptr WorkThreadPool::getPoller() {
+    return std::static_pointer_cast<EventPoller>(getExecutor());
+}
+
+EventPoller::Ptr WorkThreadPool::getFirstPoller() {
+    return std::static_pointer_cast<EventPoller>(threads_.front());
+}
+
+WorkThreadPool::WorkThreadPool() {
+    addPoller("work poller", s_pool_size, Thread_Priority::Lowest, false, s_enable_cpu_affinity);
+}
+
+}  // namespace xkernel
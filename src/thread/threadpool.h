@@ -1,13 +1,17 @@
 #ifndef _THREADPOOL_H_
 #define _THREADPOOL_H_
 #include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
 #include <memory>
+#include <vector>
 
 #include "taskexecutor.h"
 #include "logger.h"
-#include "msgqueue.h"
+#include "workstealingqueue.h"
 #include "eventpoller.h"
 
 namespace xkernel {
@@ -49,6 +53,9 @@ private:
 };
 
 // 线程池，用于任务的执行
+// 每个工作线程有一个工作窃取队列, 工作线程内投递的任务放入自己的队列, 外部线程投递的任务放入全局注入队列
+// 工作线程依次从优先队列、自己的队列、注入队列获取任务, 都没有时随机选择其他线程窃取, 仍没有则通过futex休眠
+// 所有线程都从工作窃取队列的顶部取任务, 同一线程投递的任务按投递顺序执行
 class ThreadPool : public TaskExecutor {
 public:
     ThreadPool(int num = 1, Thread_Priority priority = Thread_Priority::Highest, 
@@ -59,21 +66,44 @@ public:
 public:
     Task::Ptr async(TaskIn task, bool may_sync = true) override;
     Task::Ptr asyncFirst(TaskIn task, bool may_sync = true) override;
-    size_t size();
+    size_t size();  // 待执行的任务个数, 近似值
+    int load() override;  // 所有工作线程CPU使用率的平均值
     static bool setPriority(Thread_Priority priority = Thread_Priority::Highest, 
                             std::thread::native_handle_type threadId = 0);
     void start();
 
 private:
+    using TaskHolder = Task::Ptr*;  // 无锁队列只能存放指针, 持有任务的一份引用
+
     void run(size_t index);
     void wait();
     void shutdown();
+    bool isThisThreadIn() const;
+    void pushTask(Task::Ptr task, bool first);
+    TaskHolder getTask(size_t index, uint32_t& tick);
+    TaskHolder getFirstTask();
+    bool takeInjectTasks(size_t index);  // 从注入队列取一批任务放入自己的队列
+    TaskHolder stealTask(size_t index);
+    bool hasTask() const;
+    void notify(bool all = false);
+    void park(size_t index);
 
 private:
     size_t thread_num_;
     Logger::Ptr logger_;
     ThreadGroup thread_group_;
-    MsgQueue<Task::Ptr> queue_;
+    std::vector<std::unique_ptr<WorkStealingQueue<TaskHolder>>> queues_;  // 每个工作线程一个
+    std::vector<std::unique_ptr<ThreadLoadCounter>> loads_;  // 每个工作线程一个, 只由对应的线程更新
+    std::mutex inject_mutex_;
+    std::deque<TaskHolder> inject_;  // 外部线程投递的任务
+    std::atomic<size_t> inject_size_{0};
+    std::mutex first_mutex_;
+    std::deque<TaskHolder> first_;  // asyncFirst投递的任务, 优先执行
+    std::atomic<size_t> first_size_{0};
+    alignas(64) std::atomic<uint32_t> park_epoch_{0};  // futex等待的地址, 唤醒时递增
+    std::atomic<uint32_t> sleepers_{0};  // 准备休眠或正在休眠的线程数
+    std::atomic<bool> notified_{false};  // 已发出唤醒, 被唤醒的线程还未处理
+    std::atomic<bool> exit_{false};
     std::function<void(int)> on_setup_;
 };
 
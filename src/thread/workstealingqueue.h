@@ -0,0 +1,127 @@
+/*
+ * 无锁工作窃取双端队列(Chase-Lev)
+ *
+ * 所属线程在底部push/pop(后进先出), 其他线程从顶部steal(先进先出)
+ * 只有队列剩最后一个元素时, pop和steal才需要通过CAS竞争
+ * 数组满时扩容为两倍, 旧数组可能仍被窃取线程读取, 保留到队列析构时再释放
+ * 元素类型必须可平凡复制(一般为指针), 因为窃取线程可能和所属线程同时读写同一个槽位
+ */
+#ifndef _WORKSTEALINGQUEUE_H_
+#define _WORKSTEALINGQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "utility.h"
+
+namespace xkernel {
+
+template <typename T>
+class WorkStealingQueue : public Noncopyable {
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingQueue element must be trivially copyable");
+
+public:
+    // 容量会向上取整为2的幂
+    explicit WorkStealingQueue(size_t capacity = 1024) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        arrays_.emplace_back(new Array(size));
+        array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+    ~WorkStealingQueue() = default;
+
+public:
+    // 只能在所属线程调用
+    void push(T value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Array* array = array_.load(std::memory_order_relaxed);
+        if (bottom - top > static_cast<int64_t>(array->mask_)) {
+            array = grow(array, top, bottom);
+        }
+        array->put(bottom, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // 只能在所属线程调用, 取出最后push的元素
+    bool pop(T& value) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* array = array_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);  // 队列为空
+            return false;
+        }
+        value = array->get(bottom);
+        if (top == bottom) {
+            // 最后一个元素, 和窃取线程竞争
+            bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 可在任意线程调用, 取出最早push的元素, 和其他线程竞争失败时也返回false
+    bool steal(T& value) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+        Array* array = array_.load(std::memory_order_acquire);
+        value = array->get(top);
+        return top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // 可在任意线程调用, 结果只是一个近似值
+    size_t size() const {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t capacity() const { return array_.load(std::memory_order_relaxed)->mask_ + 1; }
+
+private:
+    struct Array {
+        explicit Array(size_t size) : mask_(size - 1), slots_(new std::atomic<T>[size]) {}
+
+        T get(int64_t index) const { return slots_[index & mask_].load(std::memory_order_relaxed); }
+        void put(int64_t index, T value) { slots_[index & mask_].store(value, std::memory_order_relaxed); }
+
+        size_t mask_;
+        std::unique_ptr<std::atomic<T>[]> slots_;
+    };
+
+    Array* grow(Array* array, int64_t top, int64_t bottom) {
+        auto bigger = new Array((array->mask_ + 1) * 2);
+        for (int64_t i = top; i < bottom; ++i) {
+            bigger->put(i, array->get(i));
+        }
+        arrays_.emplace_back(bigger);
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top_{0};  // 窃取位置
+    alignas(64) std::atomic<int64_t> bottom_{0};  // 所属线程的push/pop位置
+    std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> arrays_;  // 所有分配过的数组, 只有所属线程会修改
+};
+
+}  // namespace xkernel
+#endif  // _WORKSTEALINGQUEUE_H_
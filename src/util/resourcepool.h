@@ -1,15 +1,25 @@
 #ifndef _RESOURCEPOOL_H_
 #define _RESOURCEPOOL_H_
 
+#include <algorithm>
 #include <atomic>
-#include <deque>
+#include <cstdint>
 #include <functional>
 #include <memory>
-#include <mutex>
-#include <unordered_map>
+#include <new>
+#include <thread>
+#include <vector>
 
 #include "utility.h"
 
+/*
+ * 资源池, 循环使用对象, 避免频繁创建和销毁
+ *
+ * 每个线程按编号对应一个弹夹(magazine), 一般只有该线程访问, 取出和回收对象只操作弹夹
+ * 弹夹为空时从公共仓库(depot, 无锁有界队列)批量补充, 弹夹已满时把一半转移到仓库
+ * 线程编号冲突导致弹夹正被占用时, 直接访问仓库, 不会退化为new/delete
+ * 所有弹夹最多缓存pool_size_的一半, 仓库容量为剩余部分, 资源池缓存的对象总数不超过pool_size_
+ */
 namespace xkernel {
 
 template <typename C>
@@ -17,106 +27,363 @@ class ResourcePool_l;
 template <typename C>
 class ResourcePool;
 
+// 资源池线程编号, 决定线程使用哪个弹夹
+inline size_t resourcePoolThreadIndex() {
+    static std::atomic<size_t> s_next{0};
+    static thread_local size_t t_index = s_next.fetch_add(1, std::memory_order_relaxed);
+    return t_index;
+}
+
+// 为shared_ptr控制块分配内存, 释放的内存块缓存在本线程的空闲链表中, 避免每次obtain都向系统申请
+template <typename T>
+class ResourceNodeAllocator {
+public:
+    using value_type = T;
+
+    ResourceNodeAllocator() = default;
+    template <typename U>
+    ResourceNodeAllocator(const ResourceNodeAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        auto& cache = nodeCache();
+        if (n == 1 && cache.head) {
+            auto node = cache.head;
+            cache.head = node->next;
+            --cache.count;
+            return reinterpret_cast<T*>(node);
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        static_assert(sizeof(T) >= sizeof(void*), "node too small");
+        auto& cache = nodeCache();
+        if (n != 1 || cache.exited || cache.count >= kMaxCached) {
+            ::operator delete(ptr);
+            return;
+        }
+        static thread_local CacheHolder holder;  // 线程退出时释放空闲链表
+        (void)holder;
+        auto node = reinterpret_cast<Node*>(ptr);
+        node->next = cache.head;
+        cache.head = node;
+        ++cache.count;
+    }
+
+    template <typename U>
+    bool operator==(const ResourceNodeAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const ResourceNodeAllocator<U>&) const { return false; }
+
+private:
+    static constexpr size_t kMaxCached = 256;
+
+    struct Node {
+        Node* next;
+    };
+    // 不需要析构, 线程退出后仍可以安全访问
+    struct NodeCache {
+        Node* head;
+        size_t count;
+        bool exited;
+    };
+    struct CacheHolder {
+        ~CacheHolder() {
+            auto& cache = nodeCache();
+            while (cache.head) {
+                auto next = cache.head->next;
+                ::operator delete(cache.head);
+                cache.head = next;
+            }
+            cache.count = 0;
+            cache.exited = true;
+        }
+    };
+
+    static NodeCache& nodeCache() {
+        static thread_local NodeCache cache;
+        return cache;
+    }
+};
+
+// 对象回收器, 保存在shared_ptr的控制块中
+template <typename C>
+struct ResourceRecycler {
+    std::weak_ptr<ResourcePool_l<C>> pool_;
+    std::function<void(C*)> on_recycle_;
+    std::atomic_bool quit_{false};  // 为true时直接释放对象, 不放回资源池, 可能由其他线程设置
+
+    ResourceRecycler(const std::weak_ptr<ResourcePool_l<C>>& pool, const std::function<void(C*)>& on_recycle)
+        : pool_(pool), on_recycle_(on_recycle) {}
+    // shared_ptr要求删除器可以拷贝
+    ResourceRecycler(const ResourceRecycler& that)
+        : pool_(that.pool_), on_recycle_(that.on_recycle_), quit_(that.quit_.load()) {}
+    ResourceRecycler(ResourceRecycler&& that)
+        : pool_(std::move(that.pool_)), on_recycle_(std::move(that.on_recycle_)), quit_(that.quit_.load()) {}
+
+    void operator()(C* ptr) const {
+        if (on_recycle_) {
+            on_recycle_(ptr);
+        }
+        auto strongPool = pool_.lock();
+        if (strongPool && !quit_.load(std::memory_order_acquire)) {
+            strongPool->recycle(ptr);
+        } else {
+            delete ptr;
+        }
+    }
+};
+
 // 自定义智能指针类，继承自 std::shared_ptr, 添加了资源池相关功能
 template <typename C>
 class shared_ptr_impl : public std::shared_ptr<C> {
 public:
     shared_ptr_impl() = default;
-    shared_ptr_impl(C* ptr, const std::weak_ptr<ResourcePool_l<C>>& weakPool, 
-                   std::shared_ptr<std::atomic_bool> quit, 
-                   const std::function<void(C*)>& on_recycle) 
-        : std::shared_ptr<C>(ptr, [weakPool, quit, on_recycle](C* ptr) {
-            if (on_recycle) {
-                on_recycle(ptr);
-            }
-            auto strongPool = weakPool.lock();
-            if (strongPool && !(*quit)) {
-                strongPool->recycle(ptr);
+    shared_ptr_impl(C* ptr, const std::weak_ptr<ResourcePool_l<C>>& weakPool,
+                   const std::function<void(C*)>& on_recycle)
+        : std::shared_ptr<C>(ptr, ResourceRecycler<C>(weakPool, on_recycle),
+                             ResourceNodeAllocator<C>()) {}
+
+    // 控制对象释放时是否退出资源池循环, 需要在最后一个引用释放之前调用
+    void quit(bool flag = true) {
+        if (auto recycler = std::get_deleter<ResourceRecycler<C>>(*this)) {
+            recycler->quit_.store(flag, std::memory_order_release);
+        }
+    }
+};
+
+// 公共仓库, 有界的多生产者多消费者无锁队列(Vyukov), 槽位数为2的幂, 最多存放capacity个元素
+template <typename T>
+class ResourceDepot {
+public:
+    explicit ResourceDepot(size_t capacity) : capacity_(capacity) {
+        if (capacity == 0) {
+            return;
+        }
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(T value) {
+        if (!cells_) {
+            return false;
+        }
+        auto pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = cells_[pos & mask_];
+            auto seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // head_只会增加, 用旧值计算出的元素个数不小于实际个数
+                if (pos - head_.load(std::memory_order_relaxed) >= capacity_) {
+                    return false;
+                }
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // 已满
             } else {
-                delete ptr;
+                pos = tail_.load(std::memory_order_relaxed);
             }
-        }), quit_(std::move(quit)){}
+        }
+    }
 
-    void quit(bool flag = true) {
-        if (quit_) {
-            *quit_ = flag;
+    bool pop(T& value) {
+        if (!cells_) {
+            return false;
+        }
+        auto pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& cell = cells_[pos & mask_];
+            auto seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // 为空
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
         }
     }
+
 private:
-    std::shared_ptr<std::atomic_bool> quit_;  // 控制是否退出资源池循环的标志
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    size_t capacity_;
+    size_t mask_ = 0;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
 };
 
 template <typename C>
 class ResourcePool_l : public std::enable_shared_from_this<ResourcePool_l<C>> {
 public:
-    friend class shared_ptr_impl<C>;
+    friend struct ResourceRecycler<C>;
     friend class ResourcePool<C>;
     using ValuePtr = shared_ptr_impl<C>;
 
-    ResourcePool_l() { alloc_ = []() -> C* { return new C(); }; }
+    static constexpr size_t kMagazineSize = 8;
+
+    ResourcePool_l() {
+        alloc_ = []() -> C* { return new C(); };
+        init();
+    }
     // 使用自定义参数创建对象
     template <typename... ArgTypes>
     ResourcePool_l(ArgTypes&&... args) {
         alloc_ = [args...]() -> C* { return new C(args...); };
+        init();
     }
 
     ~ResourcePool_l() {
-        for (auto ptr : objs_) {
+        for (size_t i = 0; i < magazine_count_; ++i) {
+            auto& mag = magazines_[i];
+            for (size_t j = 0; j < mag.count; ++j) {
+                delete mag.objs[j];
+            }
+        }
+        C* ptr;
+        while (depot_->pop(ptr)) {
             delete ptr;
         }
     }
 
+    // 设置资源池最多缓存的对象数量, 只在第一次obtain之前调用有效, 之后调用被忽略; 不能和obtain并发调用
     void setSize(size_t size) {
+        if (used_.load(std::memory_order_acquire)) {
+            return;
+        }
         pool_size_ = size;
-        objs_.reserve(size);
+        resize();
     }
 
     ValuePtr obtain(const std::function<void(C*)>& on_recycle = nullptr) {
-        return ValuePtr(getPtr(), weak_self_, std::make_shared<std::atomic_bool>(false), on_recycle);
+        return ValuePtr(getPtr(), weak_self_, on_recycle);
     }
 
     std::shared_ptr<C> obtain2() {
-        auto weak_self = weak_self_;
-        return std::shared_ptr<C>(getPtr(), [weak_self](C* ptr) {
-            auto strongPool = weak_self.lock();
-            if (strongPool) {
-                strongPool->recycle(ptr);
-            } else {
-                delete ptr;
-            }
-        });
+        return std::shared_ptr<C>(getPtr(), ResourceRecycler<C>(weak_self_, nullptr),
+                                  ResourceNodeAllocator<C>());
     }
 
+    // 统计信息
+    uint64_t hitCount() const { return sumStat(&Magazine::hit); }  // 从资源池取到对象的次数
+    uint64_t missCount() const { return sumStat(&Magazine::miss); }  // 资源池为空, 新建对象的次数
+    uint64_t overflowCount() const { return sumStat(&Magazine::overflow); }  // 资源池已满, 释放对象的次数
+
 private:
+    struct alignas(64) Magazine {
+        std::atomic_flag busy = ATOMIC_FLAG_INIT;
+        size_t count = 0;
+        C* objs[kMagazineSize];
+        // 只在持有busy时更新, 或者原子地累加
+        std::atomic<uint64_t> hit{0};
+        std::atomic<uint64_t> miss{0};
+        std::atomic<uint64_t> overflow{0};
+    };
+
+    void init() {
+        // 线程编号冲突的概率随弹夹数量增加而降低, 取CPU核数的2倍
+        size_t count = 2;
+        while (count < 2 * std::max(1u, std::thread::hardware_concurrency()) && count < 64) {
+            count <<= 1;
+        }
+        magazine_count_ = count;
+        magazines_.reset(new Magazine[count]);
+        resize();
+    }
+
+    // 弹夹容量之和不超过pool_size_的一半, 仓库容量为剩余部分; pool_size_较小时弹夹容量为0, 只使用仓库
+    void resize() {
+        magazine_size_ = std::min(kMagazineSize, pool_size_ / 2 / magazine_count_);
+        depot_.reset(new ResourceDepot<C*>(pool_size_ - magazine_size_ * magazine_count_));
+    }
+
+    Magazine& localMagazine() { return magazines_[resourcePoolThreadIndex() & (magazine_count_ - 1)]; }
+
+    static void addStat(std::atomic<uint64_t>& stat) { stat.fetch_add(1, std::memory_order_relaxed); }
+
+    uint64_t sumStat(std::atomic<uint64_t> Magazine::*stat) const {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < magazine_count_; ++i) {
+            sum += (magazines_[i].*stat).load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
     void recycle(C* obj) {
-        auto is_busy = busy_.test_and_set();
-        if (!is_busy) {
-            if (objs_.size() >= pool_size_) {
-                delete obj;
-            } else {
-                objs_.emplace_back(obj);
+        auto& mag = localMagazine();
+        if (magazine_size_ && !mag.busy.test_and_set(std::memory_order_acquire)) {
+            if (mag.count >= magazine_size_) {
+                // 弹夹已满, 转移一半到仓库
+                auto keep = magazine_size_ / 2;
+                while (mag.count > keep) {
+                    auto ptr = mag.objs[--mag.count];
+                    if (!depot_->push(ptr)) {
+                        delete ptr;
+                        addStat(mag.overflow);
+                    }
+                }
             }
-            busy_.clear();
-        } else {
+            if (mag.count < magazine_size_) {
+                mag.objs[mag.count++] = obj;
+                obj = nullptr;
+            }
+            mag.busy.clear(std::memory_order_release);
+            if (!obj) {
+                return;
+            }
+        }
+        if (!depot_->push(obj)) {
             delete obj;
+            addStat(mag.overflow);
         }
     }
 
     C* getPtr() {
-        C* ptr;
-        auto is_busy = busy_.test_and_set();
-        if (!is_busy) {
-            if (objs_.size() == 0) {
-                ptr = alloc_();
-            } else {
-                ptr = objs_.back();
-                objs_.pop_back();
+        if (!used_.load(std::memory_order_relaxed)) {
+            used_.store(true, std::memory_order_release);
+        }
+        auto& mag = localMagazine();
+        C* ptr = nullptr;
+        if (magazine_size_ && !mag.busy.test_and_set(std::memory_order_acquire)) {
+            if (mag.count == 0) {
+                // 弹夹为空, 从仓库补充一半
+                auto fill = std::max<size_t>(1, magazine_size_ / 2);  // 不超过magazine_size_
+                while (mag.count < fill && depot_->pop(ptr)) {
+                    mag.objs[mag.count++] = ptr;
+                }
             }
-            busy_.clear();
-        } else {
-            ptr = alloc_();
+            ptr = mag.count ? mag.objs[--mag.count] : nullptr;
+            mag.busy.clear(std::memory_order_release);
+        } else if (!depot_->pop(ptr)) {
+            ptr = nullptr;
         }
-        return ptr;
+        if (ptr) {
+            addStat(mag.hit);
+            return ptr;
+        }
+        addStat(mag.miss);
+        return alloc_();
     }
 
     void setup() { weak_self_ = this->shared_from_this(); }
@@ -124,9 +391,12 @@ private:
 
 private:
     size_t pool_size_ = 8;
-    std::vector<C*> objs_;  // 存储可用对象的队列
+    size_t magazine_size_ = kMagazineSize;  // 每个弹夹最多缓存的对象数
+    size_t magazine_count_ = 0;
+    std::atomic_bool used_{false};  // 是否已经取出过对象, 之后不能再修改容量
+    std::unique_ptr<Magazine[]> magazines_;  // 按线程编号划分的弹夹
+    std::unique_ptr<ResourceDepot<C*>> depot_;  // 公共仓库, 缓存弹夹之外的对象
     std::function<C*(void)> alloc_;  // 分配器函数
-    std::atomic_flag busy_{false};  // 标记池是否正在被访问
     std::weak_ptr<ResourcePool_l<C>> weak_self_;  // 弱引用自身
 };
 
@@ -135,7 +405,7 @@ class ResourcePool {
 public:
     using ValuePtr = shared_ptr_impl<C>;
     ResourcePool() {
-        pool_.reset(new ResourcePool_l<C>()); 
+        pool_.reset(new ResourcePool_l<C>());
         pool_->setup();
     }
 
@@ -153,9 +423,13 @@ public:
 
     std::shared_ptr<C> obtain2() { return pool_->obtain2(); }
 
+    uint64_t hitCount() const { return pool_->hitCount(); }
+    uint64_t missCount() const { return pool_->missCount(); }
+    uint64_t overflowCount() const { return pool_->overflowCount(); }
+
 private:
     std::shared_ptr<ResourcePool_l<C>> pool_;
 };
 
 }  // namespace xkernel
-#endif
\ No newline at end of file
+#endif
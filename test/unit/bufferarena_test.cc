@@ -0,0 +1,177 @@
+/*
+ * 测试BufferArena的大小等级、线程缓存和跨线程归还, 并对比直接使用new/make_shared的性能
+ */
+#include <gtest/gtest.h>
+#include "bufferarena.h"
+#include "buffer.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 容量向上取整为2的幂, 超过最大等级时按实际大小分配
+TEST(BufferArenaTest, SizeClass) {
+    size_t capacity = 0;
+    void* ptr = BufferArena::alloc(1, capacity);
+    EXPECT_EQ(capacity, BufferArena::kMinSize);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 16, 0u);
+    BufferArena::free(ptr);
+
+    for (size_t size : {65, 4096, 4097, 128 * 1024}) {
+        ptr = BufferArena::alloc(size, capacity);
+        EXPECT_GE(capacity, size);
+        EXPECT_EQ(capacity & (capacity - 1), 0u) << size;
+        memset(ptr, 0, capacity);
+        BufferArena::free(ptr);
+    }
+    ptr = BufferArena::alloc(200 * 1024, capacity);
+    EXPECT_EQ(capacity, 200u * 1024);
+    BufferArena::free(ptr);
+    BufferArena::free(nullptr);
+}
+
+// 本线程释放后再分配同一大小等级, 命中空闲链表, 不再向系统申请
+TEST(BufferArenaTest, Reuse) {
+    void* first = BufferArena::alloc(1000);
+    BufferArena::free(first);
+    auto mallocs = BufferArena::mallocCount();
+    auto allocs = BufferArena::allocCount();
+    for (int i = 0; i < 100; ++i) {
+        void* ptr = BufferArena::alloc(1000);
+        EXPECT_EQ(ptr, first);
+        BufferArena::free(ptr);
+    }
+    EXPECT_EQ(BufferArena::mallocCount(), mallocs);
+    EXPECT_EQ(BufferArena::allocCount(), allocs + 100);
+}
+
+// 在其他线程释放的内存块归还给分配它的线程
+TEST(BufferArenaTest, CrossThreadFree) {
+    auto in_use = BufferArena::bytesInUse();
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 64; ++i) {
+        ptrs.emplace_back(BufferArena::alloc(2048));
+    }
+    EXPECT_EQ(BufferArena::bytesInUse(), in_use + 64 * 2048);
+    std::thread([&ptrs]() {
+        for (auto ptr : ptrs) {
+            BufferArena::free(ptr);
+        }
+    }).join();
+    EXPECT_EQ(BufferArena::bytesInUse(), in_use);
+
+    auto mallocs = BufferArena::mallocCount();
+    for (int i = 0; i < 64; ++i) {
+        ptrs[i] = BufferArena::alloc(2048);
+    }
+    EXPECT_EQ(BufferArena::mallocCount(), mallocs);
+    for (auto ptr : ptrs) {
+        BufferArena::free(ptr);
+    }
+}
+
+// 分配线程退出后, 其他线程释放的内存块直接归还系统; 线程缓存被新线程复用
+TEST(BufferArenaTest, OwnerExit) {
+    auto in_use = BufferArena::bytesInUse();
+    std::vector<void*> ptrs;
+    std::thread([&ptrs]() {
+        for (int i = 0; i < 16; ++i) {
+            ptrs.emplace_back(BufferArena::alloc(512));
+        }
+        BufferArena::free(BufferArena::alloc(512));  // 留一个在空闲链表中, 线程退出时释放
+    }).join();
+    for (auto ptr : ptrs) {
+        BufferArena::free(ptr);
+    }
+    EXPECT_EQ(BufferArena::bytesInUse(), in_use);
+    std::thread([]() { BufferArena::free(BufferArena::alloc(512)); }).join();
+    EXPECT_EQ(BufferArena::bytesInUse(), in_use);
+}
+
+// BufferRaw的容量足够时复用已有内存, 否则重新分配
+TEST(BufferArenaTest, BufferRaw) {
+    auto in_use = BufferArena::bytesInUse();
+    {
+        auto buf = BufferRaw::create(1000);
+        EXPECT_EQ(buf->getCapacity(), 1024u);
+        auto data = buf->data();
+        buf->setCapacity(500);
+        EXPECT_EQ(buf->data(), data);
+        buf->assign("hello");
+        EXPECT_EQ(buf->toString(), "hello");
+        buf->setCapacity(5000);
+        EXPECT_EQ(buf->getCapacity(), 8192u);
+        EXPECT_GT(BufferArena::bytesInUse(), in_use);
+
+        auto str = BufferArena::makeShared<BufferString>(std::string("world"));
+        EXPECT_EQ(str->toString(), "world");
+    }
+    EXPECT_EQ(BufferArena::bytesInUse(), in_use);
+}
+
+// 模拟poller线程接收数据后交给其他线程处理并释放
+template <typename Create>
+static uint64_t pingPong(Create create, int count) {
+    std::atomic<Buffer::Ptr*> slot{nullptr};
+    std::atomic<bool> done{false};
+    std::thread consumer([&]() {
+        while (!done || slot.load()) {
+            if (auto buf = slot.exchange(nullptr)) {
+                delete buf;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        auto buf = new Buffer::Ptr(create());
+        Buffer::Ptr* expected = nullptr;
+        while (!slot.compare_exchange_weak(expected, buf)) {
+            expected = nullptr;
+            std::this_thread::yield();
+        }
+    }
+    done = true;
+    consumer.join();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+class HeapBuffer : public Buffer {
+public:
+    explicit HeapBuffer(size_t capacity) : data_(new char[capacity]), capacity_(capacity) {}
+    ~HeapBuffer() override { delete[] data_; }
+    char* data() const override { return data_; }
+    size_t size() const override { return 0; }
+    std::string toString() const override { return std::string(); }
+    size_t getCapacity() const override { return capacity_; }
+
+private:
+    char* data_;
+    size_t capacity_;
+};
+
+TEST(BufferArenaBenchmark, CreateAndFree) {
+    constexpr int kCount = 1000000;
+    for (size_t size : {1024, 128 * 1024}) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kCount; ++i) {
+            Buffer::Ptr buf = std::make_shared<HeapBuffer>(size);
+        }
+        auto heap_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / kCount;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kCount; ++i) {
+            Buffer::Ptr buf = BufferRaw::create(size);
+        }
+        auto arena_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / kCount;
+        std::cout << size << " bytes, same thread: heap " << heap_ns << " ns, arena " << arena_ns << " ns" << std::endl;
+    }
+    auto heap_ns = pingPong([]() { return std::make_shared<HeapBuffer>(4096); }, kCount / 10);
+    auto arena_ns = pingPong([]() { return BufferRaw::create(4096); }, kCount / 10);
+    std::cout << "4096 bytes, cross thread: heap " << heap_ns << " ns, arena " << arena_ns << " ns" << std::endl;
+    std::cout << "arena alloc: " << BufferArena::allocCount() << ", malloc: " << BufferArena::mallocCount()
+              << ", in use: " << BufferArena::bytesInUse() << ", cached: " << BufferArena::bytesCached() << std::endl;
+}
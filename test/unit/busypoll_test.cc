@@ -0,0 +1,203 @@
+/*
+ * 测试EventPoller的忙轮询模式和epoll_wait批量大小自适应
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "socket.h"
+#include "threadpool.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 单独创建一个指定忙轮询时长的poller, 不影响EventPollerPool
+class BusyPoller : public TaskExecutorGetterImpl {
+public:
+    explicit BusyPoller(uint64_t usec) {
+        EventPollerPool::setBusyPoll(usec);
+        addPoller("busy poller", 1, Thread_Priority::Highest, false, false);
+        EventPollerPool::setBusyPoll(0);
+    }
+
+    EventPoller::Ptr poller() { return std::static_pointer_cast<EventPoller>(threads_.front()); }
+};
+
+static int getSockBusyPoll(int fd) {
+    int usec = 0;
+    socklen_t len = sizeof(usec);
+    getsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, &len);
+    return usec;
+}
+
+// EventPollerPool的设置应用到已经运行的poller; socket的SO_BUSY_POLL单独设置, 只影响udp socket和tcp连接
+TEST(BusyPollTest, PoolSetting) {
+    auto& pool = EventPollerPool::Instance();
+    EventPollerPool::setBusyPoll(100);
+    EventPollerPool::setSockBusyPoll(50);
+    pool.forEach([](const TaskExecutor::Ptr& executor) {
+        auto poller = std::static_pointer_cast<EventPoller>(executor);
+        EXPECT_EQ(poller->getBusyPoll(), 100u);
+        EXPECT_EQ(poller->getSockBusyPoll(), 50);
+    });
+    EventPollerPool::setBusyPoll(0);
+    EXPECT_EQ(pool.getPoller()->getBusyPoll(), 0u);
+    EXPECT_EQ(pool.getPoller()->getSockBusyPoll(), 50);
+
+    auto poller = pool.getPoller();
+    auto udp = Socket::createSocket(poller, false);
+    ASSERT_TRUE(udp->bindUdpSock(0, "127.0.0.1"));
+    auto listener = Socket::createSocket(poller, false);
+    ASSERT_TRUE(listener->listen(0, "127.0.0.1"));
+    Socket::Ptr accepted;
+    listener->setOnAccept([&](Socket::Ptr& sock, std::shared_ptr<void>&) { accepted = sock; });
+    auto client = Socket::createSocket(poller, false);
+    std::atomic<bool> connected{false};
+    client->connect("127.0.0.1", listener->getLocalPort(), [&](const SockException& ex) {
+        EXPECT_FALSE(ex);
+        connected = true;
+    });
+    for (int i = 0; i < 100 && !(connected && accepted); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(connected && accepted);
+    // 调大SO_BUSY_POLL需要CAP_NET_ADMIN权限
+    if (geteuid() == 0) {
+        poller->sync([&]() {
+            EXPECT_EQ(getSockBusyPoll(udp->rawFd()), 50);
+            EXPECT_EQ(getSockBusyPoll(client->rawFd()), 50);
+            EXPECT_EQ(getSockBusyPoll(accepted->rawFd()), 50);
+            EXPECT_EQ(getSockBusyPoll(listener->rawFd()), 0);
+        });
+    }
+    EventPollerPool::setSockBusyPoll(0);
+    poller->sync([&]() {
+        accepted->closeSock();
+        client->closeSock();
+        listener->closeSock();
+        udp->closeSock();
+    });
+}
+
+// 忙轮询期间投递的任务不需要唤醒也能执行, 并统计忙轮询和休眠时长
+TEST(BusyPollTest, SpinAndSleep) {
+    BusyPoller getter(2000);
+    auto poller = getter.poller();
+    EXPECT_EQ(poller->getBusyPoll(), 2000u);
+
+    std::atomic<int> count{0};
+    for (int i = 0; i < 100; ++i) {
+        poller->async([&count]() { ++count; }, false);
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    while (count < 100) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_GT(poller->spinTime(), 0u);
+    EXPECT_GT(poller->sleepTime(), 0u);
+    std::cout << "spin: " << poller->spinTime() << " us, sleep: " << poller->sleepTime() << " us" << std::endl;
+
+    // 关闭忙轮询后不再累计忙轮询时长
+    poller->sync([&]() { poller->setBusyPoll(0); });
+    auto spin = poller->spinTime();
+    poller->async([]() {}, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(poller->spinTime(), spin);
+}
+
+// 忙轮询时长不能超过最近一个定时任务的超时时间
+TEST(BusyPollTest, DelayTask) {
+    BusyPoller getter(5 * 1000 * 1000);
+    auto poller = getter.poller();
+    std::atomic<bool> done{false};
+    auto start = std::chrono::steady_clock::now();
+    poller->doDelayTask(20, [&]() {
+        done = true;
+        return 0;
+    });
+    while (!done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_GE(ms, 20);
+    EXPECT_LT(ms, 2000);
+}
+
+// 同时就绪的fd数量超过epoll_wait批量大小时, 所有事件依然能被分发
+TEST(BusyPollTest, ManyReadyFds) {
+    BusyPoller getter(0);
+    auto poller = getter.poller();
+    constexpr int kPairs = 2000;
+    std::vector<int> fds(kPairs * 2);
+    std::atomic<int> count{0};
+    for (int i = 0; i < kPairs; ++i) {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, &fds[i * 2]), 0);
+        int fd = fds[i * 2];
+        poller->addEvent(fd, EventPoller::Poll_Event::Read_Event, [fd, &count](EventPoller::Poll_Event) {
+            char buf[16];
+            while (read(fd, buf, sizeof(buf)) > 0) {}
+            ++count;
+        });
+    }
+    for (int round = 1; round <= 3; ++round) {
+        for (int i = 0; i < kPairs; ++i) {
+            ASSERT_EQ(write(fds[i * 2 + 1], "a", 1), 1);
+        }
+        for (int i = 0; i < 1000 && count < kPairs * round; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_EQ(count, kPairs * round);
+    }
+    poller->sync([&]() {
+        for (int i = 0; i < kPairs; ++i) {
+            poller->delEvent(fds[i * 2]);
+        }
+    });
+    for (auto fd : fds) {
+        close(fd);
+    }
+}
+
+// 通过socketpair一来一回, 对比开启忙轮询前后的事件延时
+TEST(BusyPollTest, Benchmark) {
+    for (uint64_t usec : {0, 200}) {
+        if (usec && std::thread::hardware_concurrency() < 2) {
+            std::cout << "busy poll needs a dedicated cpu, skip" << std::endl;
+            break;
+        }
+        BusyPoller getter(usec);
+        auto poller = getter.poller();
+        int fds[2];
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+        poller->addEvent(fds[0], EventPoller::Poll_Event::Read_Event, [&](EventPoller::Poll_Event) {
+            char buf[64];
+            int n;
+            while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+                write(fds[0], buf, n);
+            }
+        });
+
+        constexpr int kCount = 10000;
+        char c = 'a';
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kCount; ++i) {
+            write(fds[1], &c, 1);
+            while (read(fds[1], &c, 1) != 1) {
+                std::this_thread::yield();
+            }
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "busy poll " << usec << " us, ping-pong: " << ns / kCount << " ns, spin: "
+                  << poller->spinTime() << " us, sleep: " << poller->sleepTime() << " us" << std::endl;
+        poller->sync([&]() { poller->delEvent(fds[0]); });
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
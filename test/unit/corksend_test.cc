@@ -0,0 +1,173 @@
+/*
+ * 测试SocketHelper的合并发送: 开启后send只写入发送缓存, poller在本轮io事件和任务处理完后对每个socket发送一次,
+ * 通过替换send和sendmsg统计流水线请求的应答写入次数, 并对比逐条发送的耗时
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "socket.h"
+#include <dlfcn.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+static std::atomic<int> s_watch_fd{-1};
+static std::atomic<size_t> s_write_count{0};
+
+// 替换libc的send和sendmsg, 统计对s_watch_fd的写入次数
+extern "C" ssize_t send(int fd, const void* buf, size_t len, int flags) {
+    using Send = ssize_t (*)(int, const void*, size_t, int);
+    static auto real = reinterpret_cast<Send>(dlsym(RTLD_NEXT, "send"));
+    if (fd == s_watch_fd) {
+        ++s_write_count;
+    }
+    return real(fd, buf, len, flags);
+}
+
+extern "C" ssize_t sendmsg(int fd, const struct msghdr* msg, int flags) {
+    using SendMsg = ssize_t (*)(int, const struct msghdr*, int);
+    static auto real = reinterpret_cast<SendMsg>(dlsym(RTLD_NEXT, "sendmsg"));
+    if (fd == s_watch_fd) {
+        ++s_write_count;
+    }
+    return real(fd, msg, flags);
+}
+
+// 收到的每一行请求原样作为一条应答返回
+class PipelineHelper : public SocketHelper {
+public:
+    PipelineHelper(const Socket::Ptr& sock) : SocketHelper(sock) {}
+
+    void onRecv(const Buffer::Ptr& buf) override {
+        pending_.append(buf->data(), buf->size());
+        size_t pos;
+        while ((pos = pending_.find('\n')) != std::string::npos) {
+            send(pending_.substr(0, pos + 1));
+            pending_.erase(0, pos + 1);
+        }
+    }
+    void onErr(const SockException&) override {}
+    void onFlush() override {}
+    void onManager() override {}
+
+private:
+    std::string pending_;
+};
+
+// 服务端交给PipelineHelper处理, 客户端由测试线程直接读写
+class PipelinePair {
+public:
+    explicit PipelinePair(bool cork) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds_);
+        auto sock = Socket::createSocket(EventPollerPool::Instance().getPoller(), false);
+        sock->fromSock(fds_[0], SockNum::SockType::TCP);
+        helper_ = std::make_shared<PipelineHelper>(sock);
+        helper_->setSendCork(cork);
+        std::weak_ptr<PipelineHelper> weak_helper = helper_;
+        sock->setOnRead([weak_helper](Buffer::Ptr& buf, struct sockaddr*, int) {
+            if (auto helper = weak_helper.lock()) {
+                helper->onRecv(buf);
+            }
+        });
+        s_watch_fd = sock->rawFd();
+        s_write_count = 0;
+    }
+    ~PipelinePair() {
+        s_watch_fd = -1;
+        helper_->getSock()->closeSock();
+        close(fds_[1]);
+    }
+    const std::shared_ptr<PipelineHelper>& helper() const { return helper_; }
+
+    // 一次写入count条请求, 读回全部应答
+    std::string request(size_t count) {
+        std::string req;
+        for (size_t i = 0; i < count; ++i) {
+            req += "request-" + std::to_string(i) + "\n";
+        }
+        EXPECT_EQ(::write(fds_[1], req.data(), req.size()), static_cast<ssize_t>(req.size()));
+        EXPECT_EQ(read(req.size()), req);
+        return req;
+    }
+
+    std::string read(size_t size) {
+        std::string ret;
+        char buf[16 * 1024];
+        while (ret.size() < size) {
+            auto n = ::read(fds_[1], buf, sizeof(buf));
+            if (n <= 0) {
+                break;
+            }
+            ret.append(buf, n);
+        }
+        return ret;
+    }
+
+private:
+    int fds_[2];
+    std::shared_ptr<PipelineHelper> helper_;
+};
+
+// 同一次读事件中产生的应答合并为一次写入
+TEST(CorkSendTest, Pipeline) {
+    constexpr size_t kRequests = 100;
+    {
+        PipelinePair pair(false);
+        pair.request(kRequests);
+        EXPECT_EQ(s_write_count, kRequests);
+    }
+    {
+        PipelinePair pair(true);
+        pair.request(kRequests);
+        EXPECT_EQ(s_write_count, 1u);
+        // 下一批请求在新的一轮循环中再发送一次
+        pair.request(kRequests);
+        EXPECT_EQ(s_write_count, 2u);
+    }
+}
+
+// 其他线程发送时投递的flush任务被合并: poller忙于其他任务期间写入的数据只发送一次, 数据完整且按顺序
+TEST(CorkSendTest, SendFromThread) {
+    PipelinePair pair(true);
+    std::atomic<bool> sent{false};
+    pair.helper()->getPoller()->async([&]() {
+        while (!sent) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    std::string expect;
+    std::thread sender([&]() {
+        for (int i = 0; i < 1000; ++i) {
+            pair.helper()->send("message-" + std::to_string(i) + "\n");
+        }
+        sent = true;
+    });
+    for (int i = 0; i < 1000; ++i) {
+        expect += "message-" + std::to_string(i) + "\n";
+    }
+    EXPECT_EQ(pair.read(expect.size()), expect);
+    sender.join();
+    EXPECT_EQ(s_write_count, 1u);
+}
+
+// 每轮一次写入多条请求, 对比逐条发送和合并发送的耗时
+TEST(CorkSendBenchmark, Pipeline) {
+    constexpr size_t kRounds = 2000;
+    constexpr size_t kRequests = 32;
+    for (bool cork : {false, true}) {
+        PipelinePair pair(cork);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kRounds; ++i) {
+            pair.request(kRequests);
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (cork ? "cork: " : "flush per send: ") << kRounds * kRequests << " responses in " << us / 1000
+                  << " ms, " << s_write_count / kRounds << " writes per round" << std::endl;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * 测试FdTable以及EventPoller基于fd下标的事件分发
+ */
+#include <gtest/gtest.h>
+#include "fdtable.h"
+#include "eventpoller.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+using namespace xkernel;
+
+TEST(FdTableTest, GetAndAt) {
+    FdTable<int> table;
+    EXPECT_EQ(table.get(0), nullptr);
+    EXPECT_EQ(table.get(-1), nullptr);
+    table.at(5) = 55;
+    ASSERT_NE(table.get(5), nullptr);
+    EXPECT_EQ(*table.get(5), 55);
+    EXPECT_EQ(*table.get(6), 0);  // 同一页的其他元素已分配
+    EXPECT_EQ(table.get(100000), nullptr);
+
+    // 分配新的页后, 已有元素的地址不变
+    auto ptr = table.get(5);
+    table.at(100000) = 1;
+    EXPECT_EQ(table.get(5), ptr);
+    EXPECT_EQ(*table.get(100000), 1);
+}
+
+// 在回调中删除自身后重新添加同一个fd, 本轮已取出的旧事件不会分发给新的回调
+TEST(FdTableTest, DeleteInCallback) {
+    EventPollerPool::setPoolSize(1);
+    auto poller = EventPollerPool::Instance().getFirstPoller();
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+
+    std::atomic<int> old_count{0};
+    std::atomic<int> new_count{0};
+    poller->sync([&]() {
+        poller->addEvent(fds[0], EventPoller::Poll_Event::Read_Event, [&](EventPoller::Poll_Event) {
+            ++old_count;
+            poller->delEvent(fds[0]);
+            poller->addEvent(fds[0], EventPoller::Poll_Event::Read_Event, [&](EventPoller::Poll_Event) {
+                char buf[16];
+                while (read(fds[0], buf, sizeof(buf)) > 0) {}
+                ++new_count;
+            });
+        });
+    });
+    ASSERT_EQ(write(fds[1], "a", 1), 1);
+    for (int i = 0; i < 100 && new_count == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(old_count, 1);
+    EXPECT_EQ(new_count, 1);  // 新回调注册时数据已就绪, 会触发一次
+
+    poller->sync([&]() { poller->delEvent(fds[0]); });
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 对比哈希表+shared_ptr拷贝与fd下标查找的分发开销
+TEST(FdTableTest, Benchmark) {
+    using Callback = std::function<void(int)>;
+    constexpr int kFds = 10000;
+    constexpr int kRounds = 200;
+    uint64_t sum = 0;
+    Callback cb = [&sum](int v) { sum += v; };
+
+    std::unordered_map<int, std::shared_ptr<Callback>> map;
+    FdTable<std::unique_ptr<Callback>> table;
+    for (int fd = 0; fd < kFds; ++fd) {
+        map.emplace(fd, std::make_shared<Callback>(cb));
+        table.at(fd) = std::make_unique<Callback>(cb);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+        for (int fd = 0; fd < kFds; ++fd) {
+            auto it = map.find(fd);
+            auto copy = it->second;
+            (*copy)(fd);
+        }
+    }
+    auto map_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+        for (int fd = 0; fd < kFds; ++fd) {
+            (**table.get(fd))(fd);
+        }
+    }
+    auto table_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(sum, 2ull * kRounds * (uint64_t(kFds) * (kFds - 1) / 2));
+    std::cout << "unordered_map dispatch: " << static_cast<double>(map_ns) / (kFds * kRounds) << " ns/event, "
+              << "fdtable dispatch: " << static_cast<double>(table_ns) / (kFds * kRounds) << " ns/event" << std::endl;
+}
@@ -0,0 +1,291 @@
+/*
+ * 测试io_uring事件轮询后端
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "socket.h"
+#include "threadpool.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace xkernel;
+
+// 单独创建一个指定后端的poller, 不影响EventPollerPool
+class UringPoller : public TaskExecutorGetterImpl {
+public:
+    explicit UringPoller(bool enable = true) {
+        EventPollerPool::enableIoUring(enable);
+        addPoller("uring poller", 1, Thread_Priority::Highest, false, false);
+        EventPollerPool::enableIoUring(false);
+    }
+
+    EventPoller::Ptr poller() { return std::static_pointer_cast<EventPoller>(threads_.front()); }
+};
+
+class IoUringTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        poller_ = getter_.poller();
+        if (!poller_->useIoUring()) {
+            GTEST_SKIP() << "io_uring is not supported";
+        }
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds_), 0);
+    }
+
+    void TearDown() override {
+        if (fds_[0] != -1) {
+            poller_->sync([this]() { poller_->delEvent(fds_[0]); });
+            close(fds_[0]);
+            close(fds_[1]);
+        }
+    }
+
+    static void waitFor(const std::function<bool()>& cond) {
+        for (int i = 0; i < 1000 && !cond(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    UringPoller getter_;
+    EventPoller::Ptr poller_;
+    int fds_[2] = {-1, -1};
+};
+
+// 边沿触发: 每次有新数据到达时回调一次
+TEST_F(IoUringTest, EdgeTriggered) {
+    std::atomic<int> count{0};
+    EXPECT_EQ(poller_->addEvent(fds_[0], EventPoller::Poll_Event::Read_Event, [&](EventPoller::Poll_Event event) {
+        EXPECT_TRUE(!(event & EventPoller::Poll_Event::Read_Event));
+        char buf[16];
+        while (read(fds_[0], buf, sizeof(buf)) > 0) {}
+        ++count;
+    }), 0);
+    for (int i = 1; i <= 3; ++i) {
+        ASSERT_EQ(write(fds_[1], "a", 1), 1);
+        waitFor([&]() { return count == i; });
+        EXPECT_EQ(count, i);
+    }
+}
+
+// 水平触发: 数据未读完时会持续回调
+TEST_F(IoUringTest, LevelTriggered) {
+    std::atomic<int> count{0};
+    poller_->addEvent(fds_[0], EventPoller::Poll_Event::Read_Event | EventPoller::Poll_Event::Event_LT,
+                      [&](EventPoller::Poll_Event) {
+        if (++count >= 3) {
+            char buf[16];
+            while (read(fds_[0], buf, sizeof(buf)) > 0) {}
+        }
+    });
+    ASSERT_EQ(write(fds_[1], "a", 1), 1);
+    waitFor([&]() { return count >= 3; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(count, 3);
+}
+
+// 修改监听事件和删除事件
+TEST_F(IoUringTest, ModifyAndDelete) {
+    std::atomic<int> reads{0};
+    std::atomic<int> writes{0};
+    poller_->addEvent(fds_[0], EventPoller::Poll_Event::Read_Event, [&](EventPoller::Poll_Event event) {
+        if (!(event & EventPoller::Poll_Event::Read_Event)) {
+            ++reads;
+        }
+        if (!(event & EventPoller::Poll_Event::Write_Event)) {
+            ++writes;
+        }
+    });
+    poller_->modifyEvent(fds_[0], EventPoller::Poll_Event::Write_Event);
+    waitFor([&]() { return writes > 0; });
+    EXPECT_GT(writes, 0);
+
+    int ret = 0;
+    poller_->sync([&]() { ret = poller_->delEvent(fds_[0]); });
+    EXPECT_EQ(ret, 0);
+    reads = writes = 0;
+    ASSERT_EQ(write(fds_[1], "a", 1), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(reads, 0);
+    EXPECT_EQ(writes, 0);
+}
+
+// 无效fd与重复添加
+TEST_F(IoUringTest, InvalidFd) {
+    int ret = 0;
+    poller_->sync([&]() { ret = poller_->addEvent(-1, EventPoller::Poll_Event::Read_Event, [](EventPoller::Poll_Event) {}); });
+    EXPECT_EQ(ret, -1);
+    poller_->sync([&]() {
+        poller_->addEvent(fds_[0], EventPoller::Poll_Event::Read_Event, [](EventPoller::Poll_Event) {});
+        ret = poller_->addEvent(fds_[0], EventPoller::Poll_Event::Read_Event, [](EventPoller::Poll_Event) {});
+    });
+    EXPECT_EQ(ret, -1);
+}
+
+// 异步任务和延时任务
+TEST_F(IoUringTest, AsyncAndDelay) {
+    std::atomic<bool> async_done{false};
+    std::atomic<bool> delay_done{false};
+    poller_->async([&]() { async_done = true; });
+    auto start = std::chrono::steady_clock::now();
+    poller_->doDelayTask(50, [&]() {
+        delay_done = true;
+        return 0;
+    });
+    waitFor([&]() { return async_done && delay_done; });
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_TRUE(async_done);
+    EXPECT_TRUE(delay_done);
+    EXPECT_GE(ms, 50);
+}
+
+// multishot recv持续收到数据, 串联的发送按提交顺序到达, delEvent后不再回调
+TEST_F(IoUringTest, AsyncRecvAndLinkedSend) {
+    if (!poller_->supportAsyncIo()) {
+        GTEST_SKIP() << "io_uring async io is not supported";
+    }
+    std::string received;
+    std::atomic<size_t> received_size{0};
+    std::atomic<int> recv_count{0};
+    std::atomic<int> send_count{0};
+    std::string parts[3] = {std::string(100000, 'a'), std::string(100000, 'b'), std::string(100000, 'c')};
+    struct iovec iov[3];
+    struct msghdr msg[3];
+    poller_->sync([&]() {
+        EXPECT_NE(poller_->addRecv(fds_[1], [&](const char* data, ssize_t len) {
+            if (len > 0) {
+                received.append(data, len);
+                received_size = received.size();
+            }
+            ++recv_count;
+        }), 0u);
+        for (int i = 0; i < 3; ++i) {
+            iov[i].iov_base = &parts[i][0];
+            iov[i].iov_len = parts[i].size();
+            memset(&msg[i], 0, sizeof(msg[i]));
+            msg[i].msg_iov = &iov[i];
+            msg[i].msg_iovlen = 1;
+            EXPECT_NE(poller_->addSend(fds_[0], &msg[i], i < 2, [&, i](ssize_t ret) {
+                EXPECT_EQ(ret, static_cast<ssize_t>(parts[i].size()));
+                ++send_count;
+            }), 0u);
+        }
+    });
+    waitFor([&]() { return send_count == 3 && received_size == 300000; });
+    poller_->sync([&]() {
+        EXPECT_EQ(received, parts[0] + parts[1] + parts[2]);
+        poller_->delEvent(fds_[1]);
+    });
+    auto count = recv_count.load();
+    ASSERT_EQ(write(fds_[0], "a", 1), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(recv_count, count);
+}
+
+// Socket在io_uring poller上通过multishot accept接收连接, 异步接收并原样回发大量数据
+TEST(IoUringSocket, Echo) {
+    UringPoller getter;
+    auto poller = getter.poller();
+    if (!poller->supportAsyncIo()) {
+        GTEST_SKIP() << "io_uring async io is not supported";
+    }
+    auto server = Socket::createSocket(poller, false);
+    std::vector<Socket::Ptr> sessions;
+    server->setOnAccept([&](Socket::Ptr& sock, std::shared_ptr<void>&) {
+        std::weak_ptr<Socket> weak_sock = sock;
+        sock->setOnRead([weak_sock](Buffer::Ptr& buf, struct sockaddr*, int) {
+            if (auto sock = weak_sock.lock()) {
+                sock->send(buf);
+            }
+        });
+        sessions.emplace_back(sock);
+    });
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), len), 0);
+    ASSERT_EQ(::listen(listen_fd, 16), 0);
+    getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    ASSERT_TRUE(server->fromSock(listen_fd, SockNum::SockType::TCP_Server));
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+
+    // 一边发一边收, 避免两端的socket缓冲区都被填满
+    constexpr size_t kSize = 8 * 1024 * 1024;
+    std::thread sender([fd]() {
+        std::string data(64 * 1024, 0);
+        for (size_t sent = 0; sent < kSize; sent += data.size()) {
+            for (size_t i = 0; i < data.size(); ++i) {
+                data[i] = static_cast<char>((sent + i) % 251);
+            }
+            ::send(fd, data.data(), data.size(), 0);
+        }
+    });
+    size_t total = 0;
+    bool match = true;
+    char buf[64 * 1024];
+    while (total < kSize) {
+        auto n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        for (ssize_t i = 0; i < n; ++i) {
+            match = match && buf[i] == static_cast<char>((total + i) % 251);
+        }
+        total += n;
+    }
+    sender.join();
+    EXPECT_EQ(total, kSize);
+    EXPECT_TRUE(match);
+    close(fd);
+    poller->sync([&]() {
+        sessions.clear();
+        server = nullptr;
+    });
+}
+
+// 通过socketpair一来一回, 对比epoll和io_uring的事件延时
+TEST(IoUringBenchmark, PingPong) {
+    for (bool enable : {false, true}) {
+        UringPoller getter(enable);
+        auto poller = getter.poller();
+        if (enable && !poller->useIoUring()) {
+            break;
+        }
+        int fds[2];
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+        std::atomic<int> count{0};
+        poller->addEvent(fds[0], EventPoller::Poll_Event::Read_Event, [&](EventPoller::Poll_Event) {
+            char buf[64];
+            int n;
+            while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+                write(fds[0], buf, n);
+            }
+        });
+
+        constexpr int kCount = 20000;
+        char c = 'a';
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kCount; ++i) {
+            write(fds[1], &c, 1);
+            while (read(fds[1], &c, 1) != 1) {
+                std::this_thread::yield();
+            }
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (enable ? "io_uring" : "epoll") << " ping-pong: " << ns / kCount << " ns" << std::endl;
+        poller->sync([&]() { poller->delEvent(fds[0]); });
+        close(fds[0]);
+        close(fds[1]);
+    }
+}
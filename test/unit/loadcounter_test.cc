@@ -0,0 +1,104 @@
+/*
+ * 测试ThreadLoadCounter的负载计算, 以及其他线程并发读取负载
+ */
+#include <gtest/gtest.h>
+#include "taskexecutor.h"
+#include "threadpool.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+static void busyFor(int ms) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end) {}
+}
+
+// 运行和休眠各占一半时, 负载约为50%
+TEST(LoadCounterTest, Ratio) {
+    ThreadLoadCounter counter(32, 2 * 1000 * 1000);
+    counter.startSleep();
+    for (int i = 0; i < 10; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        counter.sleepWakeUp();
+        busyFor(10);
+        counter.startSleep();
+    }
+    auto load = counter.load();
+    EXPECT_GT(load, 25);
+    EXPECT_LT(load, 75);
+    EXPECT_GE(counter.sleepTime(), 90u * 1000);
+}
+
+// 当前状态持续超过统计窗口时, 负载只取决于当前状态
+TEST(LoadCounterTest, Window) {
+    ThreadLoadCounter counter(32, 50 * 1000);
+    counter.startSleep();
+    counter.sleepWakeUp();
+    busyFor(60);
+    EXPECT_EQ(counter.load(), 100);
+    counter.startSleep();
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    EXPECT_EQ(counter.load(), 0);
+}
+
+// 样本数量超过max_size后丢弃最早的记录
+TEST(LoadCounterTest, MaxSize) {
+    ThreadLoadCounter counter(4, 10 * 1000 * 1000);
+    counter.startSleep();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    counter.sleepWakeUp();
+    // 之后的4条记录都很短, 50ms的休眠记录被挤出
+    for (int i = 0; i < 2; ++i) {
+        busyFor(5);
+        counter.startSleep();
+        counter.sleepWakeUp();
+    }
+    busyFor(5);
+    EXPECT_GT(counter.load(), 75);
+}
+
+// 被统计线程频繁切换状态的同时, 其他线程读取负载, 结果始终在0~100之间
+TEST(LoadCounterTest, ConcurrentLoad) {
+    ThreadLoadCounter counter(32, 2 * 1000 * 1000);
+    std::atomic<bool> done{false};
+    std::thread owner([&]() {
+        for (int i = 0; i < 200000; ++i) {
+            counter.startSleep();
+            counter.sleepWakeUp();
+        }
+        done = true;
+    });
+    uint64_t reads = 0;
+    while (!done) {
+        auto load = counter.load();
+        ASSERT_GE(load, 0);
+        ASSERT_LE(load, 100);
+        ++reads;
+    }
+    owner.join();
+    std::cout << "load() called " << reads << " times while owner switching" << std::endl;
+}
+
+// 从多个线程调用getExecutor选择poller
+TEST(LoadCounterTest, GetExecutorBenchmark) {
+    auto& pool = EventPollerPool::Instance();
+    constexpr int kCount = 100000;
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&pool]() {
+            for (int i = 0; i < kCount; ++i) {
+                pool.getExecutor();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << pool.getExecutorSize() << " pollers, getExecutor: " << ns / (4 * kCount) << " ns" << std::endl;
+}
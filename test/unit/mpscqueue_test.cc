@@ -0,0 +1,155 @@
+/*
+ * 测试MpscQueue、MpscLinkedQueue以及EventPoller::async的跨线程投递
+ */
+#include <gtest/gtest.h>
+#include "mpscqueue.h"
+#include "eventpoller.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 容量向上取整为2的幂, 满了之后tryPush失败
+TEST(MpscQueueTest, Capacity) {
+    MpscQueue<int> queue(100);
+    EXPECT_EQ(queue.capacity(), 128u);
+    EXPECT_TRUE(queue.empty());
+    for (int i = 0; i < 128; ++i) {
+        EXPECT_TRUE(queue.tryPush(int(i)));
+    }
+    EXPECT_FALSE(queue.tryPush(128));
+    int value = -1;
+    EXPECT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(value, 0);
+    EXPECT_TRUE(queue.tryPush(128));
+
+    std::vector<int> out(200);
+    EXPECT_EQ(queue.popBulk(out.begin(), out.size()), 128u);
+    EXPECT_EQ(out[0], 1);
+    EXPECT_EQ(out[127], 128);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.tryPop(value));
+}
+
+// 多个生产者并发写入, 每个生产者的消息保持先进先出
+TEST(MpscQueueTest, MultiProducer) {
+    constexpr int kProducers = 4;
+    constexpr int kCount = 200000;
+    MpscQueue<uint64_t> queue(1024);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (uint64_t i = 0; i < kCount; ++i) {
+                while (!queue.tryPush((uint64_t(p) << 32) | i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<uint64_t> next(kProducers, 0);
+    int received = 0;
+    uint64_t value;
+    while (received < kProducers * kCount) {
+        if (!queue.tryPop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        auto p = value >> 32;
+        ASSERT_LT(p, uint64_t(kProducers));
+        ASSERT_EQ(value & 0xFFFFFFFF, next[p]);
+        ++next[p];
+        ++received;
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+// 无界队列: 16个生产者边写边读, 每个生产者的消息保持先进先出, 析构时释放未取出的元素
+TEST(MpscQueueTest, Linked) {
+    constexpr int kProducers = 16;
+    constexpr int kCount = 20000;
+    MpscLinkedQueue<uint64_t> queue;
+    EXPECT_TRUE(queue.empty());
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (uint64_t i = 0; i < kCount; ++i) {
+                queue.push((uint64_t(p) << 32) | i);
+            }
+        });
+    }
+
+    std::vector<uint64_t> next(kProducers, 0);
+    int received = 0;
+    uint64_t value;
+    while (received < kProducers * kCount) {
+        if (!queue.tryPop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        auto p = value >> 32;
+        ASSERT_LT(p, uint64_t(kProducers));
+        ASSERT_EQ(value & 0xFFFFFFFF, next[p]);
+        ++next[p];
+        ++received;
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    EXPECT_TRUE(queue.empty());
+
+    MpscLinkedQueue<std::shared_ptr<int>> left;
+    auto item = std::make_shared<int>(1);
+    left.push(item);
+    left.push(item);
+    EXPECT_EQ(item.use_count(), 3);
+    {
+        MpscLinkedQueue<std::shared_ptr<int>> tmp;
+        tmp.push(item);
+        EXPECT_EQ(item.use_count(), 4);
+    }
+    EXPECT_EQ(item.use_count(), 3);
+}
+
+// 多线程通过async投递任务, 超过无锁队列容量时依然保持顺序且不丢任务
+TEST(MpscQueueTest, EventPollerAsync) {
+    EventPollerPool::setPoolSize(1);
+    auto poller = EventPollerPool::Instance().getFirstPoller();
+    constexpr int kProducers = 4;
+    constexpr int kCount = 100000;
+    std::vector<int> next(kProducers, 0);
+    std::atomic<int> done{0};
+    std::atomic<bool> ordered{true};
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int i = 0; i < kCount; ++i) {
+                poller->async([&, p, i]() {
+                    if (next[p]++ != i) {
+                        ordered = false;
+                    }
+                    ++done;
+                }, false);
+            }
+        });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    while (done < kProducers * kCount) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    EXPECT_TRUE(ordered);
+    std::cout << "async tasks: " << kProducers * kCount << ", "
+              << static_cast<double>(ns) / (kProducers * kCount) << " ns/task" << std::endl;
+}
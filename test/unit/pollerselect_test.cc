@@ -0,0 +1,181 @@
+/*
+ * 测试TaskExecutorGetterImpl的poller选择策略, 对比各策略下连接在poller间的分布
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "socket.h"
+#include "threadpool.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+using SelectPolicy = TaskExecutorGetterImpl::SelectPolicy;
+
+// 单独创建一组poller, 不影响EventPollerPool
+class SelectPoller : public TaskExecutorGetterImpl {
+public:
+    explicit SelectPoller(size_t size) { addPoller("select poller", size, Thread_Priority::Highest, false, false); }
+
+    EventPoller::Ptr poller(size_t index) { return std::static_pointer_cast<EventPoller>(threads_[index]); }
+    EventPoller::Ptr getPoller() { return std::static_pointer_cast<EventPoller>(getExecutor()); }
+
+    // 等待所有poller执行完已投递的任务(Socket在所属poller线程中析构)
+    void flush() {
+        for (auto& th : threads_) {
+            th->sync([]() {});
+        }
+    }
+};
+
+// 用socketpair模拟一个已建立的tcp连接, 对端fd保存在peers中, 需要在Socket释放后关闭
+static Socket::Ptr createConnection(const EventPoller::Ptr& poller, std::vector<int>& peers) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        return nullptr;
+    }
+    peers.emplace_back(fds[1]);
+    auto sock = Socket::createSocket(poller, false);
+    sock->fromSock(fds[0], SockNum::SockType::TCP);
+    return sock;
+}
+
+static void closePeers(std::vector<int>& peers) {
+    for (auto fd : peers) {
+        close(fd);
+    }
+    peers.clear();
+}
+
+static const char* policyName(SelectPolicy policy) {
+    switch (policy) {
+        case SelectPolicy::PowerOfTwo: return "power of two";
+        case SelectPolicy::LeastConnection: return "least connection";
+        case SelectPolicy::EventWeighted: return "event weighted";
+        default: return "least load";
+    }
+}
+
+// 只有tcp连接计入所属poller的连接数, 关闭或销毁时减少; 未使用的Socket、监听socket和udp socket不计入
+TEST(PollerSelectTest, ConnectionCount) {
+    SelectPoller getter(2);
+    auto poller = getter.poller(0);
+    std::vector<int> peers;
+    EXPECT_EQ(poller->connectionCount(), 0u);
+    {
+        auto idle = Socket::createSocket(poller, false);
+        auto udp = Socket::createSocket(poller, false);
+        ASSERT_TRUE(udp->bindUdpSock(0, "127.0.0.1"));
+        auto listener = Socket::createSocket(poller, false);
+        ASSERT_TRUE(listener->listen(0, "127.0.0.1"));
+        EXPECT_EQ(poller->connectionCount(), 0u);
+
+        auto sock1 = createConnection(poller, peers);
+        auto sock2 = createConnection(poller, peers);
+        EXPECT_EQ(poller->connectionCount(), 2u);
+        EXPECT_EQ(getter.poller(1)->connectionCount(), 0u);
+        sock1->closeSock();
+        EXPECT_EQ(poller->connectionCount(), 1u);
+        sock1->closeSock();
+        EXPECT_EQ(poller->connectionCount(), 1u);
+    }
+    getter.flush();
+    EXPECT_EQ(poller->connectionCount(), 0u);
+    closePeers(peers);
+}
+
+// 按连接数选择时, 新连接总是分配到连接数最少的poller
+TEST(PollerSelectTest, LeastConnection) {
+    SelectPoller getter(4);
+    getter.setSelectPolicy(SelectPolicy::LeastConnection);
+    EXPECT_EQ(getter.getSelectPolicy(), SelectPolicy::LeastConnection);
+    std::vector<Socket::Ptr> socks;
+    std::vector<int> peers;
+    for (int i = 0; i < 10; ++i) {
+        socks.emplace_back(createConnection(getter.poller(0), peers));
+    }
+    for (int i = 0; i < 30; ++i) {
+        socks.emplace_back(createConnection(getter.getPoller(), peers));
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        EXPECT_EQ(getter.poller(i)->connectionCount(), 10u) << i;
+    }
+    socks.clear();
+    getter.flush();
+    closePeers(peers);
+}
+
+// 事件数统计周期结束后更新事件速率, 长时间没有更新时衰减
+TEST(PollerSelectTest, EventRate) {
+    SelectPoller getter(1);
+    auto poller = getter.poller(0);
+    EXPECT_EQ(poller->eventRate(), 0u);
+    poller->sync([&]() {
+        poller->addEvents(1000);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        poller->addEvents(1000);
+    });
+    auto rate = poller->eventRate();
+    EXPECT_GT(rate, 500u);
+    EXPECT_LT(rate, 1100u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+    EXPECT_LT(poller->eventRate(), rate);
+}
+
+// 模拟接入2万个连接, 其中10%为长连接, 其余很快断开, 统计各策略下长连接在poller间的分布
+TEST(PollerSelectBenchmark, Distribution) {
+    constexpr size_t kPollers = 4;
+    constexpr int kConnections = 20000;
+    for (auto policy : {SelectPolicy::LeastLoad, SelectPolicy::PowerOfTwo,
+                        SelectPolicy::LeastConnection, SelectPolicy::EventWeighted}) {
+        SelectPoller getter(kPollers);
+        getter.setSelectPolicy(policy);
+        std::vector<Socket::Ptr> alive;
+        std::vector<int> peers;
+        uint64_t select_ns = 0;
+        for (int i = 0; i < kConnections; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            auto poller = getter.getPoller();
+            select_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            std::vector<int> peer;
+            auto sock = createConnection(poller, peer);
+            if (i % 10 == 0) {
+                alive.emplace_back(std::move(sock));
+                peers.emplace_back(peer[0]);
+            } else {
+                sock.reset();
+                closePeers(peer);
+            }
+        }
+        getter.flush();
+
+        std::vector<size_t> counts;
+        for (size_t i = 0; i < kPollers; ++i) {
+            counts.emplace_back(getter.poller(i)->connectionCount());
+        }
+        double mean = static_cast<double>(alive.size()) / kPollers;
+        double var = 0;
+        for (auto count : counts) {
+            var += (count - mean) * (count - mean);
+        }
+        std::cout << policyName(policy) << ": select " << select_ns / kConnections << " ns, connections:";
+        for (auto count : counts) {
+            std::cout << " " << count;
+        }
+        std::cout << ", stddev " << std::sqrt(var / kPollers) << std::endl;
+
+        if (policy == SelectPolicy::LeastConnection || policy == SelectPolicy::PowerOfTwo) {
+            auto minmax = std::minmax_element(counts.begin(), counts.end());
+            EXPECT_LT(*minmax.second - *minmax.first, alive.size() / 10) << policyName(policy);
+        }
+        alive.clear();
+        getter.flush();
+        closePeers(peers);
+    }
+}
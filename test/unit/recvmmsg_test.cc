@@ -0,0 +1,203 @@
+/*
+ * 测试SocketRecvmmsgBuffer的接收参数: 自定义批大小和缓冲区大小、根据每次收到的个数自适应调整批大小、
+ * 复用应用没有保留的缓冲区, 以及Socket::setRecvmmsgOptions后读回调收到的数据
+ */
+#include <gtest/gtest.h>
+#include "buffersock.h"
+#include "eventpoller.h"
+#include "socket.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 回环地址上的一对非阻塞UDP socket, sender已connect到receiver
+class UdpPair {
+public:
+    UdpPair() {
+        receiver_ = bindLoopback(&addr_);
+        sender_ = bindLoopback(nullptr);
+        connect(sender_, reinterpret_cast<struct sockaddr*>(&addr_), sizeof(addr_));
+        int size = 4 * 1024 * 1024;
+        setsockopt(receiver_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    ~UdpPair() {
+        close(sender_);
+        close(receiver_);
+    }
+    void send(size_t count, size_t size = 200) {
+        std::string data(size, 'x');
+        for (size_t i = 0; i < count; ++i) {
+            data[0] = 'a' + i % 26;
+            ::send(sender_, data.data(), data.size(), 0);
+        }
+    }
+    int receiver() const { return receiver_; }
+    const struct sockaddr_in& addr() const { return addr_; }
+
+private:
+    static int bindLoopback(struct sockaddr_in* out) {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(fd, reinterpret_cast<struct sockaddr*>(&addr), len);
+        if (out) {
+            getsockname(fd, reinterpret_cast<struct sockaddr*>(out), &len);
+        }
+        return fd;
+    }
+
+private:
+    int sender_;
+    int receiver_;
+    struct sockaddr_in addr_;
+};
+
+// 读取当前所有数据包, keep不为空时保留读回调拿到的缓冲区
+static size_t recvAll(SocketRecvmmsgBuffer& buffer, int fd, std::vector<Buffer::Ptr>* keep = nullptr) {
+    size_t total = 0;
+    ssize_t count = 0;
+    while (buffer.recvFromSocket(fd, count) > 0) {
+        for (ssize_t i = 0; i < count; ++i) {
+            if (keep) {
+                keep->emplace_back(buffer.getBuffer(i));
+            }
+        }
+        total += count;
+    }
+    return total;
+}
+
+// 自定义的缓冲区大小可以接收超过默认4KB的巨型帧
+TEST(RecvmmsgTest, Geometry) {
+    UdpPair pair;
+    RecvmmsgOptions options;
+    options.count = 4;
+    options.size = 9 * 1024;
+    SocketRecvmmsgBuffer buffer(options);
+    EXPECT_EQ(buffer.batchSize(), 4u);
+    EXPECT_EQ(buffer.allocCount(), 4u);
+
+    pair.send(6, 9000);
+    ssize_t count = 0;
+    EXPECT_EQ(buffer.recvFromSocket(pair.receiver(), count), 4 * 9000);
+    EXPECT_EQ(count, 4);
+    EXPECT_EQ(buffer.getBuffer(0)->size(), 9000u);
+    EXPECT_EQ(buffer.getBuffer(0)->data()[0], 'a');
+    EXPECT_EQ(buffer.getBuffer(3)->data()[0], 'd');
+    EXPECT_EQ(buffer.recvFromSocket(pair.receiver(), count), 2 * 9000);
+    EXPECT_EQ(count, 2);
+}
+
+// 持续只收到少量数据包时批大小减小, 连续收满后成倍增大, 不超过count
+TEST(RecvmmsgTest, AdaptiveBatch) {
+    UdpPair pair;
+    RecvmmsgOptions options;
+    options.count = 64;
+    options.adaptive = true;
+    SocketRecvmmsgBuffer buffer(options);
+    EXPECT_EQ(buffer.batchSize(), 64u);
+
+    for (int i = 0; i < 100; ++i) {
+        pair.send(1);
+        EXPECT_EQ(recvAll(buffer, pair.receiver()), 1u);
+    }
+    EXPECT_EQ(buffer.batchSize(), 4u);
+
+    for (int i = 0; i < 10; ++i) {
+        pair.send(256);
+        EXPECT_EQ(recvAll(buffer, pair.receiver()), 256u);
+    }
+    EXPECT_EQ(buffer.batchSize(), 64u);
+}
+
+// 开启复用后应用没有保留的缓冲区原地复用, 不再分配; 应用保留的缓冲区释放后被回收
+TEST(RecvmmsgTest, Recycle) {
+    UdpPair pair;
+    RecvmmsgOptions options;
+    options.count = 16;
+    options.recycle = true;
+    SocketRecvmmsgBuffer buffer(options);
+    auto allocated = buffer.allocCount();
+
+    for (int i = 0; i < 100; ++i) {
+        pair.send(16);
+        EXPECT_EQ(recvAll(buffer, pair.receiver()), 16u);
+    }
+    EXPECT_EQ(buffer.allocCount(), allocated);
+
+    // 保留一批后, 被保留的槽位换成新缓冲区, 数据不被覆盖
+    std::vector<Buffer::Ptr> kept;
+    pair.send(16);
+    EXPECT_EQ(recvAll(buffer, pair.receiver(), &kept), 16u);
+    pair.send(16);
+    EXPECT_EQ(recvAll(buffer, pair.receiver()), 16u);
+    allocated = buffer.allocCount();
+    EXPECT_GT(allocated, 16u);
+    for (size_t i = 0; i < kept.size(); ++i) {
+        EXPECT_EQ(kept[i]->data()[0], static_cast<char>('a' + i % 26));
+        EXPECT_EQ(kept[i]->size(), 200u);
+    }
+
+    // 释放后再次保留时从回收的缓冲区中取, 不再分配
+    kept.clear();
+    for (int i = 0; i < 10; ++i) {
+        pair.send(16);
+        EXPECT_EQ(recvAll(buffer, pair.receiver(), &kept), 16u);
+        pair.send(16);
+        EXPECT_EQ(recvAll(buffer, pair.receiver()), 16u);
+        kept.clear();
+    }
+    EXPECT_EQ(buffer.allocCount(), allocated);
+}
+
+// Socket使用自定义接收参数后读回调仍能收到全部数据包
+TEST(RecvmmsgTest, SocketOptions) {
+    auto poller = EventPollerPool::Instance().getPoller();
+    auto sock = Socket::createSocket(poller, false);
+    ASSERT_TRUE(sock->bindUdpSock(0, "127.0.0.1"));
+    RecvmmsgOptions options;
+    options.count = 8;
+    options.size = 16 * 1024;
+    options.recycle = true;
+    options.adaptive = true;
+    sock->setRecvmmsgOptions(options);
+
+    std::atomic<size_t> received{0};
+    std::atomic<size_t> bytes{0};
+    sock->setOnRead([&](Buffer::Ptr& buf, struct sockaddr*, int) {
+        ++received;
+        bytes += buf->size();
+    });
+
+    // 等待接收参数在poller线程生效
+    poller->sync([]() {});
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(sock->getLocalPort());
+    std::string data(10000, 'x');
+    for (int i = 0; i < 100; ++i) {
+        sendto(fd, data.data(), data.size(), 0, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    }
+    close(fd);
+
+    for (int i = 0; i < 100 && received < 100; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(received, 100u);
+    EXPECT_EQ(bytes, 100u * 10000);
+    sock->closeSock();
+}
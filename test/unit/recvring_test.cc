@@ -0,0 +1,177 @@
+/*
+ * 测试TCP共享接收环: 切片的内容、跨内存块读取、内存块的复用, 并与每次读取分配新缓冲区的方式对比
+ */
+#include <gtest/gtest.h>
+#include "buffersock.h"
+#include "eventpoller.h"
+#include "socket.h"
+#include "threadpool.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+class SocketPair {
+public:
+    SocketPair() { socketpair(AF_UNIX, SOCK_STREAM, 0, fds_); }
+    ~SocketPair() {
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+    void write(const std::string& data) { ASSERT_EQ(::write(fds_[1], data.data(), data.size()), (ssize_t)data.size()); }
+    int readFd() const { return fds_[0]; }
+
+private:
+    int fds_[2];
+};
+
+// 每次读取得到只引用所读区域的切片, 切片之后写入'\0'
+TEST(RecvRingTest, Slice) {
+    SocketPair pair;
+    SocketRecvRingBuffer ring(8192, 2);
+    ssize_t count = 0;
+    pair.write("hello");
+    ASSERT_EQ(ring.recvFromSocket(pair.readFd(), count), 5);
+    EXPECT_EQ(count, 1);
+    auto first = ring.getBuffer(0);
+    EXPECT_EQ(first->toString(), "hello");
+    EXPECT_EQ(first->data()[5], '\0');
+
+    pair.write("world!");
+    ASSERT_EQ(ring.recvFromSocket(pair.readFd(), count), 6);
+    EXPECT_EQ(ring.getBuffer(0)->toString(), "world!");
+    EXPECT_EQ(ring.getBuffer(0)->data(), first->data() + 6);  // 同一个内存块中紧随其后
+    EXPECT_EQ(first->toString(), "hello");
+}
+
+// 当前内存块剩余空间不足时, 一次读取分成两个切片
+TEST(RecvRingTest, SpanBlocks) {
+    SocketPair pair;
+    SocketRecvRingBuffer ring(8192, 2);
+    ssize_t count = 0;
+    pair.write(std::string(3000, 'a'));
+    ASSERT_EQ(ring.recvFromSocket(pair.readFd(), count), 3000);
+
+    std::string data;
+    for (int i = 0; i < 7000; ++i) {
+        data.push_back('0' + i % 10);
+    }
+    pair.write(data);
+    ASSERT_EQ(ring.recvFromSocket(pair.readFd(), count), 7000);
+    ASSERT_EQ(count, 2);
+    EXPECT_EQ(ring.getBuffer(0)->size(), 8192u - 3001 - 1);
+    EXPECT_EQ(ring.getBuffer(0)->toString() + ring.getBuffer(1)->toString(), data);
+}
+
+// 没有被会话保留的内存块循环使用; 被保留的内存块换成新块, 原来的数据不受影响
+TEST(RecvRingTest, Reuse) {
+    SocketPair pair;
+    SocketRecvRingBuffer ring(8192, 2);
+    ssize_t count = 0;
+    for (int i = 0; i < 100; ++i) {
+        pair.write(std::string(3000, 'x'));
+        ASSERT_EQ(ring.recvFromSocket(pair.readFd(), count), 3000);
+    }
+    EXPECT_EQ(ring.blockAllocCount(), 2u);
+
+    pair.write("keep");
+    ring.recvFromSocket(pair.readFd(), count);
+    auto kept = ring.getBuffer(0);
+    for (int i = 0; i < 100; ++i) {
+        pair.write(std::string(3000, 'y'));
+        ASSERT_EQ(ring.recvFromSocket(pair.readFd(), count), 3000);
+    }
+    EXPECT_EQ(ring.blockAllocCount(), 3u);
+    EXPECT_EQ(kept->toString(), "keep");
+}
+
+// 开启接收环后, Socket的读回调收到的是接收环的切片
+TEST(RecvRingTest, Socket) {
+    class RingPoller : public TaskExecutorGetterImpl {
+    public:
+        RingPoller() {
+            EventPollerPool::enableRecvRing(true);
+            addPoller("ring poller", 1, Thread_Priority::Highest, false, false);
+            EventPollerPool::enableRecvRing(false);
+        }
+        EventPoller::Ptr poller() { return std::static_pointer_cast<EventPoller>(threads_.front()); }
+    } getter;
+    auto poller = getter.poller();
+    EXPECT_TRUE(poller->useRecvRing());
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    std::atomic<size_t> received{0};
+    std::vector<Buffer::Ptr> kept;
+    auto sock = Socket::createSocket(poller, false);
+    sock->setOnRead([&](const Buffer::Ptr& buf, struct sockaddr*, int) {
+        kept.emplace_back(buf);
+        received += buf->size();
+    });
+    ASSERT_TRUE(sock->fromSock(fds[0], SockNum::SockType::TCP));
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(write(fds[1], "0123456789", 10), 10);
+    }
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (received < 1000 && std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(received, 1000u);
+    poller->sync([&]() {
+        std::string all;
+        for (auto& buf : kept) {
+            EXPECT_EQ(std::dynamic_pointer_cast<BufferRaw>(buf), nullptr);
+            all += buf->toString();
+        }
+        EXPECT_EQ(all.substr(0, 20), "01234567890123456789");
+        kept.clear();
+        sock = nullptr;
+    });
+    close(fds[1]);
+}
+
+// 会话保留每条小消息, 对比每次读取分配128KB缓冲区和接收环切片的耗时与占用内存
+template <typename Recv>
+static void benchmarkRecv(const char* name, Recv&& recv) {
+    constexpr int kCount = 100000;
+    constexpr int kKeep = 64;
+    SocketPair pair;
+    std::string msg(100, 'm');
+    std::vector<Buffer::Ptr> kept;
+    uint64_t max_in_use = 0;
+    auto base = BufferArena::bytesInUse();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kCount; ++i) {
+        pair.write(msg);
+        kept.emplace_back(recv(pair.readFd()));
+        if (kept.size() == kKeep) {
+            max_in_use = std::max(max_in_use, BufferArena::bytesInUse() - base);
+            kept.clear();
+        }
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << ns / kCount << " ns per message, " << max_in_use / 1024 << " KB held by "
+              << kKeep << " messages" << std::endl;
+}
+
+TEST(RecvRingBenchmark, SmallMessages) {
+    SocketRecvFromBuffer from(128 * 1024);
+    benchmarkRecv("recvfrom 128KB", [&from](int fd) {
+        ssize_t count;
+        from.recvFromSocket(fd, count);
+        return std::move(from.getBuffer(0));  // 会话取走缓冲区, 下次读取重新分配
+    });
+    SocketRecvRingBuffer ring(256 * 1024, 4);
+    benchmarkRecv("recv ring", [&ring](int fd) {
+        ssize_t count;
+        ring.recvFromSocket(fd, count);
+        return ring.getBuffer(0);
+    });
+    std::cout << "ring blocks allocated: " << ring.blockAllocCount() << std::endl;
+}
@@ -0,0 +1,219 @@
+/*
+ * 测试ResourcePool的对象复用、统计信息和跨线程回收, 并与原先基于atomic_flag的实现对比多线程性能
+ */
+#include <gtest/gtest.h>
+#include "resourcepool.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+struct PoolObject {
+    static std::atomic<int> s_alive;
+    PoolObject() { ++s_alive; }
+    ~PoolObject() { --s_alive; }
+    char data[256];
+};
+std::atomic<int> PoolObject::s_alive{0};
+
+// 原先的实现: 单个atomic_flag保护对象列表, 冲突时直接new/delete, 每次obtain额外分配一个atomic_bool
+class LegacyPool : public std::enable_shared_from_this<LegacyPool> {
+public:
+    explicit LegacyPool(size_t size) : pool_size_(size) { objs_.reserve(size); }
+    ~LegacyPool() {
+        for (auto ptr : objs_) {
+            delete ptr;
+        }
+    }
+
+    std::shared_ptr<PoolObject> obtain() {
+        std::weak_ptr<LegacyPool> weak_self = shared_from_this();
+        auto quit = std::make_shared<std::atomic_bool>(false);
+        return std::shared_ptr<PoolObject>(getPtr(), [weak_self, quit](PoolObject* ptr) {
+            auto strongPool = weak_self.lock();
+            if (strongPool && !(*quit)) {
+                strongPool->recycle(ptr);
+            } else {
+                delete ptr;
+            }
+        });
+    }
+
+    std::atomic<uint64_t> miss_{0};
+
+private:
+    void recycle(PoolObject* obj) {
+        if (!busy_.test_and_set()) {
+            if (objs_.size() >= pool_size_) {
+                delete obj;
+            } else {
+                objs_.emplace_back(obj);
+            }
+            busy_.clear();
+        } else {
+            delete obj;
+        }
+    }
+
+    PoolObject* getPtr() {
+        PoolObject* ptr = nullptr;
+        if (!busy_.test_and_set()) {
+            if (!objs_.empty()) {
+                ptr = objs_.back();
+                objs_.pop_back();
+            }
+            busy_.clear();
+        }
+        if (!ptr) {
+            ++miss_;
+            ptr = new PoolObject();
+        }
+        return ptr;
+    }
+
+    size_t pool_size_;
+    std::vector<PoolObject*> objs_;
+    std::atomic_flag busy_ = ATOMIC_FLAG_INIT;
+};
+
+// 单线程反复取出和归还, 只有第一次新建对象
+TEST(ResourcePoolTest, Reuse) {
+    ResourcePool<PoolObject> pool;
+    PoolObject* first;
+    {
+        auto obj = pool.obtain();
+        first = obj.get();
+    }
+    for (int i = 0; i < 100; ++i) {
+        auto obj = pool.obtain2();
+        EXPECT_EQ(obj.get(), first);
+    }
+    EXPECT_EQ(pool.missCount(), 1u);
+    EXPECT_EQ(pool.hitCount(), 100u);
+    EXPECT_EQ(pool.overflowCount(), 0u);
+}
+
+// 超出容量的对象被释放, 弹夹和仓库缓存的对象总数不超过setSize设置的数量
+TEST(ResourcePoolTest, Overflow) {
+    auto alive = PoolObject::s_alive.load();
+    {
+        ResourcePool<PoolObject> pool;
+        pool.setSize(16);
+        std::vector<std::shared_ptr<PoolObject>> objs;
+        for (int i = 0; i < 32; ++i) {
+            objs.emplace_back(pool.obtain2());
+        }
+        // 多个线程同时归还, 分散到不同弹夹
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&objs, t]() {
+                for (int i = t; i < 32; i += 4) {
+                    objs[i].reset();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(pool.missCount(), 32u);
+        auto cached = PoolObject::s_alive - alive;
+        EXPECT_LE(cached, 16);
+        EXPECT_EQ(pool.overflowCount(), 32u - cached);
+    }
+    EXPECT_EQ(PoolObject::s_alive, alive);
+}
+
+// 取出过对象后再设置容量不生效
+TEST(ResourcePoolTest, SetSizeAfterUse) {
+    auto alive = PoolObject::s_alive.load();
+    {
+        ResourcePool<PoolObject> pool;
+        pool.setSize(1);
+        pool.obtain2().reset();
+        pool.setSize(64);
+        std::vector<std::shared_ptr<PoolObject>> objs;
+        for (int i = 0; i < 8; ++i) {
+            objs.emplace_back(pool.obtain2());
+        }
+        objs.clear();
+        EXPECT_EQ(PoolObject::s_alive, alive + 1);
+    }
+    EXPECT_EQ(PoolObject::s_alive, alive);
+}
+
+// quit后对象不再放回资源池; 资源池销毁后归还的对象直接释放
+TEST(ResourcePoolTest, QuitAndPoolDestroyed) {
+    auto alive = PoolObject::s_alive.load();
+    ResourcePool<PoolObject>::ValuePtr obj;
+    {
+        ResourcePool<PoolObject> pool;
+        bool recycled = false;
+        auto quit_obj = pool.obtain([&recycled](PoolObject*) { recycled = true; });
+        quit_obj.quit();
+        quit_obj.reset();
+        EXPECT_TRUE(recycled);
+        EXPECT_EQ(PoolObject::s_alive, alive);
+        obj = pool.obtain();
+    }
+    EXPECT_EQ(PoolObject::s_alive, alive + 1);
+    obj.reset();
+    EXPECT_EQ(PoolObject::s_alive, alive);
+}
+
+// 一个线程取出, 另一个线程归还, 对象经仓库回到取出线程; 只有留在归还线程弹夹中的对象需要重新创建
+TEST(ResourcePoolTest, CrossThreadRecycle) {
+    ResourcePool<PoolObject> pool;
+    pool.setSize(64);
+    for (int round = 0; round < 10; ++round) {
+        std::vector<std::shared_ptr<PoolObject>> objs;
+        for (int i = 0; i < 32; ++i) {
+            objs.emplace_back(pool.obtain2());
+        }
+        std::thread([&objs]() { objs.clear(); }).join();
+    }
+    EXPECT_LE(pool.missCount(), 32u + 10 * ResourcePool_l<PoolObject>::kMagazineSize);
+    EXPECT_EQ(pool.hitCount() + pool.missCount(), 320u);
+}
+
+// 多个线程同时取出和归还, 统计耗时和新建对象的次数
+template <typename Obtain>
+static uint64_t concurrentObtain(Obtain obtain, int threads, int count) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&obtain, count]() {
+            std::vector<std::shared_ptr<PoolObject>> held;
+            for (int i = 0; i < count; ++i) {
+                held.emplace_back(obtain());
+                if (held.size() == 4) {
+                    held.clear();
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() /
+           (threads * count);
+}
+
+TEST(ResourcePoolBenchmark, Concurrent) {
+    constexpr int kCount = 500000;
+    for (int threads : {1, 4}) {
+        auto legacy = std::make_shared<LegacyPool>(64);
+        auto legacy_ns = concurrentObtain([&legacy]() { return legacy->obtain(); }, threads, kCount);
+
+        ResourcePool<PoolObject> pool;
+        pool.setSize(64);
+        auto pool_ns = concurrentObtain([&pool]() { return pool.obtain2(); }, threads, kCount);
+
+        std::cout << threads << " threads: legacy " << legacy_ns << " ns, miss " << legacy->miss_
+                  << "; magazine " << pool_ns << " ns, hit " << pool.hitCount() << ", miss " << pool.missCount()
+                  << ", overflow " << pool.overflowCount() << std::endl;
+        EXPECT_LT(pool.missCount(), static_cast<uint64_t>(threads) * 64);
+    }
+}
@@ -0,0 +1,207 @@
+/*
+ * 测试Socket::sendFile: 与普通发送的顺序、大文件在对端读取缓慢时的续传、SSL连接的分块发送,
+ * 并与读入内存后发送的方式对比吞吐
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "file.h"
+#include "socket.h"
+#include "threadpool.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace xkernel;
+
+class SendFilePoller : public TaskExecutorGetterImpl {
+public:
+    SendFilePoller() { addPoller("sendfile poller", 1, Thread_Priority::Highest, false, false); }
+    EventPoller::Ptr poller() { return std::static_pointer_cast<EventPoller>(threads_.front()); }
+};
+
+// 临时文件, 内容为按位置生成的字节
+class TempFile {
+public:
+    explicit TempFile(size_t size) {
+        char path[] = "/tmp/sendfile_test_XXXXXX";
+        fd_ = mkstemp(path);
+        path_ = path;
+        for (size_t i = 0; i < size; ++i) {
+            data_.push_back(static_cast<char>(i % 251));
+        }
+        EXPECT_EQ(write(fd_, data_.data(), size), static_cast<ssize_t>(size));
+    }
+    ~TempFile() {
+        close(fd_);
+        unlink(path_.data());
+    }
+    int fd() const { return fd_; }
+    const std::string& path() const { return path_; }
+    std::string substr(size_t offset, size_t len = std::string::npos) const { return data_.substr(offset, len); }
+
+private:
+    int fd_;
+    std::string path_;
+    std::string data_;
+};
+
+// 发送端交给Socket管理, 接收端由测试线程直接读取
+class StreamPair {
+public:
+    StreamPair() { socketpair(AF_UNIX, SOCK_STREAM, 0, fds_); }
+    ~StreamPair() { close(fds_[1]); }
+    Socket::Ptr createSender(const EventPoller::Ptr& poller) {
+        auto sock = Socket::createSocket(poller, true);
+        sock->fromSock(fds_[0], SockNum::SockType::TCP);
+        return sock;
+    }
+    std::string read(size_t size) {
+        std::string ret;
+        char buf[64 * 1024];
+        while (ret.size() < size) {
+            auto n = ::read(fds_[1], buf, std::min(sizeof(buf), size - ret.size()));
+            if (n <= 0) {
+                break;
+            }
+            ret.append(buf, n);
+        }
+        return ret;
+    }
+
+private:
+    int fds_[2];
+};
+
+static bool waitFor(const std::function<bool()>& cond) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() > end) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// 文件和内存数据交替发送, 对端按调用顺序收到
+TEST(SendFileTest, Order) {
+    SendFilePoller getter;
+    StreamPair pair;
+    TempFile file(1000);
+    auto sock = pair.createSender(getter.poller());
+    std::atomic<int> succeeded{0};
+    sock->setOnSendResult([&](const Buffer::Ptr&, bool success) { succeeded += success; });
+
+    EXPECT_EQ(sock->send("head"), 4);
+    EXPECT_EQ(sock->sendFile(file.fd(), 10, 100), 100);
+    EXPECT_EQ(sock->send("mid"), 3);
+    EXPECT_EQ(sock->sendFile(file.fd()), 1000);
+    EXPECT_EQ(sock->sendFile(file.fd(), 990, 100), 10);  // 超出文件末尾的部分被截掉
+    EXPECT_EQ(sock->sendFile(file.fd(), 1000), 0);
+    EXPECT_EQ(sock->send("tail"), 4);
+    EXPECT_EQ(sock->sendFile(-1), -1);
+
+    auto expected = "head" + file.substr(10, 100) + "mid" + file.substr(0) + file.substr(990) + "tail";
+    EXPECT_EQ(pair.read(expected.size()), expected);
+    EXPECT_TRUE(waitFor([&]() { return succeeded == 6; }));
+    getter.poller()->sync([&sock]() { sock = nullptr; });
+}
+
+// 对端没有读取时文件留在发送缓存中, socket可写后继续发送, 全部发送后触发onceFlushed
+TEST(SendFileTest, Backpressure) {
+    SendFilePoller getter;
+    StreamPair pair;
+    constexpr size_t kSize = 8 * 1024 * 1024;
+    TempFile file(kSize);
+    auto sock = pair.createSender(getter.poller());
+    std::atomic<int> succeeded{0};
+    std::atomic<bool> flushed{false};
+    sock->setOnSendResult([&](const Buffer::Ptr& buf, bool success) {
+        EXPECT_EQ(buf->size(), kSize);
+        succeeded += success;
+    });
+    EXPECT_EQ(sock->sendFile(file.fd()), static_cast<ssize_t>(kSize));
+    EXPECT_EQ(succeeded, 0);
+    EXPECT_TRUE(sock->isSocketBusy());
+    EXPECT_EQ(sock->getSendBufferCount(), 1u);
+    sock->onceFlushed([&flushed]() { flushed = true; });
+
+    EXPECT_EQ(pair.read(kSize), file.substr(0));
+    EXPECT_TRUE(waitFor([&]() { return flushed.load(); }));
+    EXPECT_EQ(succeeded, 1);
+    EXPECT_EQ(sock->getSendBufferCount(), 0u);
+
+    // 发送缓存已空时异步回调
+    flushed = false;
+    getter.poller()->sync([&]() {
+        sock->onceFlushed([&flushed]() { flushed = true; });
+        EXPECT_FALSE(flushed);
+    });
+    EXPECT_TRUE(waitFor([&]() { return flushed.load(); }));
+    getter.poller()->sync([&sock]() { sock = nullptr; });
+}
+
+// 模拟SSL连接: 文件分块读取后经send发送, 每批等发送缓存清空后再读取
+class ChunkedHelper : public SocketHelper {
+public:
+    ChunkedHelper(const Socket::Ptr& sock) : SocketHelper(sock) {}
+    bool overSsl() const override { return true; }
+    ssize_t send(Buffer::Ptr buf) override {
+        max_chunk_ = std::max(max_chunk_.load(), buf->size());
+        return SocketHelper::send(std::move(buf));
+    }
+    void onRecv(const Buffer::Ptr&) override {}
+    void onErr(const SockException&) override {}
+    void onFlush() override {}
+    void onManager() override {}
+
+    std::atomic<size_t> max_chunk_{0};
+};
+
+TEST(SendFileTest, Chunked) {
+    SendFilePoller getter;
+    StreamPair pair;
+    constexpr size_t kSize = 4 * 1024 * 1024 + 123;
+    TempFile file(kSize);
+    auto helper = std::make_shared<ChunkedHelper>(pair.createSender(getter.poller()));
+    getter.poller()->sync([&]() { EXPECT_EQ(helper->sendFile(file.fd(), 1), static_cast<ssize_t>(kSize - 1)); });
+    // 第一批读取后即等待发送缓存清空, 不会把整个文件读入发送缓存
+    EXPECT_LE(helper->getSock()->getSendBufferCount(), 16u);
+    EXPECT_EQ(pair.read(kSize - 1), file.substr(1));
+    EXPECT_EQ(helper->max_chunk_, 16u * 1024);
+    getter.poller()->sync([&helper]() { helper = nullptr; });
+}
+
+// 对比读入内存后send与sendfile发送同一个文件的吞吐
+TEST(SendFileBenchmark, Throughput) {
+    constexpr size_t kSize = 32 * 1024 * 1024;
+    constexpr int kCount = 8;
+    TempFile file(kSize);
+    for (bool use_sendfile : {false, true}) {
+        SendFilePoller getter;
+        StreamPair pair;
+        auto sock = pair.createSender(getter.poller());
+        std::atomic<int> succeeded{0};
+        sock->setOnSendResult([&](const Buffer::Ptr&, bool success) { succeeded += success; });
+        auto start = std::chrono::steady_clock::now();
+        std::thread reader([&pair]() { EXPECT_EQ(pair.read(kSize * kCount).size(), kSize * kCount); });
+        for (int i = 0; i < kCount; ++i) {
+            if (use_sendfile) {
+                sock->sendFile(file.fd());
+            } else {
+                sock->send(FileUtil::loadFile(file.path()));
+            }
+        }
+        reader.join();
+        EXPECT_TRUE(waitFor([&]() { return succeeded == kCount; }));
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (use_sendfile ? "sendfile" : "loadFile + send") << ": " << kSize / 1024 / 1024 * kCount * 1000 / (ms ? ms : 1)
+                  << " MB/s" << std::endl;
+        getter.poller()->sync([&sock]() { sock = nullptr; });
+    }
+}
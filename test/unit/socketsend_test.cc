@@ -0,0 +1,123 @@
+/*
+ * 测试Socket的多线程发送: 多个线程同时向同一个socket发送时每个线程的数据保持顺序且不丢失,
+ * 发送结果回调和onceFlushed在无锁一级缓存下仍然生效, 并统计16个生产者线程的发送吞吐
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "socket.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 每条消息16字节: 生产者编号、序号、填充
+struct Message {
+    uint32_t producer;
+    uint32_t seq;
+    uint64_t pad;
+};
+
+// 发送端交给Socket管理, 接收端由测试线程直接读取
+class StreamPair {
+public:
+    StreamPair() {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds_);
+        sender_ = Socket::createSocket(EventPollerPool::Instance().getPoller(), true);
+        sender_->fromSock(fds_[0], SockNum::SockType::TCP);
+    }
+    ~StreamPair() {
+        sender_->closeSock();
+        close(fds_[1]);
+    }
+    const Socket::Ptr& sender() const { return sender_; }
+    int receiver() const { return fds_[1]; }
+
+private:
+    int fds_[2];
+    Socket::Ptr sender_;
+};
+
+// producers个线程各发送count条消息, 接收端检查每个生产者的序号连续; 返回耗时(微秒)
+static int64_t sendConcurrently(StreamPair& pair, int producers, uint32_t count) {
+    std::atomic<bool> ordered{true};
+    std::thread reader([&]() {
+        std::vector<uint32_t> next(producers, 0);
+        size_t total = static_cast<size_t>(producers) * count * sizeof(Message);
+        std::string buf;
+        size_t received = 0;
+        char tmp[64 * 1024];
+        while (received < total) {
+            auto n = ::read(pair.receiver(), tmp, sizeof(tmp));
+            if (n <= 0) {
+                break;
+            }
+            buf.append(tmp, n);
+            size_t pos = 0;
+            for (; pos + sizeof(Message) <= buf.size(); pos += sizeof(Message)) {
+                Message msg;
+                memcpy(&msg, buf.data() + pos, sizeof(msg));
+                if (msg.producer >= static_cast<uint32_t>(producers) || msg.seq != next[msg.producer]++) {
+                    ordered = false;
+                }
+            }
+            buf.erase(0, pos);
+            received += n;
+        }
+        EXPECT_EQ(received, total);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            Message msg{static_cast<uint32_t>(p), 0, 0};
+            for (uint32_t i = 0; i < count; ++i) {
+                msg.seq = i;
+                pair.sender()->send(reinterpret_cast<const char*>(&msg), sizeof(msg));
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    reader.join();
+    EXPECT_TRUE(ordered);
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(SocketSendTest, MultiProducer) {
+    StreamPair pair;
+    std::atomic<size_t> results{0};
+    pair.sender()->setOnSendResult([&](const Buffer::Ptr&, bool success) { results += success; });
+    sendConcurrently(pair, 16, 2000);
+    // 发送结果在数据写入socket后回调, 读完时可能还没有回调完
+    for (int i = 0; i < 100 && results < 16 * 2000; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(results, 16u * 2000);
+    EXPECT_EQ(pair.sender()->getSendBufferCount(), 0u);
+
+    std::atomic<bool> flushed{false};
+    pair.sender()->onceFlushed([&]() { flushed = true; });
+    for (int i = 0; i < 100 && !flushed; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(flushed);
+}
+
+// 1个和16个生产者线程向同一个socket发送相同数量的小消息
+TEST(SocketSendBenchmark, Producers) {
+    constexpr uint32_t kTotal = 800000;
+    for (int producers : {1, 16}) {
+        StreamPair pair;
+        auto us = sendConcurrently(pair, producers, kTotal / producers);
+        std::cout << producers << " producers: " << kTotal << " messages in " << us / 1000 << " ms, "
+                  << static_cast<uint64_t>(kTotal) * 1000000 / (us ? us : 1) << " msg/s" << std::endl;
+    }
+}
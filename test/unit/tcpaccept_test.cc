@@ -0,0 +1,296 @@
+/*
+ * 测试TcpServer多线程下的三种接受连接方式: 共享监听fd、每个poller一个SO_REUSEPORT监听socket、
+ * 共享监听fd并以EPOLLEXCLUSIVE注册, 检查连接都能建立并收发数据, 并在连接风暴下统计接受速率和各poller的会话分布;
+ * 以及新连接的socket选项: accept4直接得到非阻塞和FD_CLOEXEC的fd, 其他选项从监听socket继承或逐个设置
+ */
+#include <gtest/gtest.h>
+#include "tcpserver.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 固定4个poller, 单核机器上也覆盖多个poller的情况
+static bool s_pool_size = []() {
+    EventPollerPool::setPoolSize(4);
+    return true;
+}();
+
+// 记录会话所在的poller, 收到数据后原样返回
+class EchoSession : public Session {
+public:
+    static std::atomic<size_t> s_sessions;
+    static std::mutex s_mtx;
+    static std::map<const EventPoller*, size_t> s_pollers;
+
+    EchoSession(const Socket::Ptr& sock) : Session(sock) {
+        std::lock_guard<std::mutex> lock(s_mtx);
+        ++s_pollers[sock->getPoller().get()];
+        ++s_sessions;
+    }
+
+    void onRecv(const Buffer::Ptr& buf) override { send(buf); }
+    void onErr(const SockException&) override {}
+    void onFlush() override {}
+    void onManager() override {}
+
+    static void reset() {
+        std::lock_guard<std::mutex> lock(s_mtx);
+        s_pollers.clear();
+        s_sessions = 0;
+    }
+};
+std::atomic<size_t> EchoSession::s_sessions{0};
+std::mutex EchoSession::s_mtx;
+std::map<const EventPoller*, size_t> EchoSession::s_pollers;
+
+static int connectServer(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool waitSessions(size_t count) {
+    for (int i = 0; i < 500 && EchoSession::s_sessions < count; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return EchoSession::s_sessions == count;
+}
+
+// 本进程中监听port的tcp socket个数
+static size_t countListeners(uint16_t port) {
+    size_t count = 0;
+    auto dir = opendir("/proc/self/fd");
+    while (auto entry = readdir(dir)) {
+        int fd = atoi(entry->d_name);
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        int listening = 0;
+        socklen_t opt_len = sizeof(listening);
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &opt_len) == -1 || !listening ||
+            getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) == -1 || addr.ss_family != AF_INET) {
+            continue;
+        }
+        count += ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port) == port;
+    }
+    closedir(dir);
+    return count;
+}
+
+static TcpServer::Ptr startServer(TcpServer::AcceptMode mode) {
+    auto server = std::make_shared<TcpServer>();
+    server->setAcceptMode(mode);
+    server->start<EchoSession>(0, "127.0.0.1");
+    return server;
+}
+
+class TcpAcceptTest : public testing::TestWithParam<TcpServer::AcceptMode> {};
+
+// 每种方式下连接都能建立并收发数据
+TEST_P(TcpAcceptTest, Echo) {
+    constexpr size_t kClients = 16;
+    EchoSession::reset();
+    auto server = startServer(GetParam());
+    auto expect_listeners = GetParam() == TcpServer::AcceptMode::ReusePort
+                                ? EventPollerPool::Instance().getExecutorSize() : 1u;
+    EXPECT_EQ(countListeners(server->getPort()), expect_listeners);
+
+    std::vector<int> fds;
+    for (size_t i = 0; i < kClients; ++i) {
+        int fd = connectServer(server->getPort());
+        ASSERT_NE(fd, -1);
+        fds.emplace_back(fd);
+    }
+    EXPECT_TRUE(waitSessions(kClients));
+    for (auto fd : fds) {
+        struct timeval tv = {5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char buf[4];
+        ASSERT_EQ(::send(fd, "ping", 4, 0), 4);
+        ASSERT_EQ(::recv(fd, buf, sizeof(buf), MSG_WAITALL), 4);
+        EXPECT_EQ(std::string(buf, 4), "ping");
+        close(fd);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(AcceptMode, TcpAcceptTest,
+                         testing::Values(TcpServer::AcceptMode::Shared, TcpServer::AcceptMode::ReusePort,
+                                         TcpServer::AcceptMode::Exclusive));
+
+// 多个客户端线程同时发起连接, 统计全部连接被接受的耗时和各poller上的会话个数
+TEST(TcpAcceptBenchmark, ConnectionStorm) {
+    constexpr int kThreads = 4;
+    constexpr int kPerThread = 500;
+    const std::map<TcpServer::AcceptMode, const char*> names = {
+        {TcpServer::AcceptMode::Shared, "shared"},
+        {TcpServer::AcceptMode::ReusePort, "reuseport"},
+        {TcpServer::AcceptMode::Exclusive, "exclusive"},
+    };
+    for (auto& pr : names) {
+        EchoSession::reset();
+        auto server = startServer(pr.first);
+        std::atomic<size_t> failed{0};
+        std::vector<std::vector<int>> fds(kThreads);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for (int t = 0; t < kThreads; ++t) {
+            clients.emplace_back([&, t]() {
+                for (int i = 0; i < kPerThread; ++i) {
+                    int fd = connectServer(server->getPort());
+                    if (fd == -1) {
+                        ++failed;
+                        continue;
+                    }
+                    fds[t].emplace_back(fd);
+                }
+            });
+        }
+        for (auto& client : clients) {
+            client.join();
+        }
+        EXPECT_EQ(failed, 0u);
+        EXPECT_TRUE(waitSessions(kThreads * kPerThread));
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << pr.second << ": " << EchoSession::s_sessions << " connections in " << ms << " ms ("
+                  << EchoSession::s_sessions * 1000 / (ms ? ms : 1) << " conn/s), sessions per poller:";
+        {
+            std::lock_guard<std::mutex> lock(EchoSession::s_mtx);
+            for (auto& poller : EchoSession::s_pollers) {
+                std::cout << " " << poller.second;
+            }
+        }
+        std::cout << std::endl;
+        for (auto& vec : fds) {
+            for (auto fd : vec) {
+                close(fd);
+            }
+        }
+        // 等待会话随连接关闭释放, 避免影响下一种方式
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+}
+
+// 新连接fd上的选项
+struct AcceptedOptions {
+    bool non_block = false;
+    bool cloexec = false;
+    int no_delay = 0;
+    int send_buf = 0;
+    struct linger linger = {0, 0};
+};
+
+static AcceptedOptions readOptions(int fd) {
+    AcceptedOptions ret;
+    ret.non_block = fcntl(fd, F_GETFL) & O_NONBLOCK;
+    ret.cloexec = fcntl(fd, F_GETFD) & FD_CLOEXEC;
+    socklen_t len = sizeof(int);
+    getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &ret.no_delay, &len);
+    len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &ret.send_buf, &len);
+    len = sizeof(ret.linger);
+    getsockopt(fd, SOL_SOCKET, SO_LINGER, &ret.linger, &len);
+    return ret;
+}
+
+// 监听socket按options接受连接, 每接受一个连接调用一次cb; 返回监听socket
+static Socket::Ptr listenWith(const AcceptOptions& options, const std::function<void(const Socket::Ptr&)>& cb) {
+    auto listener = Socket::createSocket(EventPollerPool::Instance().getPoller(), false);
+    listener->setAcceptOptions(options);
+    listener->setOnAccept([cb](Socket::Ptr& sock, std::shared_ptr<void>&) { cb(sock); });
+    EXPECT_TRUE(listener->listen(0, "127.0.0.1"));
+    return listener;
+}
+
+// 继承和逐个设置两种方式下新连接得到相同的选项
+TEST(AcceptOptionsTest, Inherit) {
+    for (bool inherit : {true, false}) {
+        AcceptOptions options;
+        options.inherit = inherit;
+        options.send_buf = 128 * 1024;
+        options.close_wait = 3;
+        std::atomic<bool> done{false};
+        AcceptedOptions accepted;
+        auto listener = listenWith(options, [&](const Socket::Ptr& sock) {
+            accepted = readOptions(sock->rawFd());
+            done = true;
+        });
+        int fd = connectServer(listener->getLocalPort());
+        ASSERT_NE(fd, -1);
+        for (int i = 0; i < 500 && !done; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_TRUE(done);
+        EXPECT_TRUE(accepted.non_block);
+        EXPECT_TRUE(accepted.cloexec);
+        EXPECT_EQ(accepted.no_delay, 1);
+        EXPECT_EQ(accepted.send_buf, 2 * options.send_buf);  // 内核记录的值是设置值的两倍
+        EXPECT_EQ(accepted.linger.l_onoff, 1);
+        EXPECT_EQ(accepted.linger.l_linger, 3);
+        close(fd);
+        listener->closeSock();
+    }
+}
+
+// 统计同一监听socket接受大量连接的速率, 对比从监听socket继承选项和对每个新连接逐个设置选项
+TEST(AcceptOptionsBenchmark, AcceptRate) {
+    constexpr size_t kConnections = 3000;
+    for (bool inherit : {false, true}) {
+        AcceptOptions options;
+        options.inherit = inherit;
+        std::atomic<size_t> accepted{0};
+        std::mutex mtx;
+        std::vector<Socket::Ptr> socks;
+        auto listener = listenWith(options, [&](const Socket::Ptr& sock) {
+            std::lock_guard<std::mutex> lock(mtx);
+            socks.emplace_back(sock);
+            ++accepted;
+        });
+
+        std::vector<int> fds;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kConnections; ++i) {
+            int fd = connectServer(listener->getLocalPort());
+            ASSERT_NE(fd, -1);
+            fds.emplace_back(fd);
+        }
+        for (int i = 0; i < 500 && accepted < kConnections; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        EXPECT_EQ(accepted, kConnections);
+        std::cout << (inherit ? "accept4 + inherited options: " : "accept4 + per-connection setters: ") << accepted
+                  << " connections in " << us / 1000 << " ms (" << accepted * 1000000 / (us ? us : 1) << " conn/s)"
+                  << std::endl;
+
+        for (auto fd : fds) {
+            close(fd);
+        }
+        listener->closeSock();
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& sock : socks) {
+            sock->closeSock();
+        }
+    }
+}
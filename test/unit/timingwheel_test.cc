@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include "timingwheel.h"
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+#include <iostream>
+
+using namespace xkernel;
+
+static DelayTask::Ptr makeTask(std::vector<uint64_t>& fired, uint64_t id, uint64_t repeat = 0) {
+    return std::make_shared<DelayTask>([&fired, id, repeat]() -> uint64_t {
+        fired.push_back(id);
+        return repeat;
+    });
+}
+
+// 到期时间精确到毫秒, 且按到期时间顺序执行
+TEST(TimingWheelTest, ExpireInOrder) {
+    uint64_t now = 1000;
+    TimingWheel wheel(now);
+    std::vector<uint64_t> fired;
+    std::vector<uint64_t> delays = {1, 255, 256, 300, 16383, 16384, 70000, 1048576, 5000000};
+    for (auto delay : delays) {
+        wheel.add(makeTask(fired, now + delay), now + delay);
+    }
+    EXPECT_EQ(wheel.size(), delays.size());
+
+    auto cb = [](DelayTask::Ptr& task) { (*task)(); };
+    for (size_t i = 0; i < delays.size(); ++i) {
+        wheel.advance(now + delays[i] - 1, cb);
+        EXPECT_EQ(fired.size(), i) << delays[i];
+        wheel.advance(now + delays[i], cb);
+        ASSERT_EQ(fired.size(), i + 1);
+        EXPECT_EQ(fired.back(), now + delays[i]);
+    }
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(wheel.nextExpire(), 0u);
+}
+
+// nextExpire不晚于最近任务的到期时间
+TEST(TimingWheelTest, NextExpire) {
+    uint64_t now = 123456;
+    TimingWheel wheel(now);
+    std::vector<uint64_t> fired;
+    std::mt19937_64 rng(1);
+    std::multimap<uint64_t, uint64_t> expect;
+    for (int i = 0; i < 2000; ++i) {
+        uint64_t expire = now + 1 + rng() % 200000;
+        wheel.add(makeTask(fired, expire), expire);
+        expect.emplace(expire, expire);
+    }
+    auto cb = [](DelayTask::Ptr& task) { (*task)(); };
+    while (!wheel.empty()) {
+        auto next = wheel.nextExpire();
+        ASSERT_LE(next, expect.begin()->first);
+        ASSERT_GE(next, now);
+        now = next;
+        wheel.advance(now, cb);
+        while (!expect.empty() && expect.begin()->first <= now) {
+            expect.erase(expect.begin());
+        }
+        ASSERT_EQ(fired.size() + expect.size(), 2000u);
+    }
+    EXPECT_TRUE(expect.empty());
+    for (size_t i = 1; i < fired.size(); ++i) {
+        EXPECT_LE(fired[i - 1], fired[i]);
+    }
+}
+
+// 已取消的任务不会被执行, 并在到期时被移除
+TEST(TimingWheelTest, Cancel) {
+    TimingWheel wheel(0);
+    std::vector<uint64_t> fired;
+    auto task1 = makeTask(fired, 1);
+    auto task2 = makeTask(fired, 2);
+    wheel.add(task1, 10);
+    wheel.add(task2, 100000);
+    task1->cancel();
+    task2->cancel();
+    wheel.advance(200000, [](DelayTask::Ptr& task) { (*task)(); });
+    EXPECT_TRUE(fired.empty());
+    EXPECT_TRUE(wheel.empty());
+}
+
+// 回调中重新挂载的任务按新的到期时间执行
+TEST(TimingWheelTest, Repeat) {
+    TimingWheel wheel(0);
+    std::vector<uint64_t> fired;
+    wheel.add(makeTask(fired, 1, 50), 50);
+    uint64_t now = 0;
+    auto cb = [&](DelayTask::Ptr& task) {
+        auto next = (*task)();
+        if (next) {
+            wheel.add(std::move(task), now + next);
+        }
+    };
+    for (now = 0; now <= 1000; ++now) {
+        wheel.advance(now, cb);
+    }
+    EXPECT_EQ(fired.size(), 20u);
+    EXPECT_EQ(wheel.size(), 1u);
+}
+
+// 超过时间轮范围的任务在降级后按原到期时间执行
+TEST(TimingWheelTest, OutOfRange) {
+    TimingWheel wheel(0);
+    std::vector<uint64_t> fired;
+    uint64_t expire = (1ULL << 33) + 7;
+    wheel.add(makeTask(fired, 1), expire);
+    uint64_t now = 0;
+    auto cb = [](DelayTask::Ptr& task) { (*task)(); };
+    while (!wheel.empty()) {
+        now = wheel.nextExpire();
+        ASSERT_LE(now, expire);
+        wheel.advance(now, cb);
+    }
+    EXPECT_EQ(now, expire);
+    EXPECT_EQ(fired.size(), 1u);
+}
+
+// 与std::multimap对比插入/取消/到期的开销
+TEST(TimingWheelTest, Benchmark) {
+    constexpr size_t kCount = 1000000;
+    constexpr uint64_t kRange = 60 * 1000;
+    std::mt19937_64 rng(2);
+    std::vector<uint64_t> expires(kCount);
+    for (auto& expire : expires) {
+        expire = 1 + rng() % kRange;
+    }
+    std::vector<DelayTask::Ptr> tasks(kCount);
+    for (auto& task : tasks) {
+        task = std::make_shared<DelayTask>([]() -> uint64_t { return 0; });
+    }
+    auto elapsed = [](std::chrono::steady_clock::time_point start) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return static_cast<double>(ns) / kCount;
+    };
+
+    size_t wheel_fired = 0;
+    double wheel_insert, wheel_fire;
+    {
+        TimingWheel wheel(0);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kCount; ++i) {
+            wheel.add(tasks[i], expires[i]);
+        }
+        wheel_insert = elapsed(start);
+        start = std::chrono::steady_clock::now();
+        for (uint64_t now = 0; now <= kRange; ++now) {
+            wheel.advance(now, [&](DelayTask::Ptr&) { ++wheel_fired; });
+        }
+        wheel_fire = elapsed(start);
+    }
+
+    size_t map_fired = 0;
+    double map_insert, map_fire;
+    {
+        std::multimap<uint64_t, DelayTask::Ptr> map;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kCount; ++i) {
+            map.emplace(expires[i], tasks[i]);
+        }
+        map_insert = elapsed(start);
+        start = std::chrono::steady_clock::now();
+        for (uint64_t now = 0; now <= kRange; ++now) {
+            auto end = map.upper_bound(now);
+            for (auto it = map.begin(); it != end; ++it) {
+                ++map_fired;
+            }
+            map.erase(map.begin(), end);
+        }
+        map_fire = elapsed(start);
+    }
+
+    // 取消: 时间轮只释放闭包, 节点在到期时惰性移除
+    double cancel;
+    {
+        TimingWheel wheel(0);
+        for (size_t i = 0; i < kCount; ++i) {
+            tasks[i] = std::make_shared<DelayTask>([]() -> uint64_t { return 0; });
+            wheel.add(tasks[i], expires[i]);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (auto& task : tasks) {
+            task->cancel();
+        }
+        cancel = elapsed(start);
+        size_t fired = 0;
+        wheel.advance(kRange, [&](DelayTask::Ptr&) { ++fired; });
+        EXPECT_EQ(fired, 0u);
+        EXPECT_TRUE(wheel.empty());
+    }
+
+    EXPECT_EQ(wheel_fired, kCount);
+    EXPECT_EQ(map_fired, kCount);
+    std::cout << "timers: " << kCount << std::endl
+              << "timingwheel insert: " << wheel_insert << " ns/op, fire: " << wheel_fire << " ns/op"
+              << ", cancel: " << cancel << " ns/op" << std::endl
+              << "multimap    insert: " << map_insert << " ns/op, fire: " << map_fire << " ns/op" << std::endl;
+}
@@ -0,0 +1,266 @@
+/*
+ * 测试UDP的GSO发送和GRO接收: 合并发送后对端按原始数据包收到、按段长拆分、不同目标不合并、
+ * 合并发送失败时退回逐包发送, 并在回环网卡上对比逐包发送接收与GSO/GRO的包速率
+ */
+#include <gtest/gtest.h>
+#include "buffersock.h"
+#include "eventpoller.h"
+#include "socket.h"
+#include "threadpool.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 回环地址上的非阻塞UDP socket
+class UdpFd {
+public:
+    UdpFd() {
+        fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        memset(&addr_, 0, sizeof(addr_));
+        addr_.sin_family = AF_INET;
+        addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr_);
+        bind(fd_, reinterpret_cast<struct sockaddr*>(&addr_), len);
+        getsockname(fd_, reinterpret_cast<struct sockaddr*>(&addr_), &len);
+        int size = 4 * 1024 * 1024;
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    ~UdpFd() { close(fd_); }
+    bool enableGro() {
+        int on = 1;
+        return setsockopt(fd_, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+    }
+    void connectTo(const UdpFd& other) { connect(fd_, other.addr(), sizeof(struct sockaddr_in)); }
+    int fd() const { return fd_; }
+    struct sockaddr* addr() const { return reinterpret_cast<struct sockaddr*>(const_cast<struct sockaddr_in*>(&addr_)); }
+
+private:
+    int fd_;
+    struct sockaddr_in addr_;
+};
+
+static Buffer::Ptr makePacket(size_t size, char tag) {
+    auto buf = BufferRaw::create(size);
+    buf->setSize(size);
+    memset(buf->data(), tag, size);
+    return buf;
+}
+
+// 读取当前所有数据包
+static std::vector<std::string> recvAll(SocketRecvmmsgBuffer& buffer, int fd) {
+    std::vector<std::string> ret;
+    ssize_t count = 0;
+    while (buffer.recvFromSocket(fd, count) > 0) {
+        for (ssize_t i = 0; i < count; ++i) {
+            ret.emplace_back(buffer.getBuffer(i)->toString());
+        }
+    }
+    return ret;
+}
+
+static bool supportGso(const UdpFd& fd) {
+    int seg = 0;
+    return setsockopt(fd.fd(), SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg)) == 0;
+}
+
+// 等长的连续数据包合并发送, 最后一个可以更短; 开启GRO的接收端按段长拆分
+TEST(UdpGsoTest, SendAndSplit) {
+    UdpFd sender, receiver;
+    if (!supportGso(sender) || !receiver.enableGro()) {
+        GTEST_SKIP() << "kernel does not support UDP GSO/GRO";
+    }
+    sender.connectTo(receiver);
+    List<std::pair<Buffer::Ptr, bool>> list;
+    for (int i = 0; i < 10; ++i) {
+        list.emplace_back(makePacket(1000, 'a' + i), false);
+    }
+    list.emplace_back(makePacket(500, 'z'), false);
+    list.emplace_back(makePacket(1000, 'y'), false);  // 短包之后重新开始一个消息
+    int succeeded = 0;
+    BufferSendMMsg send(std::move(list), [&](const Buffer::Ptr&, bool success) { succeeded += success; }, true);
+    EXPECT_EQ(send.count(), 12u);
+    EXPECT_EQ(send.send(sender.fd(), 0), 11500);
+    EXPECT_TRUE(send.empty());
+    EXPECT_EQ(send.count(), 0u);
+    EXPECT_EQ(succeeded, 12);
+
+    SocketRecvmmsgBuffer buffer(8, 64 * 1024, true);
+    auto packets = recvAll(buffer, receiver.fd());
+    ASSERT_EQ(packets.size(), 12u);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(packets[i], std::string(1000, 'a' + i));
+    }
+    EXPECT_EQ(packets[10], std::string(500, 'z'));
+    EXPECT_EQ(packets[11], std::string(1000, 'y'));
+}
+
+// 不同目标、超过段长上限的数据包不合并, 普通接收端收到的是内核切分后的数据包
+TEST(UdpGsoTest, NoMerge) {
+    UdpFd sender, receiver1, receiver2;
+    if (!supportGso(sender)) {
+        GTEST_SKIP() << "kernel does not support UDP GSO";
+    }
+    List<std::pair<Buffer::Ptr, bool>> list;
+    for (int i = 0; i < 3; ++i) {
+        list.emplace_back(std::make_shared<BufferSock>(makePacket(1000, 'a'), receiver1.addr()), true);
+        list.emplace_back(std::make_shared<BufferSock>(makePacket(1000, 'a'), receiver1.addr()), true);
+        list.emplace_back(std::make_shared<BufferSock>(makePacket(1000, 'b'), receiver2.addr()), true);
+    }
+    list.emplace_back(std::make_shared<BufferSock>(makePacket(3000, 'c'), receiver2.addr()), true);
+    list.emplace_back(std::make_shared<BufferSock>(makePacket(3000, 'c'), receiver2.addr()), true);
+    BufferSendMMsg send(std::move(list), nullptr, true);
+    EXPECT_EQ(send.send(sender.fd(), 0), 15000);
+    EXPECT_TRUE(send.empty());
+
+    SocketRecvmmsgBuffer buffer(32, 4 * 1024);
+    EXPECT_EQ(recvAll(buffer, receiver1.fd()), std::vector<std::string>(6, std::string(1000, 'a')));
+    auto packets = recvAll(buffer, receiver2.fd());
+    ASSERT_EQ(packets.size(), 5u);
+    EXPECT_EQ(packets[0], std::string(1000, 'b'));
+    EXPECT_EQ(packets[4], std::string(3000, 'c'));
+}
+
+// 拆分后的切片仍被会话引用时, 下次接收换用新的缓冲区
+TEST(UdpGsoTest, KeepSlices) {
+    UdpFd sender, receiver;
+    if (!supportGso(sender) || !receiver.enableGro()) {
+        GTEST_SKIP() << "kernel does not support UDP GSO/GRO";
+    }
+    sender.connectTo(receiver);
+    SocketRecvmmsgBuffer buffer(8, 64 * 1024, true);
+    std::vector<Buffer::Ptr> kept;
+    for (char tag : {'a', 'b'}) {
+        List<std::pair<Buffer::Ptr, bool>> list;
+        for (int i = 0; i < 4; ++i) {
+            list.emplace_back(makePacket(1000, tag), false);
+        }
+        BufferSendMMsg(std::move(list), nullptr, true).send(sender.fd(), 0);
+        ssize_t count = 0;
+        ASSERT_EQ(buffer.recvFromSocket(receiver.fd(), count), 4000);
+        ASSERT_EQ(count, 4);
+        kept.emplace_back(buffer.getBuffer(3));
+    }
+    EXPECT_EQ(kept[0]->toString(), std::string(1000, 'a'));
+    EXPECT_EQ(kept[1]->toString(), std::string(1000, 'b'));
+}
+
+// Socket开启GSO和GRO后收发数据
+TEST(UdpGsoTest, Socket) {
+    class UdpPoller : public TaskExecutorGetterImpl {
+    public:
+        UdpPoller() { addPoller("udp poller", 1, Thread_Priority::Highest, false, false); }
+        EventPoller::Ptr poller() { return std::static_pointer_cast<EventPoller>(threads_.front()); }
+    } getter;
+    auto poller = getter.poller();
+    auto sender = Socket::createSocket(poller);
+    auto receiver = Socket::createSocket(poller);
+    ASSERT_TRUE(sender->bindUdpSock(0, "127.0.0.1"));
+    ASSERT_TRUE(receiver->bindUdpSock(0, "127.0.0.1"));
+    if (!sender->enableUdpGso() || !receiver->enableUdpGro()) {
+        GTEST_SKIP() << "kernel does not support UDP GSO/GRO";
+    }
+    std::atomic<size_t> packets{0};
+    std::atomic<size_t> bytes{0};
+    std::atomic<bool> content_ok{true};
+    receiver->setOnRead([&](Buffer::Ptr& buf, struct sockaddr*, int) {
+        content_ok = content_ok && buf->toString() == std::string(buf->size(), buf->data()[0]);
+        ++packets;
+        bytes += buf->size();
+    });
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(receiver->getLocalPort());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_TRUE(sender->bindPeerAddr(reinterpret_cast<struct sockaddr*>(&addr)));
+    poller->sync([&]() {
+        for (int i = 0; i < 32; ++i) {
+            sender->send(makePacket(1200, 'a' + i % 26), nullptr, 0, false);
+        }
+        sender->flushAll();
+    });
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (packets < 32 && std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(packets, 32u);
+    EXPECT_EQ(bytes, 32u * 1200);
+    EXPECT_TRUE(content_ok);
+    poller->sync([&]() {
+        sender = nullptr;
+        receiver = nullptr;
+    });
+}
+
+// 内核拒绝合并消息时(这里用SO_NO_CHECK使GSO返回EINVAL)整批退回逐包发送, 不丢包
+TEST(UdpGsoTest, Fallback) {
+    UdpFd sender, receiver;
+    if (!supportGso(sender)) {
+        GTEST_SKIP() << "kernel does not support UDP GSO";
+    }
+    int on = 1;
+    setsockopt(sender.fd(), SOL_SOCKET, SO_NO_CHECK, &on, sizeof(on));
+    sender.connectTo(receiver);
+    List<std::pair<Buffer::Ptr, bool>> list;
+    for (int i = 0; i < 10; ++i) {
+        list.emplace_back(makePacket(1000, 'a' + i), false);
+    }
+    list.emplace_back(makePacket(500, 'z'), false);
+    int succeeded = 0;
+    BufferSendMMsg send(std::move(list), [&](const Buffer::Ptr&, bool success) { succeeded += success; }, true);
+    EXPECT_EQ(send.send(sender.fd(), 0), 10500);
+    if (!send.gsoFailed()) {
+        GTEST_SKIP() << "SO_NO_CHECK does not reject UDP GSO on this kernel";
+    }
+    EXPECT_TRUE(send.empty());
+    EXPECT_EQ(succeeded, 11);
+
+    SocketRecvmmsgBuffer buffer(32, 4 * 1024);
+    auto packets = recvAll(buffer, receiver.fd());
+    ASSERT_EQ(packets.size(), 11u);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(packets[i], std::string(1000, 'a' + i));
+    }
+    EXPECT_EQ(packets[10], std::string(500, 'z'));
+}
+
+// 回环网卡上每批发送32个1200字节的数据包后全部读出, 统计包速率
+TEST(UdpGsoBenchmark, PacketRate) {
+    constexpr int kBatch = 32;
+    constexpr int kRounds = 20000;
+    for (bool gso : {false, true}) {
+        UdpFd sender, receiver;
+        if (gso && (!supportGso(sender) || !receiver.enableGro())) {
+            GTEST_SKIP() << "kernel does not support UDP GSO/GRO";
+        }
+        sender.connectTo(receiver);
+        SocketRecvmmsgBuffer buffer(gso ? 8 : 32, gso ? 64 * 1024 : 4 * 1024, gso);
+        size_t received = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < kRounds; ++round) {
+            List<std::pair<Buffer::Ptr, bool>> list;
+            for (int i = 0; i < kBatch; ++i) {
+                list.emplace_back(makePacket(1200, 'p'), false);
+            }
+            BufferSendMMsg(std::move(list), nullptr, gso).send(sender.fd(), 0);
+            ssize_t count = 0;
+            while (buffer.recvFromSocket(receiver.fd(), count) > 0) {
+                received += count;
+            }
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        EXPECT_EQ(received, static_cast<size_t>(kBatch) * kRounds);
+        std::cout << (gso ? "GSO/GRO" : "sendmmsg/recvmmsg") << ": " << received * 1000 / (ms ? ms : 1)
+                  << " packets/s" << std::endl;
+    }
+}
@@ -0,0 +1,262 @@
+/*
+ * 测试UdpServer的对端id和分片会话表: ipv4与映射后的ipv6地址得到相同id, 同一对端只创建一个会话,
+ * 多线程下所有对端的数据包都投递到各自的会话, 每个poller使用独立的SO_REUSEPORT监听socket,
+ * 并对比原先字符串id加全局递归锁的查找耗时
+ */
+#include <gtest/gtest.h>
+#include "udpserver.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 固定4个poller, 单核机器上也覆盖多个poller的情况
+static bool s_pool_size = []() {
+    EventPollerPool::setPoolSize(4);
+    return true;
+}();
+
+static struct sockaddr_in makeAddr4(const char* ip, uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &addr.sin_addr);
+    return addr;
+}
+
+static struct sockaddr_in6 makeAddr6(const char* ip, uint16_t port) {
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_port = htons(port);
+    inet_pton(AF_INET6, ip, &addr.sin6_addr);
+    return addr;
+}
+
+static UdpPeerId makeId(const struct sockaddr_in& addr) {
+    return UdpPeerId::make(reinterpret_cast<const struct sockaddr*>(&addr));
+}
+
+static UdpPeerId makeId(const struct sockaddr_in6& addr) {
+    return UdpPeerId::make(reinterpret_cast<const struct sockaddr*>(&addr));
+}
+
+// 统计收到的数据包
+class CountSession : public Session {
+public:
+    static std::atomic<size_t> s_packets;
+    static std::atomic<size_t> s_sessions;
+
+    CountSession(const Socket::Ptr& sock) : Session(sock) { ++s_sessions; }
+
+    void onRecv(const Buffer::Ptr&) override { ++s_packets; }
+    void onErr(const SockException&) override {}
+    void onFlush() override {}
+    void onManager() override {}
+};
+std::atomic<size_t> CountSession::s_packets{0};
+std::atomic<size_t> CountSession::s_sessions{0};
+
+static SessionHelper::Ptr makeHelper() {
+    auto sock = Socket::createSocket(EventPollerPool::Instance().getPoller(), false);
+    return std::make_shared<SessionHelper>(std::weak_ptr<Server>(), std::make_shared<CountSession>(sock), "CountSession");
+}
+
+TEST(UdpPeerIdTest, Make) {
+    auto v4 = makeId(makeAddr4("192.168.1.10", 5000));
+    auto mapped = makeId(makeAddr6("::ffff:192.168.1.10", 5000));
+    EXPECT_EQ(v4, mapped);
+    EXPECT_EQ(UdpPeerIdHash()(v4), UdpPeerIdHash()(mapped));
+    EXPECT_NE(v4, makeId(makeAddr4("192.168.1.10", 5001)));
+    EXPECT_NE(v4, makeId(makeAddr4("192.168.1.11", 5000)));
+    EXPECT_NE(v4, makeId(makeAddr6("fe80::1", 5000)));
+}
+
+// 同一对端只创建一次会话; 移除后返回被移除的会话
+TEST(UdpSessionTableTest, FindOrCreate) {
+    UdpSessionTable table(4);
+    auto id = makeId(makeAddr4("10.0.0.1", 1234));
+    EXPECT_EQ(table.find(id), nullptr);
+    EXPECT_EQ(table.findOrCreate(id, []() { return nullptr; }), nullptr);
+    EXPECT_EQ(table.size(), 0u);
+
+    int created = 0;
+    auto creator = [&]() {
+        ++created;
+        return makeHelper();
+    };
+    auto helper = table.findOrCreate(id, creator);
+    ASSERT_TRUE(helper);
+    EXPECT_EQ(table.findOrCreate(id, creator), helper);
+    EXPECT_EQ(table.find(id), helper);
+    EXPECT_EQ(created, 1);
+
+    for (uint16_t port = 1; port <= 100; ++port) {
+        table.findOrCreate(makeId(makeAddr4("10.0.0.2", port)), creator);
+    }
+    EXPECT_EQ(table.size(), 101u);
+    EXPECT_EQ(table.getAll().size(), 101u);
+    EXPECT_EQ(table.erase(id), helper);
+    EXPECT_EQ(table.erase(id), nullptr);
+    EXPECT_EQ(table.find(id), nullptr);
+    table.clear();
+    EXPECT_EQ(table.size(), 0u);
+}
+
+// 多个对端同时发送, 每个对端一个会话, 所有数据包都被会话收到
+static void floodServer(const UdpServer::Ptr& server) {
+    constexpr int kPeers = 32;
+    constexpr int kPackets = 20;
+    CountSession::s_packets = 0;
+    CountSession::s_sessions = 0;
+    auto addr = makeAddr4("127.0.0.1", server->getPort());
+
+    std::vector<int> fds;
+    for (int i = 0; i < kPeers; ++i) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        fds.emplace_back(fd);
+    }
+    for (int round = 0; round < kPackets; ++round) {
+        for (auto fd : fds) {
+            ::send(fd, "ping", 4, 0);
+        }
+        // 首包之后等会话建立, 避免对端socket建立前的数据包被内核丢弃
+        if (round == 0) {
+            for (int i = 0; i < 100 && CountSession::s_sessions < kPeers; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+    for (int i = 0; i < 200 && CountSession::s_packets < kPeers * kPackets; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(CountSession::s_sessions, static_cast<size_t>(kPeers));
+    EXPECT_EQ(CountSession::s_packets, static_cast<size_t>(kPeers * kPackets));
+    for (auto fd : fds) {
+        close(fd);
+    }
+}
+
+// 本进程中绑定在port上且没有connect的udp socket个数
+static size_t countListeners(uint16_t port) {
+    size_t count = 0;
+    auto dir = opendir("/proc/self/fd");
+    while (auto entry = readdir(dir)) {
+        int fd = atoi(entry->d_name);
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        int type = 0;
+        socklen_t type_len = sizeof(type);
+        if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len) == -1 || type != SOCK_DGRAM ||
+            getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) == -1 || addr.ss_family != AF_INET ||
+            ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port) != port) {
+            continue;
+        }
+        len = sizeof(addr);
+        count += getpeername(fd, reinterpret_cast<struct sockaddr*>(&addr), &len) == -1;
+    }
+    closedir(dir);
+    return count;
+}
+
+TEST(UdpServerTest, ManyPeers) {
+    auto server = std::make_shared<UdpServer>();
+    server->start<CountSession>(0, "127.0.0.1");
+    EXPECT_EQ(countListeners(server->getPort()), 1u);
+    floodServer(server);
+}
+
+// 每个poller绑定自己的监听socket, 可选按收包cpu分发
+TEST(UdpServerTest, ReusePort) {
+    for (bool cpu_steering : {false, true}) {
+        auto server = std::make_shared<UdpServer>();
+        server->enableReusePort(true, cpu_steering);
+        server->start<CountSession>(0, "127.0.0.1");
+        EXPECT_EQ(countListeners(server->getPort()), EventPollerPool::Instance().getExecutorSize());
+        floodServer(server);
+    }
+}
+
+// 原先的实现: 每个数据包生成18字节的字符串id, 在全局递归锁下查找
+class LegacyTable {
+public:
+    static std::string makeId(const struct sockaddr_in& addr) {
+        static const uint8_t prefix[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+        std::string ret;
+        ret.resize(18);
+        ret[0] = addr.sin_port >> 8;
+        ret[1] = addr.sin_port & 0xFF;
+        memcpy(&ret[2], prefix, 12);
+        memcpy(&ret[14], &addr.sin_addr, 4);
+        return ret;
+    }
+    SessionHelper::Ptr find(const struct sockaddr_in& addr) {
+        auto id = makeId(addr);
+        std::lock_guard<std::recursive_mutex> lock(mtx_);
+        auto it = map_.find(id);
+        return it == map_.end() ? nullptr : it->second;
+    }
+    void add(const struct sockaddr_in& addr, const SessionHelper::Ptr& helper) { map_.emplace(makeId(addr), helper); }
+
+private:
+    std::recursive_mutex mtx_;
+    std::unordered_map<std::string, SessionHelper::Ptr> map_;
+};
+
+// 多个线程模拟每个poller收到数据包时查找会话, 统计每个数据包的查找耗时
+template <typename Lookup>
+static uint64_t floodLookup(Lookup lookup, const std::vector<struct sockaddr_in>& peers, int threads, int count) {
+    std::vector<std::thread> workers;
+    std::atomic<size_t> found{0};
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            size_t hit = 0;
+            for (int i = 0; i < count; ++i) {
+                hit += lookup(peers[(i * 7 + t) % peers.size()]) != nullptr;
+            }
+            found += hit;
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_EQ(found, static_cast<size_t>(threads) * count);
+    return ns / (threads * count);
+}
+
+TEST(UdpServerBenchmark, Lookup) {
+    constexpr int kPeers = 4096;
+    constexpr int kCount = 500000;
+    std::vector<struct sockaddr_in> peers;
+    LegacyTable legacy;
+    UdpSessionTable table(8);
+    for (int i = 0; i < kPeers; ++i) {
+        peers.emplace_back(makeAddr4("10.1.0.0", 0));
+        peers.back().sin_addr.s_addr = htonl(0x0A010000 + i / 16);
+        peers.back().sin_port = htons(10000 + i % 16);
+        auto helper = makeHelper();
+        legacy.add(peers.back(), helper);
+        table.findOrCreate(makeId(peers.back()), [&helper]() { return helper; });
+    }
+    for (int threads : {1, 4}) {
+        auto legacy_ns = floodLookup([&](const struct sockaddr_in& addr) { return legacy.find(addr); },
+                                     peers, threads, kCount);
+        auto table_ns = floodLookup([&](const struct sockaddr_in& addr) { return table.find(makeId(addr)); },
+                                    peers, threads, kCount);
+        std::cout << threads << " threads: string id + global lock " << legacy_ns << " ns/packet, peer id + sharded table "
+                  << table_ns << " ns/packet" << std::endl;
+    }
+}
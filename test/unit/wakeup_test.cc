@@ -0,0 +1,102 @@
+/*
+ * 测试EventPoller的唤醒方式, 对比eventfd和管道的跨线程async延时和吞吐
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "threadpool.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+// 单独创建一个指定唤醒方式的poller, 不影响EventPollerPool
+class WakeupPoller : public TaskExecutorGetterImpl {
+public:
+    explicit WakeupPoller(Wakeup::Type type) {
+        EventPollerPool::setWakeupType(type);
+        addPoller("wakeup poller", 1, Thread_Priority::Highest, false, false);
+        EventPollerPool::setWakeupType(Wakeup::Type::EventFd);
+    }
+
+    EventPoller::Ptr poller() { return std::static_pointer_cast<EventPoller>(threads_.front()); }
+};
+
+static const char* typeName(Wakeup::Type type) {
+    return type == Wakeup::Type::EventFd ? "eventfd" : "pipe";
+}
+
+// 一来一回: 每次投递时poller都处于休眠状态, 统计唤醒延时
+static double pingPong(const EventPoller::Ptr& poller, int count) {
+    std::atomic<bool> done{false};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        done = false;
+        poller->async([&done]() { done = true; }, false);
+        while (!done) {
+            std::this_thread::yield();
+        }
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(ns) / count;
+}
+
+// 多线程连续投递, 统计吞吐
+static double throughput(const EventPoller::Ptr& poller, int producers, int count) {
+    std::atomic<int> done{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < count; ++i) {
+                poller->async([&done]() { ++done; }, false);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    while (done < producers * count) {
+        std::this_thread::yield();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(producers) * count * 1e9 / ns;
+}
+
+TEST(WakeupTest, Type) {
+    WakeupPoller eventfd(Wakeup::Type::EventFd);
+    WakeupPoller pipe(Wakeup::Type::Pipe);
+    EXPECT_EQ(eventfd.poller()->getWakeupType(), Wakeup::Type::EventFd);
+    EXPECT_EQ(pipe.poller()->getWakeupType(), Wakeup::Type::Pipe);
+}
+
+// 重复唤醒会合并, drain一次即可清空
+TEST(WakeupTest, Coalesce) {
+    for (auto type : {Wakeup::Type::EventFd, Wakeup::Type::Pipe}) {
+        auto wakeup = Wakeup::create(type);
+        ASSERT_EQ(wakeup->type(), type);
+        for (int i = 0; i < 100; ++i) {
+            wakeup->notify();
+        }
+        EXPECT_TRUE(wakeup->drain()) << typeName(type);
+        EXPECT_TRUE(wakeup->drain()) << typeName(type);  // 已读空时返回EAGAIN, 依然有效
+        wakeup->reOpen();
+        wakeup->notify();
+        EXPECT_TRUE(wakeup->drain()) << typeName(type);
+    }
+}
+
+TEST(WakeupTest, Benchmark) {
+    for (auto type : {Wakeup::Type::EventFd, Wakeup::Type::Pipe}) {
+        WakeupPoller getter(type);
+        auto poller = getter.poller();
+        auto latency = pingPong(poller, 20000);
+        auto tps = throughput(poller, 4, 100000);
+        std::cout << typeName(type) << " async latency: " << latency << " ns, throughput: "
+                  << static_cast<uint64_t>(tps) << " tasks/s" << std::endl;
+    }
+}
@@ -0,0 +1,360 @@
+/*
+ * 测试WorkStealingQueue和工作窃取线程池, 并对比基于MsgQueue的旧线程池的性能
+ */
+#include <gtest/gtest.h>
+#include "workstealingqueue.h"
+#include "msgqueue.h"
+#include "threadpool.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace xkernel;
+
+static void waitCount(const std::atomic<int>& count, int total) {
+    while (count < total) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// 所属线程后进先出, 窃取线程先进先出
+TEST(WorkStealingQueueTest, Order) {
+    WorkStealingQueue<int*> queue(4);
+    int values[3] = {0, 1, 2};
+    for (auto& v : values) {
+        queue.push(&v);
+    }
+    EXPECT_EQ(queue.size(), 3u);
+    int* value = nullptr;
+    EXPECT_TRUE(queue.steal(value));
+    EXPECT_EQ(*value, 0);
+    EXPECT_TRUE(queue.pop(value));
+    EXPECT_EQ(*value, 2);
+    EXPECT_TRUE(queue.pop(value));
+    EXPECT_EQ(*value, 1);
+    EXPECT_FALSE(queue.pop(value));
+    EXPECT_FALSE(queue.steal(value));
+    EXPECT_TRUE(queue.empty());
+}
+
+// 超过容量时自动扩容, 元素不丢失
+TEST(WorkStealingQueueTest, Grow) {
+    WorkStealingQueue<uintptr_t> queue(4);
+    EXPECT_EQ(queue.capacity(), 4u);
+    for (uintptr_t i = 0; i < 100; ++i) {
+        queue.push(i);
+    }
+    EXPECT_EQ(queue.capacity(), 128u);
+    uintptr_t value;
+    for (uintptr_t i = 0; i < 50; ++i) {
+        ASSERT_TRUE(queue.steal(value));
+        EXPECT_EQ(value, i);
+    }
+    for (uintptr_t i = 100; i-- > 50;) {
+        ASSERT_TRUE(queue.pop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+// 所属线程push/pop的同时多个线程窃取, 每个元素恰好被取出一次
+TEST(WorkStealingQueueTest, ConcurrentSteal) {
+    constexpr uintptr_t kCount = 200000;
+    constexpr int kThieves = 3;
+    WorkStealingQueue<uintptr_t> queue(64);
+    std::vector<std::atomic<int>> seen(kCount);
+    std::atomic<bool> done{false};
+    std::atomic<uintptr_t> taken{0};
+
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < kThieves; ++t) {
+        thieves.emplace_back([&]() {
+            uintptr_t value;
+            while (!done || !queue.empty()) {
+                if (queue.steal(value)) {
+                    ++seen[value];
+                    ++taken;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    uintptr_t value;
+    for (uintptr_t i = 0; i < kCount; ++i) {
+        queue.push(i);
+        if (i % 3 == 0 && queue.pop(value)) {
+            ++seen[value];
+            ++taken;
+        }
+    }
+    while (queue.pop(value)) {
+        ++seen[value];
+        ++taken;
+    }
+    done = true;
+    for (auto& t : thieves) {
+        t.join();
+    }
+    EXPECT_EQ(taken, kCount);
+    for (uintptr_t i = 0; i < kCount; ++i) {
+        ASSERT_EQ(seen[i], 1) << i;
+    }
+}
+
+// 外部线程投递的任务全部执行
+TEST(ThreadPoolTest, Async) {
+    std::atomic<int> count{0};
+    ThreadPool pool(4, Thread_Priority::Highest, true, false);
+    for (int i = 0; i < 10000; ++i) {
+        pool.async([&count]() { ++count; });
+    }
+    for (int i = 0; i < 1000 && count < 10000; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(count, 10000);
+}
+
+// 析构时先执行完已投递的任务, 包括执行过程中新投递的任务, 工作线程才退出
+TEST(ThreadPoolTest, DrainOnShutdown) {
+    std::atomic<int> count{0};
+    {
+        ThreadPool pool(4, Thread_Priority::Highest, true, false);
+        for (int i = 0; i < 10000; ++i) {
+            pool.async([&pool, &count, i]() {
+                if (i % 100 == 0) {
+                    pool.async([&count]() { ++count; }, false);
+                }
+                ++count;
+            });
+        }
+    }
+    EXPECT_EQ(count, 10100);
+}
+
+// asyncFirst投递的任务优先于普通任务执行, 后投递的先执行
+TEST(ThreadPoolTest, AsyncFirst) {
+    std::vector<int> order;
+    {
+        ThreadPool pool(1, Thread_Priority::Highest, false, false);
+        for (int i = 0; i < 3; ++i) {
+            pool.async([&order, i]() { order.push_back(i); });
+        }
+        pool.asyncFirst([&order]() { order.push_back(100); });
+        pool.asyncFirst([&order]() { order.push_back(101); });
+        EXPECT_EQ(pool.size(), 5u);
+        pool.start();
+        pool.sync([]() {});  // 只有一个工作线程, 同步任务执行时之前的任务都已执行
+    }
+    EXPECT_EQ(order, (std::vector<int>{101, 100, 0, 1, 2}));
+}
+
+// 工作线程内投递: may_sync时直接执行, 否则放入自己的队列, 可以被取消
+TEST(ThreadPoolTest, AsyncInWorker) {
+    std::atomic<int> count{0};
+    std::atomic<bool> sync_run{false};
+    {
+        ThreadPool pool(2, Thread_Priority::Highest, true, false);
+        pool.sync([&]() {
+            pool.async([&]() { sync_run = true; });
+            EXPECT_TRUE(sync_run);
+            auto task = pool.async([&]() { count += 100; }, false);
+            task->cancel();
+            for (int i = 0; i < 1000; ++i) {
+                pool.async([&count]() { ++count; }, false);
+            }
+        });
+        waitCount(count, 1000);
+    }
+    EXPECT_EQ(count, 1000);
+}
+
+// 只有一个工作线程时, 线程内和外部投递的任务都按投递顺序执行
+TEST(ThreadPoolTest, SingleWorkerOrder) {
+    std::vector<int> order;
+    {
+        ThreadPool pool(1, Thread_Priority::Highest, true, false);
+        pool.sync([&]() {
+            for (int i = 0; i < 100; ++i) {
+                pool.async([&order, i]() { order.push_back(i); }, false);
+            }
+        });
+        for (int i = 100; i < 200; ++i) {
+            pool.async([&order, i]() { order.push_back(i); });
+        }
+        pool.sync([]() {});
+    }
+    ASSERT_EQ(order.size(), 200u);
+    for (int i = 0; i < 200; ++i) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+// 线程池的负载是所有工作线程的平均值, 两个线程中只有一个忙碌时约为50
+TEST(ThreadPoolTest, Load) {
+    ThreadPool pool(2, Thread_Priority::Highest, true, false);
+    std::atomic<bool> started{false};
+    // 工作线程是实时优先级, 用sleep代替忙等, 避免单核时饿死测试线程; 任务执行期间都计为运行
+    pool.async([&]() {
+        started = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    });
+    while (!started) {
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto load = pool.load();
+    EXPECT_GE(load, 25);
+    EXPECT_LE(load, 75);
+}
+
+// 一个工作线程内投递的大量耗时任务会被其他空闲线程窃取
+TEST(ThreadPoolTest, Steal) {
+    std::mutex mtx;
+    std::set<std::thread::id> ids;
+    std::atomic<int> done{0};
+    {
+        ThreadPool pool(4, Thread_Priority::Highest, true, false);
+        pool.async([&]() {
+            for (int i = 0; i < 40; ++i) {
+                pool.async([&]() {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                    std::lock_guard<std::mutex> lock(mtx);
+                    ids.emplace(std::this_thread::get_id());
+                    ++done;
+                }, false);
+            }
+        });
+        waitCount(done, 40);
+    }
+    EXPECT_GT(ids.size(), 1u);
+}
+
+// putMsg、putMsgToHead和getMsg并发修改同一个队列, 每条消息恰好取出一次
+TEST(MsgQueueTest, ConcurrentPutAndGet) {
+    constexpr int kPerProducer = 50000;
+    MsgQueue<int> queue(SIZE_MAX);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 3; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < kPerProducer; ++i) {
+                if (p == 0) {
+                    queue.putMsgToHead(1);
+                } else {
+                    queue.putMsg(1);
+                }
+            }
+        });
+    }
+    int sum = 0;
+    int msg;
+    for (int i = 0; i < 3 * kPerProducer; ++i) {
+        ASSERT_TRUE(queue.getMsg(msg));
+        sum += msg;
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    EXPECT_EQ(sum, 3 * kPerProducer);
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+// 原来基于单个MsgQueue的线程池, 用于性能对比
+class MsgQueuePool {
+public:
+    MsgQueuePool(size_t num, bool auto_run) : num_(num), queue_(SIZE_MAX) {
+        if (auto_run) {
+            start();
+        }
+    }
+    ~MsgQueuePool() {
+        for (size_t i = 0; i < num_; ++i) {
+            queue_.putMsg(nullptr);  // 空任务作为退出标记
+        }
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    void async(TaskIn task) { queue_.putMsg(std::make_shared<Task>(std::move(task))); }
+
+    void start() {
+        for (size_t i = 0; i < num_; ++i) {
+            threads_.emplace_back([this]() {
+                ThreadPool::setPriority(Thread_Priority::Highest);
+                Task::Ptr task;
+                while (queue_.getMsg(task) && task) {
+                    (*task)();
+                }
+            });
+        }
+    }
+
+private:
+    size_t num_;
+    MsgQueue<Task::Ptr> queue_;
+    std::vector<std::thread> threads_;
+};
+
+static uint64_t elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 对应ZLToolKit的test_threadPoolBenchmark: 先入队再启动线程, 分别统计入队和执行耗时
+template <typename Pool>
+static void enqueueThenRun(const char* name, int total) {
+    std::atomic<int> count{0};
+    Pool pool(1, false);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < total; ++i) {
+        pool.async([&count]() { ++count; });
+    }
+    auto enqueue_ms = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    pool.start();
+    waitCount(count, total);
+    std::cout << name << " enqueue " << total << " tasks: " << enqueue_ms << " ms, run: " << elapsedMs(start)
+              << " ms" << std::endl;
+}
+
+// 多个外部线程同时投递
+template <typename Pool>
+static void multiProducer(const char* name, int workers, int producers, int per_producer) {
+    std::atomic<int> count{0};
+    Pool pool(workers, true);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < per_producer; ++i) {
+                pool.async([&count]() { ++count; });
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    waitCount(count, producers * per_producer);
+    std::cout << name << " " << producers << " producers -> " << workers << " workers, "
+              << producers * per_producer << " tasks: " << elapsedMs(start) << " ms" << std::endl;
+}
+
+class WorkStealingPool : public ThreadPool {
+public:
+    WorkStealingPool(int num, bool auto_run) : ThreadPool(num, Thread_Priority::Highest, auto_run, false) {}
+    void async(TaskIn task) { ThreadPool::async(std::move(task), false); }
+};
+
+TEST(ThreadPoolBenchmark, CompareMsgQueuePool) {
+    constexpr int kTotal = 1000 * 1000;
+    enqueueThenRun<MsgQueuePool>("msgqueue pool", kTotal);
+    enqueueThenRun<WorkStealingPool>("work stealing pool", kTotal);
+
+    int workers = std::max(2u, std::thread::hardware_concurrency());
+    multiProducer<MsgQueuePool>("msgqueue pool", workers, 4, kTotal / 8);
+    multiProducer<WorkStealingPool>("work stealing pool", workers, 4, kTotal / 8);
+}
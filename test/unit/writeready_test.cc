@@ -0,0 +1,118 @@
+/*
+ * 测试Socket的可写事件处理: 可写事件在注册时以边沿触发监听, 发送缓冲区满和清空时只修改用户态标记,
+ * 通过替换epoll_ctl统计发送过程中的EPOLL_CTL_MOD调用次数, 并检查数据完整且onceFlushed仍然生效
+ */
+#include <gtest/gtest.h>
+#include "eventpoller.h"
+#include "socket.h"
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace xkernel;
+
+static std::atomic<int> s_watch_fd{-1};
+static std::atomic<size_t> s_modify_count{0};
+
+// 替换libc的epoll_ctl, 统计对s_watch_fd的EPOLL_CTL_MOD调用
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+    using EpollCtl = int (*)(int, int, int, struct epoll_event*);
+    static auto real = reinterpret_cast<EpollCtl>(dlsym(RTLD_NEXT, "epoll_ctl"));
+    if (op == EPOLL_CTL_MOD && fd == s_watch_fd) {
+        ++s_modify_count;
+    }
+    return real(epfd, op, fd, event);
+}
+
+// 发送端交给Socket管理并缩小发送缓冲区, 接收端由测试线程直接读取
+class StreamPair {
+public:
+    StreamPair() {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds_);
+        int size = 4 * 1024;
+        setsockopt(fds_[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        sender_ = Socket::createSocket(EventPollerPool::Instance().getPoller(), true);
+        sender_->fromSock(fds_[0], SockNum::SockType::TCP);
+        s_watch_fd = sender_->rawFd();
+        s_modify_count = 0;
+    }
+    ~StreamPair() {
+        s_watch_fd = -1;
+        sender_->closeSock();
+        close(fds_[1]);
+    }
+    const Socket::Ptr& sender() const { return sender_; }
+
+    // 先等待delay让发送端写满, 再读取size字节, 返回读到的数据
+    std::string read(size_t size, std::chrono::milliseconds delay) {
+        std::this_thread::sleep_for(delay);
+        std::string ret;
+        char buf[16 * 1024];
+        while (ret.size() < size) {
+            auto n = ::read(fds_[1], buf, sizeof(buf));
+            if (n <= 0) {
+                break;
+            }
+            ret.append(buf, n);
+        }
+        return ret;
+    }
+
+private:
+    int fds_[2];
+    Socket::Ptr sender_;
+};
+
+static std::string makeData(size_t count, size_t size) {
+    std::string ret;
+    for (size_t i = 0; i < count; ++i) {
+        ret.append(size, static_cast<char>('a' + i % 26));
+    }
+    return ret;
+}
+
+// 其他线程发送, 发送缓冲区反复写满和清空
+TEST(WriteReadyTest, SendFromThread) {
+    constexpr size_t kCount = 20000;
+    constexpr size_t kSize = 512;
+    StreamPair pair;
+    auto expect = makeData(kCount, kSize);
+    std::thread sender([&]() {
+        for (size_t i = 0; i < kCount; ++i) {
+            pair.sender()->send(expect.data() + i * kSize, kSize);
+        }
+    });
+    EXPECT_EQ(pair.read(expect.size(), std::chrono::milliseconds(50)), expect);
+    sender.join();
+
+    std::atomic<bool> flushed{false};
+    pair.sender()->onceFlushed([&]() { flushed = true; });
+    for (int i = 0; i < 100 && !flushed; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(flushed);
+    EXPECT_FALSE(pair.sender()->isSocketBusy());
+    EXPECT_EQ(s_modify_count, 0u);
+}
+
+// poller线程发送, 缓冲区满后由可写事件继续发送
+TEST(WriteReadyTest, SendFromPoller) {
+    constexpr size_t kCount = 2000;
+    constexpr size_t kSize = 1024;
+    StreamPair pair;
+    auto expect = makeData(kCount, kSize);
+    pair.sender()->getPoller()->async([&]() {
+        for (size_t i = 0; i < kCount; ++i) {
+            pair.sender()->send(expect.data() + i * kSize, kSize);
+        }
+        EXPECT_TRUE(pair.sender()->isSocketBusy());
+    });
+    EXPECT_EQ(pair.read(expect.size(), std::chrono::milliseconds(50)), expect);
+    pair.sender()->getPoller()->sync([]() {});
+    EXPECT_EQ(s_modify_count, 0u);
+}